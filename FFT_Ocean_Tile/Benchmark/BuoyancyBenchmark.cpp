@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+
+#include <omp.h>
+
+#include "BuoyancySolver.h"
+#include "SimulationPipeline.h"
+
+//================================================================================
+//
+//        Times BuoyancySolver on a frame of the CPU simulation, for 1k, 10k
+//        and 100k probes, from one thread up to all of them, with the
+//        probes sorted by tile and in the order of their bodies.
+//        Usage: BuoyancyBenchmark [steps]
+//
+//================================================================================
+
+//================================================================================
+// Constants
+//================================================================================
+constexpr uint32_t kProbeCounts[] = { 1000, 10000, 100000 };
+constexpr uint32_t kProbesPerBody = 4;		// A probe under every corner of a 2 m raft
+constexpr int kWarmupSteps = 5;
+constexpr int kMinSteps = 5;
+constexpr float kTimeStep = 1.0f / 60;
+
+//================================================================================
+// Benchmark helpers
+//================================================================================
+
+// Rafts scattered over the tile, resting on the water
+void add_rafts(BuoyancySolver& solver, OceanSurface& surface, const uint32_t& probes)
+{
+	static const BuoyancyProbe raft[kProbesPerBody] =
+	{
+		{ { -1, 0, -1 }, 0.5f, 200 },
+		{ { 1, 0, -1 }, 0.5f, 200 },
+		{ { -1, 0, 1 }, 0.5f, 200 },
+		{ { 1, 0, 1 }, 0.5f, 200 },
+	};
+
+	std::mt19937 e2(1);
+	std::uniform_real_distribution<float> dist(0, surface.getTileSize());
+
+	solver.Clear();
+	for (uint32_t b(0); b < probes / kProbesPerBody; ++b)
+	{
+		float position[3] = { dist(e2), 0, dist(e2) };
+		position[1] = surface.Query(position[0], position[2]).height;
+
+		// Floats with its probes half under water
+		solver.Add_Body(position, 1000, raft, kProbesPerBody);
+	}
+}
+
+// Milliseconds per step
+double time_steps(BuoyancySolver& solver, OceanSurface& surface, const int& steps)
+{
+	CStopWatch timer;
+
+	for (int s = 0; s < kWarmupSteps; ++s)
+		solver.Step(surface, kTimeStep);
+
+	timer.startTimer();
+	for (int s = 0; s < steps; ++s)
+		solver.Step(surface, kTimeStep);
+	timer.stopTimer();
+
+	return timer.getElapsedTime() * 1000.0 / steps;
+}
+
+//================================================================================
+// Entry point
+//================================================================================
+int main(int argc, char* argv[])
+{
+	const int steps = (argc > 1 && atoi(argv[1]) > 0) ? atoi(argv[1]) : 100;
+	const int maxThreads = omp_get_max_threads();
+
+	// Two frames of the default ocean, so the surface has a velocity
+	PipelineSettings settings;
+	settings.mode = kPipelineCpuNormFFT;
+	settings.seed = 7;
+	settings.textureFormat = kTextureRGBA32F;
+
+	std::unique_ptr<SimulationPipeline> pipeline = CreatePipeline(settings.mode);
+	std::unique_ptr<FFTWrapper> wrapper = pipeline->Create_Wrapper(settings);
+	wrapper->Generate_Heightmap();
+
+	const PipelineFrame frame = { 1.3f, 1.2f, 2.0f, kTimeStep, settings.seaState, 0 };
+	OceanSurface surface;
+	for (int f = 0; f < 2; ++f)
+	{
+		pipeline->Step(*wrapper, frame);
+		surface.Update(*wrapper, wrapper->getTextures(), frame.choppy, frame.heightAdj, kTimeStep);
+	}
+
+	printf("%s at %dx%d, %d cascades, %d probes per body, %d steps at %u probes\n", PipelineModeName(settings.mode),
+		settings.gridSize, settings.gridSize, settings.cascades, kProbesPerBody, steps, kProbeCounts[2]);
+	printf("%8s %8s %14s %14s %12s %8s\n", "Probes", "Threads", "ms (sorted)", "ms (unsorted)", "ns/probe", "Scaling");
+
+	for (const uint32_t& probes : kProbeCounts)
+	{
+		// Same amount of work per probe count
+		const int probeSteps = std::max(kMinSteps, (int)(steps * (uint64_t)kProbeCounts[2] / probes));
+		double oneThreadMs = 0;
+
+		// 1, 2, 4, ... threads, then all of them
+		for (int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+		{
+			BuoyancySolver solver(threads);
+
+			add_rafts(solver, surface, probes);
+			const double sortedMs = time_steps(solver, surface, probeSteps);
+
+			add_rafts(solver, surface, probes);
+			solver.setSortProbes(false);
+			const double unsortedMs = time_steps(solver, surface, probeSteps);
+
+			if (threads == 1)
+				oneThreadMs = sortedMs;
+
+			printf("%8u %8d %14.3f %14.3f %12.1f %7.2fx\n", probes, threads, sortedMs, unsortedMs,
+				sortedMs * 1e6 / probes, oneThreadMs / sortedMs);
+
+			if (threads == maxThreads)
+				break;
+		}
+	}
+
+	return 0;
+}
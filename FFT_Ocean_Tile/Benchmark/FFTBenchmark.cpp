@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+
+#include <omp.h>
+
+#include "SimulationPipeline.h"
+
+//================================================================================
+//
+//        Times the per-frame IFFTs of FFTWrapper, one batched plan of
+//        every field, on every FFT backend built in, for every grid size
+//        and from one thread up to all of them. Checks first that the
+//        cascades of every spectrum model fall off.
+//        Usage: FFTBenchmark [-measure] [-c2r] [frames]
+//
+//================================================================================
+
+//================================================================================
+// Constants
+//================================================================================
+constexpr int kFieldCount = 3;		// Height, X and Z displacement
+constexpr int kGridSizes[] = { 256, 512, 1024, 2048 };
+constexpr int kWarmupFrames = 5;
+constexpr int kMinFrames = 5;
+constexpr int kCheckGridSize = 128;		// Grid of the cascade check
+
+//================================================================================
+// Benchmark helpers
+//================================================================================
+
+// Planning with FFTW_MEASURE overwrites the arrays, so the
+// random spectrum is filled in after the plans are made
+void fill_spectrum(fftwf_complex* pIn, const int& size)
+{
+	static std::mt19937 e2(1);
+	std::normal_distribution<float> dist(0, 1);
+
+	for (int i = 0; i < size; ++i)
+	{
+		pIn[i][0] = dist(e2);
+		pIn[i][1] = dist(e2);
+	}
+}
+
+template<typename Frame>
+double time_frames(const int& frames, Frame frame)
+{
+	CStopWatch timer;
+
+	for (int f = 0; f < kWarmupFrames; ++f)
+		frame();
+
+	timer.startTimer();
+	for (int f = 0; f < frames; ++f)
+		frame();
+	timer.stopTimer();
+
+	// Milliseconds per frame
+	return timer.getElapsedTime() * 1000.0 / frames;
+}
+
+// Nominal 5 N log2(N) flops per complex transform of N points, half of it for c2r,
+// so GFLOP/s compare the backends on the same work whatever their algorithm
+double nominal_flops(const int& n, const bool& realOutput)
+{
+	const double points = (double)n * n;
+	return kFieldCount * (realOutput ? 2.5 : 5.0) * points * log2(points);
+}
+
+// Height variance of every cascade of a frame of each spectrum model. A
+// cascade holds shorter waves than the one before it, so it has to hold
+// less energy. Returns false if a cascade doesn't fall off.
+bool check_cascades()
+{
+	PipelineSettings settings;
+	settings.mode = kPipelineCpuNormFFT;
+	settings.gridSize = kCheckGridSize;
+	settings.backend = kBackendStockham;
+	settings.plannerPolicy = kPlanEstimate;
+	settings.cascades = FFTWrapper::kMaxCascades;
+	settings.seed = 1;
+	settings.spectrumCache = false;
+	settings.textureFormat = kTextureRGBA32F;
+
+	const size_t sliceTexels = (size_t)kCheckGridSize * kCheckGridSize;
+	bool fallsOff = true;
+
+	printf("Height variance per cascade at %dx%d\n", kCheckGridSize, kCheckGridSize);
+	for (int m = 0; m < kMaxSpectrumModels; ++m)
+	{
+		settings.seaState.model = (SpectrumModel)m;
+
+		std::unique_ptr<SimulationPipeline> pipeline = CreatePipeline(settings.mode);
+		std::unique_ptr<FFTWrapper> wrapper = pipeline->Create_Wrapper(settings);
+		wrapper->Generate_Heightmap();
+		pipeline->Step(*wrapper, { 1.0f, 1.0f, 1.0f, settings.timescale, settings.seaState, 0 });
+
+		printf("%18s", SpectrumModelName((SpectrumModel)m));
+		double previous = INFINITY;
+		for (uint32_t c = 0; c < wrapper->getCascadeCount(); ++c)
+		{
+			const float* image = wrapper->getTextures().image + c * sliceTexels * 4;
+			double sum = 0, sumOfSquares = 0;
+			for (size_t t = 0; t < sliceTexels; ++t)
+			{
+				sum += image[4 * t + 1];
+				sumOfSquares += image[4 * t + 1] * image[4 * t + 1];
+			}
+
+			const double variance = sumOfSquares / sliceTexels - (sum / sliceTexels) * (sum / sliceTexels);
+			printf(" %12.4g", variance);
+
+			if (!(variance < previous))
+				fallsOff = false;
+			previous = variance;
+		}
+		printf("\n");
+	}
+
+	if (!fallsOff)
+		printf("The cascades don't fall off.\n");
+
+	return fallsOff;
+}
+
+// Returns false if the backend can't transform this grid
+bool bench_backend(FFTBackend& backend, const int& n, const int& threads, const int& frames,
+	const bool& realOutput, const PlannerPolicy& policy, double& ms)
+{
+	const FFTBatch batch = { (uint32_t)n, kFieldCount, realOutput };
+	if (!backend.Supports(batch))
+		return false;
+
+	const int specSize = n * (realOutput ? n / 2 + 1 : n);
+	fftwf_complex* pIn = (fftwf_complex*)backend.Allocate(sizeof(fftwf_complex) * specSize * kFieldCount);
+	void* pOut = backend.Allocate(sizeof(fftwf_complex) * n * n * kFieldCount);
+
+	std::shared_ptr<FFTPlan> plan = backend.Create_Plan(batch, pIn, pOut, threads, policy);
+	if (plan)
+	{
+		// The c2r transforms overwrite their input, which only changes the values
+		fill_spectrum(pIn, kFieldCount * specSize);
+
+		ms = time_frames(frames, [&]()
+		{
+			plan->Execute(pIn, pOut);
+		});
+	}
+
+	plan.reset();
+	backend.Free(pIn);
+	backend.Free(pOut);
+
+	return ms > 0;
+}
+
+//================================================================================
+// Entry point
+//================================================================================
+int main(int argc, char* argv[])
+{
+	PlannerPolicy policy = kPlanEstimate;
+	bool realOutput = false;
+	int frames = 100;
+
+	for (int a = 1; a < argc; ++a)
+	{
+		if (strcmp(argv[a], "-measure") == 0)
+			policy = kPlanMeasure;
+		else if (strcmp(argv[a], "-c2r") == 0)
+			realOutput = true;
+		else
+			frames = atoi(argv[a]) > 0 ? atoi(argv[a]) : frames;
+	}
+
+	const int maxThreads = omp_get_max_threads();
+
+	if (!check_cascades())
+		return 1;
+
+	printf("%d fields, %s, %s, %d frames at %dx%d\n", kFieldCount, realOutput ? "c2r" : "c2c",
+		policy == kPlanMeasure ? "FFTW_MEASURE" : "FFTW_ESTIMATE", frames, kGridSizes[0], kGridSizes[0]);
+	printf("%10s %8s %8s %12s %10s\n", "Backend", "Grid", "Threads", "ms/frame", "GFLOP/s");
+
+	for (int b = 0; b < kMaxBackends; ++b)
+	{
+		FFTBackend* backend = GetFFTBackend((FFTBackendKind)b);
+		if (!backend)
+			continue;
+
+		for (const int& n : kGridSizes)
+		{
+			// Same amount of work per grid size
+			const int gridFrames = std::max(kMinFrames, frames * kGridSizes[0] / n * kGridSizes[0] / n);
+
+			// 1, 2, 4, ... threads, then all of them
+			for (int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+			{
+				double ms = 0;
+				if (!bench_backend(*backend, n, threads, gridFrames, realOutput, policy, ms))
+				{
+					printf("%10s %8d %8s\n", FFTBackendName((FFTBackendKind)b), n, "unsupported");
+					break;
+				}
+
+				printf("%10s %8d %8d %12.3f %10.2f\n", FFTBackendName((FFTBackendKind)b), n, threads,
+					ms, nominal_flops(n, realOutput) / (ms * 1e6));
+
+				if (threads == maxThreads)
+					break;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "OceanScheduler.h"
+
+//================================================================================
+//
+//        Runs several oceans, with their own seeds and winds, through
+//        OceanScheduler, first with no budget and then with a fraction of
+//        the time all of them take. Reports the milliseconds spent per
+//        frame, the oceans advanced per frame and the longest wait.
+//        Usage: SchedulerBenchmark [oceans] [frames]
+//
+//================================================================================
+
+//================================================================================
+// Constants
+//================================================================================
+constexpr double kBudgetFractions[] = { 0.0, 0.75, 0.5, 0.25 };	// 0 for no budget
+constexpr unsigned int kMaxLag = 4;
+constexpr int kWarmupFrames = 10;
+
+//================================================================================
+// Benchmark helpers
+//================================================================================
+
+struct FrameStats
+{
+	double meanMs = 0;
+	double maxMs = 0;
+	double meanAdvanced = 0;
+	unsigned int longestWait = 0;
+};
+
+FrameStats run_frames(OceanScheduler& scheduler, const int& frames)
+{
+	FrameStats stats;
+
+	for (int f = 0; f < kWarmupFrames; ++f)
+		scheduler.Update();
+
+	for (int f = 0; f < frames; ++f)
+	{
+		scheduler.Update();
+
+		stats.meanMs += scheduler.getFrameTime();
+		stats.maxMs = std::max(stats.maxMs, scheduler.getFrameTime());
+		stats.meanAdvanced += scheduler.getAdvanced();
+		stats.longestWait = std::max(stats.longestWait, scheduler.getLongestWait());
+	}
+
+	stats.meanMs /= frames;
+	stats.meanAdvanced /= frames;
+	return stats;
+}
+
+//================================================================================
+// Entry point
+//================================================================================
+int main(int argc, char* argv[])
+{
+	const int oceans = (argc > 1 && atoi(argv[1]) > 0) ? atoi(argv[1]) : 8;
+	const int frames = (argc > 2 && atoi(argv[2]) > 0) ? atoi(argv[2]) : 200;
+
+	PipelineSettings settings;
+	settings.mode = kPipelineCpuNormFFT;
+	settings.spectrumCache = false;
+
+	// Every ocean has a pipeline of its own, which follows its sea state
+	std::vector<std::unique_ptr<SimulationPipeline>> pipelines;
+	std::vector<std::unique_ptr<FFTWrapper>> wrappers;
+
+	for (int o = 0; o < oceans; ++o)
+	{
+		settings.seed = o + 1;
+		settings.seaState.windSpeed = 14.0f + 2.0f * o;
+
+		pipelines.push_back(CreatePipeline(settings.mode));
+		wrappers.push_back(pipelines.back()->Create_Wrapper(settings));
+		wrappers.back()->Generate_Heightmap();
+	}
+
+	printf("%s at %dx%d, %d oceans, max lag %u, %d frames\n", PipelineModeName(settings.mode),
+		settings.gridSize, settings.gridSize, oceans, kMaxLag, frames);
+	printf("%10s %10s %10s %10s %12s\n", "Budget ms", "Mean ms", "Max ms", "Advanced", "Longest wait");
+
+	double allOceansMs = 0;
+	for (const double& fraction : kBudgetFractions)
+	{
+		// No budget is a budget nothing overruns
+		const double budgetMs = (fraction > 0) ? fraction * allOceansMs : 1e9;
+		OceanScheduler scheduler(budgetMs, kMaxLag);
+
+		for (int o = 0; o < oceans; ++o)
+		{
+			settings.seaState.windSpeed = 14.0f + 2.0f * o;
+			const PipelineFrame frame = { 1.3f, 1.2f, 2.0f, settings.timescale, settings.seaState, 0 };
+			scheduler.Add(pipelines[o].get(), wrappers[o].get(), frame);
+		}
+
+		const FrameStats stats = run_frames(scheduler, frames);
+		if (fraction == 0)
+			allOceansMs = stats.meanMs;
+
+		if (fraction > 0)
+			printf("%10.3f", budgetMs);
+		else
+			printf("%10s", "none");
+		printf(" %10.3f %10.3f %10.2f %12u\n", stats.meanMs, stats.maxMs, stats.meanAdvanced, stats.longestWait);
+	}
+
+	return 0;
+}
@@ -0,0 +1,357 @@
+#include "FrameWriters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	const char* kFormatNames[kMaxExportFormats] = { "raw", "exr", "png" };
+	const char* kChannelNames[kMaxExportFields] = { "displacement.X", "displacement.Y", "displacement.Z", "foam",
+		"normal.X", "normal.Y", "normal.Z" };
+
+	// OpenEXR constants, from the file layout of the OpenEXR documentation
+	const uint32_t kEXRMagic = 20000630;
+	const uint32_t kEXRVersion = 2;			// Single-part scanline file
+	const uint32_t kEXRPixelFloat = 2;
+
+	// Longest stored deflate block
+	const uint32_t kStoredBlockBytes = 65535;
+
+	// Channels of the PNG files
+	const ExportField kDisplacementChannels[] = { kExportDispX, kExportDispY, kExportDispZ };
+	const ExportField kNormalChannels[] = { kExportNormalX, kExportNormalY, kExportNormalZ, kExportFoam };
+
+	inline void Put_LE(std::vector<uint8_t>& bytes, const uint64_t& value, const uint32_t& count)
+	{
+		for (uint32_t b(0); b < count; ++b)
+			bytes.push_back((uint8_t)(value >> (8 * b)));
+	}
+
+	inline void Put_BE(std::vector<uint8_t>& bytes, const uint64_t& value, const uint32_t& count)
+	{
+		for (uint32_t b(count); b > 0; --b)
+			bytes.push_back((uint8_t)(value >> (8 * (b - 1))));
+	}
+
+	inline void Put_Float(std::vector<uint8_t>& bytes, const float& value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		Put_LE(bytes, bits, 4);
+	}
+
+	// With its terminating zero
+	inline void Put_Text(std::vector<uint8_t>& bytes, const char* text)
+	{
+		bytes.insert(bytes.end(), text, text + strlen(text) + 1);
+	}
+
+	// Name, type and size of an EXR header attribute, followed by its value
+	inline void Put_Attribute(std::vector<uint8_t>& bytes, const char* name, const char* type, const uint32_t& size)
+	{
+		Put_Text(bytes, name);
+		Put_Text(bytes, type);
+		Put_LE(bytes, size, 4);
+	}
+
+	// CRC-32 of the PNG chunks
+	uint32_t Crc32(const uint8_t* data, const size_t& size)
+	{
+		static const struct CrcTable
+		{
+			uint32_t entries[256];
+
+			CrcTable()
+			{
+				for (uint32_t n(0); n < 256; ++n)
+				{
+					uint32_t c = n;
+					for (int k(0); k < 8; ++k)
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					entries[n] = c;
+				}
+			}
+		} table;
+
+		uint32_t crc = 0xFFFFFFFFu;
+		for (size_t b(0); b < size; ++b)
+			crc = table.entries[(crc ^ data[b]) & 0xFF] ^ (crc >> 8);
+
+		return crc ^ 0xFFFFFFFFu;
+	}
+
+	// Adler-32 of the zlib stream
+	uint32_t Adler32(const uint8_t* data, const size_t& size)
+	{
+		uint32_t a = 1, b = 0;
+
+		// 5552 bytes is the longest run that can't overflow b
+		for (size_t begin(0); begin < size; begin += 5552)
+		{
+			const size_t end = std::min(size, begin + 5552);
+			for (size_t i(begin); i < end; ++i)
+			{
+				a += data[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+
+		return (b << 16) | a;
+	}
+
+	// value / range from -1 to 1 onto the 16-bit unsigned range
+	inline uint16_t Quantise(const float& value, const float& range)
+	{
+		const float unit = std::min(std::max(value / range * 0.5f + 0.5f, 0.0f), 1.0f);
+		return (uint16_t)(unit * 65535.0f + 0.5f);
+	}
+}
+
+const char* ExportFormatName(const ExportFormat& format)
+{
+	return (format >= 0 && format < kMaxExportFormats) ? kFormatNames[format] : "unknown";
+}
+
+void FrameWriter::Fill(const float* image, const float* normal, const uint32_t& width, const float& choppy, const float& heightAdj)
+{
+	const uint32_t texels = width * width;
+	m_width = width;
+	m_planes.resize(kMaxExportFields * texels);
+
+	float* planes[kMaxExportFields];
+	for (uint32_t f(0); f < kMaxExportFields; ++f)
+		planes[f] = m_planes.data() + f * texels;
+
+	for (uint32_t n(0); n < texels; ++n)
+	{
+		// The ocean shader's displacement, with the horizontal
+		// displacement pointing the other way to the IFFT output
+		planes[kExportDispX][n] = -choppy * image[4 * n + 0];
+		planes[kExportDispY][n] = heightAdj * image[4 * n + 1];
+		planes[kExportDispZ][n] = -choppy * image[4 * n + 2];
+
+		const float nx = normal[4 * n + 0];
+		const float ny = normal[4 * n + 1];
+		const float nz = normal[4 * n + 2];
+		const float oneOverLength = 1.0f / sqrt(nx * nx + ny * ny + nz * nz);
+
+		planes[kExportNormalX][n] = nx * oneOverLength;
+		planes[kExportNormalY][n] = ny * oneOverLength;
+		planes[kExportNormalZ][n] = nz * oneOverLength;
+		planes[kExportFoam][n] = normal[4 * n + 3];
+	}
+}
+
+bool FrameWriter::Write(const std::string& path)
+{
+	switch (m_format)
+	{
+	case kExportRaw:	return Write_Raw(path + ".raw");
+	case kExportEXR:	return Write_EXR(path + ".exr");
+	case kExportPNG:	return Write_PNG(path + "_displacement.png", kDisplacementChannels, 3)
+							&& Write_PNG(path + "_normal.png", kNormalChannels, 4);
+	default:			return false;
+	}
+}
+
+bool FrameWriter::Write_Raw(const std::string& path)
+{
+	// The planes are already laid out like the file
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write((const char*)m_planes.data(), (std::streamsize)(m_planes.size() * sizeof(float)));
+
+	if (!file.good())
+		return false;
+
+	m_bytesWritten += m_planes.size() * sizeof(float);
+	return true;
+}
+
+bool FrameWriter::Write_EXR(const std::string& path)
+{
+	const uint32_t lineBytes = m_width * kMaxExportFields * sizeof(float);
+	const uint32_t max = m_width - 1;
+
+	m_bytes.clear();
+	Put_LE(m_bytes, kEXRMagic, 4);
+	Put_LE(m_bytes, kEXRVersion, 4);
+
+	// Every channel's name, FLOAT pixels, linear, no subsampling
+	uint32_t channelBytes = 1;
+	for (const char* name : kChannelNames)
+		channelBytes += (uint32_t)strlen(name) + 1 + 16;
+
+	Put_Attribute(m_bytes, "channels", "chlist", channelBytes);
+	for (const char* name : kChannelNames)
+	{
+		Put_Text(m_bytes, name);
+		Put_LE(m_bytes, kEXRPixelFloat, 4);
+		Put_LE(m_bytes, 0, 4);
+		Put_LE(m_bytes, 1, 4);
+		Put_LE(m_bytes, 1, 4);
+	}
+	m_bytes.push_back(0);
+
+	Put_Attribute(m_bytes, "compression", "compression", 1);
+	m_bytes.push_back(0);
+
+	Put_Attribute(m_bytes, "dataWindow", "box2i", 16);
+	Put_LE(m_bytes, 0, 4); Put_LE(m_bytes, 0, 4); Put_LE(m_bytes, max, 4); Put_LE(m_bytes, max, 4);
+
+	Put_Attribute(m_bytes, "displayWindow", "box2i", 16);
+	Put_LE(m_bytes, 0, 4); Put_LE(m_bytes, 0, 4); Put_LE(m_bytes, max, 4); Put_LE(m_bytes, max, 4);
+
+	Put_Attribute(m_bytes, "lineOrder", "lineOrder", 1);
+	m_bytes.push_back(0);
+
+	Put_Attribute(m_bytes, "pixelAspectRatio", "float", 4);
+	Put_Float(m_bytes, 1.0f);
+
+	Put_Attribute(m_bytes, "screenWindowCenter", "v2f", 8);
+	Put_Float(m_bytes, 0.0f);
+	Put_Float(m_bytes, 0.0f);
+
+	Put_Attribute(m_bytes, "screenWindowWidth", "float", 4);
+	Put_Float(m_bytes, 1.0f);
+
+	m_bytes.push_back(0);
+
+	// Uncompressed files have one line per block, each block starting
+	// with its line and size, then the line of every channel in turn
+	const uint64_t firstBlock = m_bytes.size() + 8ull * m_width;
+	for (uint32_t y(0); y < m_width; ++y)
+		Put_LE(m_bytes, firstBlock + (uint64_t)y * (8 + lineBytes), 8);
+
+	m_bytes.reserve(m_bytes.size() + (size_t)m_width * (8 + lineBytes));
+	for (uint32_t y(0); y < m_width; ++y)
+	{
+		Put_LE(m_bytes, y, 4);
+		Put_LE(m_bytes, lineBytes, 4);
+
+		for (uint32_t f(0); f < kMaxExportFields; ++f)
+		{
+			const uint8_t* line = (const uint8_t*)(Plane(f) + y * m_width);
+			m_bytes.insert(m_bytes.end(), line, line + m_width * sizeof(float));
+		}
+	}
+
+	return Write_Bytes(path);
+}
+
+bool FrameWriter::Write_PNG(const std::string& path, const ExportField* fields, const uint32_t& channels)
+{
+	const uint32_t rowBytes = 1 + m_width * channels * 2;
+	const size_t dataBytes = (size_t)rowBytes * m_width;
+
+	static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	m_bytes.assign(kSignature, kSignature + 8);
+
+	// Chunks are their length, type and data, then the CRC of type and data
+	auto Begin_Chunk = [&](const char* type, const uint32_t& length)
+	{
+		Put_BE(m_bytes, length, 4);
+		m_bytes.insert(m_bytes.end(), type, type + 4);
+		return m_bytes.size() - 4;
+	};
+	auto End_Chunk = [&](const size_t& begin)
+	{
+		Put_BE(m_bytes, Crc32(m_bytes.data() + begin, m_bytes.size() - begin), 4);
+	};
+
+	size_t chunk = Begin_Chunk("IHDR", 13);
+	Put_BE(m_bytes, m_width, 4);
+	Put_BE(m_bytes, m_width, 4);
+	m_bytes.push_back(16);
+	m_bytes.push_back(channels == 4 ? 6 : 2);		// RGBA or RGB
+	m_bytes.push_back(0);
+	m_bytes.push_back(0);
+	m_bytes.push_back(0);
+	End_Chunk(chunk);
+
+	// A zlib stream of stored deflate blocks, which leaves the samples as they
+	// are. The writers are bound by the disk, not by the size of the files.
+	const uint32_t blocks = (uint32_t)((dataBytes + kStoredBlockBytes - 1) / kStoredBlockBytes);
+	chunk = Begin_Chunk("IDAT", (uint32_t)(2 + dataBytes + 5 * blocks + 4));
+	m_bytes.push_back(0x78);
+	m_bytes.push_back(0x01);
+
+	// Unfiltered rows of big-endian samples, which the blocks are then cut out of
+	const size_t scanlines = m_bytes.size() + 5 * blocks;
+	m_bytes.resize(scanlines + dataBytes);
+
+	for (uint32_t y(0); y < m_width; ++y)
+	{
+		uint8_t* row = m_bytes.data() + scanlines + (size_t)y * rowBytes;
+		*row++ = 0;
+
+		for (uint32_t x(0); x < m_width; ++x)
+		{
+			const uint32_t n = y * m_width + x;
+			bool clipped = false;
+
+			for (uint32_t c(0); c < channels; ++c)
+			{
+				// The displacement is quantised to the range, the normals from -1 to 1, and foam from 0 to 1
+				const float value = Plane(fields[c])[n];
+				uint16_t sample;
+
+				if (fields[c] <= kExportDispZ)
+				{
+					clipped |= fabs(value) > m_range;
+					sample = Quantise(value, m_range);
+				}
+				else
+				{
+					sample = (fields[c] == kExportFoam) ? Quantise(2.0f * value - 1.0f, 1.0f) : Quantise(value, 1.0f);
+				}
+
+				*row++ = (uint8_t)(sample >> 8);
+				*row++ = (uint8_t)sample;
+			}
+
+			m_clippedTexels += clipped ? 1 : 0;
+		}
+	}
+
+	const uint32_t adler = Adler32(m_bytes.data() + scanlines, dataBytes);
+
+	// Every block header goes in front of its data, moving the data down
+	// from the front so nothing is overwritten before it is moved
+	for (uint32_t b(0); b < blocks; ++b)
+	{
+		const size_t begin = (size_t)b * kStoredBlockBytes;
+		const uint32_t length = (uint32_t)std::min<size_t>(kStoredBlockBytes, dataBytes - begin);
+		uint8_t* header = m_bytes.data() + scanlines - 5 * blocks + begin + 5 * b;
+
+		memmove(header + 5, m_bytes.data() + scanlines + begin, length);
+		header[0] = (b + 1 == blocks) ? 1 : 0;
+		header[1] = (uint8_t)length;
+		header[2] = (uint8_t)(length >> 8);
+		header[3] = (uint8_t)~length;
+		header[4] = (uint8_t)(~length >> 8);
+	}
+
+	Put_BE(m_bytes, adler, 4);
+	End_Chunk(chunk);
+
+	chunk = Begin_Chunk("IEND", 0);
+	End_Chunk(chunk);
+
+	return Write_Bytes(path);
+}
+
+bool FrameWriter::Write_Bytes(const std::string& path)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write((const char*)m_bytes.data(), (std::streamsize)m_bytes.size());
+
+	if (!file.good())
+		return false;
+
+	m_bytesWritten += m_bytes.size();
+	return true;
+}
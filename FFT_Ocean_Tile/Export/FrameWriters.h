@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// File formats of the exported frames
+enum ExportFormat
+{
+	kExportRaw,		// Every field as a plane of little-endian float32, one file per cascade
+	kExportEXR,		// Every field as an uncompressed FLOAT channel, one file per cascade
+	kExportPNG,		// 16-bit displacement and normal map files per cascade
+	kMaxExportFormats
+};
+
+const char* ExportFormatName(const ExportFormat& format);
+
+// Fields of an exported frame, in the order of the raw planes and of the EXR
+// channels, which have to be sorted by name
+enum ExportField
+{
+	kExportDispX,		// "displacement.X", m
+	kExportDispY,		// "displacement.Y", the height, m
+	kExportDispZ,		// "displacement.Z", m
+	kExportFoam,		// "foam", 0 or 1
+	kExportNormalX,		// "normal.X", unit length
+	kExportNormalY,		// "normal.Y"
+	kExportNormalZ,		// "normal.Z"
+	kMaxExportFields
+};
+
+//================================================================================
+// Turns one cascade of a frame of the RGBA32F textures into world space fields
+// and writes them out. Every writer thread has its own, and reuses its planes
+// and file buffer from one frame to the next.
+//================================================================================
+class FrameWriter
+{
+public:
+	// PNG files map displacements of -range to range metres onto 0 to 65535
+	FrameWriter(const ExportFormat& format, const float& range)
+		:m_format(format), m_range(range) {}
+
+	FrameWriter(FrameWriter const&) = delete; // Don't Implement
+	void operator=(FrameWriter const&) = delete;   // Don't Implement
+
+	// width x width texels of the heightmap and normal map. The displacement
+	// is scaled the way the ocean shader scales it, and the normals are normalised.
+	void Fill(const float* image, const float* normal, const uint32_t& width, const float& choppy, const float& heightAdj);
+
+	// Writes the fields to path plus the extension of the format, false if a file can't be written
+	bool Write(const std::string& path);
+
+	inline uint64_t getBytesWritten() { return m_bytesWritten; }
+
+	// Texels whose displacement didn't fit into the range of the PNG files
+	inline uint64_t getClippedTexels() { return m_clippedTexels; }
+
+private:
+	bool Write_Raw(const std::string& path);
+	bool Write_EXR(const std::string& path);
+	bool Write_PNG(const std::string& path, const ExportField* fields, const uint32_t& channels);
+
+	// Writes m_bytes to path
+	bool Write_Bytes(const std::string& path);
+
+	inline const float* Plane(const uint32_t& field) { return m_planes.data() + field * m_width * m_width; }
+
+	const ExportFormat m_format;
+	const float m_range;
+
+	uint32_t m_width = 0;
+	std::vector<float> m_planes;		// kMaxExportFields planes of m_width x m_width
+	std::vector<uint8_t> m_bytes;		// The file being written
+
+	uint64_t m_bytesWritten = 0;
+	uint64_t m_clippedTexels = 0;
+};
@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <omp.h>
+
+#include "FrameWriters.h"
+#include "SimulationPipeline.h"
+
+//================================================================================
+//
+//        Headless export of the CPU simulation. Simulates the frames at
+//        t0, t0 + dt, ... up to t1 on several FFTWrapper instances at once,
+//        and writes their displacement, normals and foam to files on a
+//        pool of writer threads.
+//        Usage: OceanExport [-t0 s] [-t1 s] [-dt s] [-format raw|exr|png]
+//               [-out prefix] [-jobs n] [-writers n] [-range m]
+//               [-choppy x] [-height_adj x] [-foam x] [pipeline settings]
+//
+//================================================================================
+
+//================================================================================
+// Constants
+//================================================================================
+constexpr uint32_t kChunkFrames = 16;		// Frames a job simulates after turning its waves to their start
+constexpr int kSetsPerJob = 2;				// Frames a job can have waiting for the writers
+
+//================================================================================
+// Export helpers
+//================================================================================
+
+struct ExportSettings
+{
+	double t0 = 0;
+	double t1 = 10;
+	double dt = OCEAN_TIMESCALE;
+	ExportFormat format = kExportEXR;
+	std::string out = "ocean";
+	int jobs = 0;			// 0 runs one job per hardware thread
+	int writers = 2;
+	float range = 100;		// m, of the PNG displacement
+
+	// The application's defaults
+	float choppy = 1.3f;
+	float heightAdj = 1.2f;
+	float foamInt = 2.0f;
+};
+
+// Returns false for keys that aren't the exporter's own
+bool apply_export_setting(ExportSettings& settings, const std::string& key, const char* value)
+{
+	if (key == "t0")
+		settings.t0 = atof(value);
+	else if (key == "t1")
+		settings.t1 = atof(value);
+	else if (key == "dt")
+		settings.dt = atof(value);
+	else if (key == "out")
+		settings.out = value;
+	else if (key == "jobs")
+		settings.jobs = std::max(0, atoi(value));
+	else if (key == "writers")
+		settings.writers = std::max(1, atoi(value));
+	else if (key == "range")
+		settings.range = std::max(0.01f, (float)atof(value));
+	else if (key == "choppy")
+		settings.choppy = (float)atof(value);
+	else if (key == "height_adj")
+		settings.heightAdj = (float)atof(value);
+	else if (key == "foam")
+		settings.foamInt = (float)atof(value);
+	else if (key == "format")
+	{
+		for (int f(0); f < kMaxExportFormats; ++f)
+		{
+			if (ExportFormatName((ExportFormat)f) == std::string(value))
+				settings.format = (ExportFormat)f;
+		}
+	}
+	else
+		return false;
+
+	return true;
+}
+
+// Items are handed from one thread to another, Pop waits for one and
+// returns false once the queue is closed and empty
+template <typename T>
+class BlockingQueue
+{
+public:
+	void Push(T item)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_items.push_back(std::move(item));
+		}
+		m_ready.notify_one();
+	}
+
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_ready.wait(lock, [this]() { return !m_items.empty() || m_closed; });
+		if (m_items.empty())
+			return false;
+
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		return true;
+	}
+
+	void Close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_closed = true;
+		}
+		m_ready.notify_all();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_ready;
+	std::deque<T> m_items;
+	bool m_closed = false;
+};
+
+struct ExportFrame
+{
+	uint32_t index;
+	FFTWrapper::TextureSet textures;
+};
+
+//================================================================================
+// Entry point
+//================================================================================
+int main(int argc, char* argv[])
+{
+	ExportSettings exportSettings;
+	PipelineSettings settings;
+	settings.mode = kPipelineCpuNormFFT;
+
+	for (int a(1); a + 1 < argc; ++a)
+	{
+		if (argv[a][0] != '-')
+			continue;
+
+		const std::string key = argv[a] + (argv[a][1] == '-' ? 2 : 1);
+		const char* value = argv[++a];
+
+		if (apply_export_setting(exportSettings, key, value))
+			continue;
+
+		if (key == "config")
+		{
+			if (!LoadPipelineSettings(settings, value))
+				debugF("OceanExport: could not open %s\n", value);
+		}
+		else
+		{
+			ApplyPipelineSetting(settings, key, value);
+		}
+	}
+
+	if (settings.mode == kPipelineGpgpuNormCD)
+	{
+		debugF("OceanExport: %s needs the GPU, exporting with %s.\n", PipelineModeName(settings.mode),
+			PipelineModeName(kPipelineCpuNormFFT));
+		settings.mode = kPipelineCpuNormFFT;
+	}
+
+	if (exportSettings.dt <= 0 || exportSettings.t1 < exportSettings.t0)
+	{
+		debugF("OceanExport: nothing to export from %.3f s to %.3f s every %.3f s.\n",
+			exportSettings.t0, exportSettings.t1, exportSettings.dt);
+		return 1;
+	}
+
+	// Frames from t0 up to and including t1
+	const uint32_t frameCount = (uint32_t)((exportSettings.t1 - exportSettings.t0) / exportSettings.dt + 1e-6) + 1;
+
+	// Whole frames run in parallel, and every job gets a share of the hardware
+	// threads for its own passes. Jobs past the number of chunks would idle.
+	const int hardwareThreads = omp_get_max_threads();
+	const uint32_t chunkCount = (frameCount + kChunkFrames - 1) / kChunkFrames;
+	const int jobs = (int)std::min<uint32_t>(exportSettings.jobs > 0 ? exportSettings.jobs : hardwareThreads, chunkCount);
+	if (settings.threads == 0)
+		settings.threads = std::max(1, hardwareThreads / jobs);
+
+	// Every job simulates the same ocean, and the written frames are the
+	// RGBA32F ones whatever the application uploads
+	if (settings.seed == 0)
+		settings.seed = std::random_device()();
+	settings.textureFormat = kTextureRGBA32F;
+
+	printf("%u frames of %.3f s from %.3f s, %s at %dx%d, %d cascades, seed %u\n", frameCount, exportSettings.dt,
+		exportSettings.t0, PipelineModeName(settings.mode), settings.gridSize, settings.gridSize, settings.cascades, settings.seed);
+	printf("%d jobs of %d threads, %d writers, %s to %s_*\n", jobs, settings.threads, exportSettings.writers,
+		ExportFormatName(exportSettings.format), exportSettings.out.c_str());
+
+	// Planning isn't thread safe, so every job's simulation is made up front
+	std::vector<std::unique_ptr<SimulationPipeline>> pipelines;
+	std::vector<std::unique_ptr<FFTWrapper>> wrappers;
+	for (int j(0); j < jobs; ++j)
+	{
+		pipelines.push_back(CreatePipeline(settings.mode));
+		wrappers.push_back(pipelines[j]->Create_Wrapper(settings));
+		wrappers[j]->Generate_Heightmap();
+	}
+
+	const uint32_t width = wrappers[0]->getWidth();
+	const uint32_t cascades = wrappers[0]->getCascadeCount();
+
+	// Sets a job exchanges its finished frame for. Once the writers fall
+	// behind the pool runs dry, and the jobs wait for them.
+	BlockingQueue<FFTWrapper::TextureSet> freeSets;
+	const int setCount = jobs * kSetsPerJob + exportSettings.writers;
+	for (int s(0); s < setCount; ++s)
+	{
+		FFTWrapper::TextureSet set;
+		wrappers[0]->Allocate_Texture_Set(set);
+		freeSets.Push(set);
+	}
+
+	BlockingQueue<ExportFrame> finished;
+	std::atomic<uint32_t> nextChunk(0);
+	std::atomic<uint32_t> framesWritten(0);
+	std::atomic<bool> failed(false);
+	std::atomic<uint64_t> bytesWritten(0), clippedTexels(0);
+	std::vector<double> stepSeconds(jobs, 0);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	// Jobs take a chunk of frames at a time, and turn every wave to the frame
+	// before it first, so the frames don't depend on the number of jobs
+	std::vector<std::thread> jobThreads;
+	for (int j(0); j < jobs; ++j)
+	{
+		jobThreads.emplace_back([&, j]()
+		{
+			SimulationPipeline& pipeline = *pipelines[j];
+			FFTWrapper& wrapper = *wrappers[j];
+			const PipelineFrame frame = { exportSettings.choppy, exportSettings.heightAdj, exportSettings.foamInt,
+				(float)exportSettings.dt, settings.seaState, 0 };
+
+			for (uint32_t chunk = nextChunk++; chunk < chunkCount && !failed; chunk = nextChunk++)
+			{
+				const uint32_t first = chunk * kChunkFrames;
+				const uint32_t last = std::min(frameCount, first + kChunkFrames);
+				wrapper.Set_Time(exportSettings.t0 + (first - 1.0) * exportSettings.dt);
+
+				for (uint32_t f(first); f < last && !failed; ++f)
+				{
+					const auto stepStart = std::chrono::high_resolution_clock::now();
+					pipeline.Step(wrapper, frame);
+					const std::chrono::duration<double> step = std::chrono::high_resolution_clock::now() - stepStart;
+					stepSeconds[j] += step.count();
+
+					ExportFrame done = {};
+					done.index = f;
+					freeSets.Pop(done.textures);
+					wrapper.Exchange_Textures(done.textures);
+					finished.Push(done);
+				}
+			}
+		});
+	}
+
+	std::vector<std::thread> writerThreads;
+	for (int w(0); w < exportSettings.writers; ++w)
+	{
+		writerThreads.emplace_back([&]()
+		{
+			FrameWriter writer(exportSettings.format, exportSettings.range);
+			std::vector<char> path(exportSettings.out.size() + 32);
+			ExportFrame done;
+
+			while (finished.Pop(done))
+			{
+				for (uint32_t c(0); c < cascades && !failed; ++c)
+				{
+					const uint32_t slice = c * width * width * 4;
+					writer.Fill(done.textures.image + slice, done.textures.normal + slice, width,
+						exportSettings.choppy, exportSettings.heightAdj);
+
+					if (cascades > 1)
+						snprintf(path.data(), path.size(), "%s_c%u_%05u", exportSettings.out.c_str(), c, done.index);
+					else
+						snprintf(path.data(), path.size(), "%s_%05u", exportSettings.out.c_str(), done.index);
+
+					if (!writer.Write(path.data()) && !failed.exchange(true))
+						debugF("OceanExport: could not write %s\n", path.data());
+				}
+
+				freeSets.Push(done.textures);
+				if (!failed)
+					++framesWritten;
+			}
+
+			bytesWritten += writer.getBytesWritten();
+			clippedTexels += writer.getClippedTexels();
+		});
+	}
+
+	// Progress, until every job is done
+	std::thread progress([&]()
+	{
+		while (framesWritten < frameCount && !failed)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+			const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+			printf("\r%u / %u frames, %.1f frames/s ", (uint32_t)framesWritten, frameCount, framesWritten / elapsed.count());
+			fflush(stdout);
+		}
+	});
+
+	for (std::thread& job : jobThreads)
+		job.join();
+
+	finished.Close();
+	for (std::thread& writer : writerThreads)
+		writer.join();
+
+	const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	progress.join();
+
+	// Frames/s of the simulation alone, with every job busy all the time
+	double simulated = 0;
+	for (const double& seconds : stepSeconds)
+		simulated += seconds;
+
+	printf("\r%u frames in %.2f s, %.1f frames/s, %.1f MB/s written, simulation alone %.1f frames/s\n",
+		(uint32_t)framesWritten, elapsed.count(), framesWritten / elapsed.count(),
+		bytesWritten / (1024.0 * 1024.0) / elapsed.count(), frameCount * jobs / std::max(simulated, 1e-9));
+
+	if (clippedTexels > 0)
+		printf("%llu texels clipped to +-%.1f m, raise -range to keep them\n", (unsigned long long)clippedTexels,
+			exportSettings.range);
+
+	// Every set has come back, the wrappers free the ones they hold
+	freeSets.Close();
+	FFTWrapper::TextureSet set;
+	while (freeSets.Pop(set))
+		FFTWrapper::Free_Texture_Set(set);
+
+	return failed ? 1 : 0;
+}
@@ -17,18 +17,26 @@ Texture::~Texture()
 	SAFE_RELEASE(m_pTexture);
 }
 
-void Texture::init_custom(ID3D11Device* pDevice, const int& texSize, const bool& isDynamic)
+void Texture::init_custom(ID3D11Device* pDevice, const int& texSize, const bool& isDynamic, const DXGI_FORMAT& format, const int& arraySize)
 {
 
 	D3D11_TEXTURE2D_DESC desc = {};
 	desc.Width = texSize;
 	desc.Height = texSize;
-	desc.MipLevels = desc.ArraySize = 1;
-	desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	desc.MipLevels = 1;
+	desc.ArraySize = (arraySize > 0) ? arraySize : 1;
+	desc.Format = format;
 	desc.SampleDesc.Count = 1;
 	
-	// Dynamic Textures cannot have UAVs
-	if (isDynamic)
+	// Dynamic Textures cannot have UAVs, and can't be arrays, so dynamic
+	// arrays live in GPU memory and take their updates from the CPU
+	if (isDynamic && arraySize > 0)
+	{
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.CPUAccessFlags = 0;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	}
+	else if (isDynamic)
 	{
 		desc.Usage = D3D11_USAGE_DYNAMIC;
 		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
@@ -52,16 +60,33 @@ void Texture::init_custom(ID3D11Device* pDevice, const int& texSize, const bool&
 		// Create Shader Resource View 
 		D3D11_SHADER_RESOURCE_VIEW_DESC SRVdesc = {};
 		SRVdesc.Format = desc.Format;
-		SRVdesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		SRVdesc.Texture2D.MipLevels = 1;
+		if (arraySize > 0)
+		{
+			SRVdesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+			SRVdesc.Texture2DArray.MipLevels = 1;
+			SRVdesc.Texture2DArray.ArraySize = desc.ArraySize;
+		}
+		else
+		{
+			SRVdesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+			SRVdesc.Texture2D.MipLevels = 1;
+		}
 
 		hr = pDevice->CreateShaderResourceView(tex, &SRVdesc, &m_pTextureSRV);
 
 		// Create Unordered Access View
 		D3D11_UNORDERED_ACCESS_VIEW_DESC UAVdesc = {};
-		UAVdesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
 		UAVdesc.Format = desc.Format;
-		UAVdesc.Texture2D.MipSlice = 0;
+		if (arraySize > 0)
+		{
+			UAVdesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+			UAVdesc.Texture2DArray.ArraySize = desc.ArraySize;
+		}
+		else
+		{
+			UAVdesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+			UAVdesc.Texture2D.MipSlice = 0;
+		}
 
 		hr = pDevice->CreateUnorderedAccessView(m_pTexture, &UAVdesc, &m_pTextureUAV);
 		bool testHR = (SUCCEEDED(hr));
@@ -17,8 +17,10 @@ public:
 	inline ID3D11UnorderedAccessView* getUAV() { return m_pTextureUAV; }
 
 	// Custom initialisation that can also set the Unordered Access View
-	// for compute shader output scenarios
-	void init_custom(ID3D11Device* pDevice, const int& texSize, const bool& isDynamic);
+	// for compute shader output scenarios. A non-zero arraySize makes a
+	// texture array, whose dynamic slices are updated with UpdateSubresource.
+	void init_custom(ID3D11Device* pDevice, const int& texSize, const bool& isDynamic,
+		const DXGI_FORMAT& format = DXGI_FORMAT_R32G32B32A32_FLOAT, const int& arraySize = 0);
 
 	// Initialize from a DDS file.
 	void init_from_dds(ID3D11Device* pDevice, const char* pFilename);
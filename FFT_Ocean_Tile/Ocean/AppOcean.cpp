@@ -6,18 +6,23 @@
 
 #include "Configurations.h"
 #include "FFTWrapper.h"
+#include "SimulationPipeline.h"
+#include "AsyncSimulation.h"
+#include "OceanSequence.h"
 #include "OceanTile.h"
 
 #include <d3dcompiler.h>
 #pragma comment(lib,"d3dcompiler.lib")
 
 #include <time.h>
+#include <memory>
 
 //================================================================================
 //
 //                 External library only supports x86 builds.
 //             Different execution configurations can be tested by 
-//             uncommenting the #define macros in Configurations.h
+//             passing them in Ocean.cfg or on the command line,
+//             see SimulationPipeline.h
 //
 //================================================================================
 
@@ -28,6 +33,10 @@
 constexpr float kBlendFactor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
 constexpr UINT kSampleMask = 0xffffffff;
 
+// Upload formats of the CPU textures, indexed by TextureFormat
+constexpr DXGI_FORMAT kHeightmapFormats[kMaxTextureFormats] = { DXGI_FORMAT_R32G32B32A32_FLOAT, DXGI_FORMAT_R16G16B16A16_FLOAT, DXGI_FORMAT_R16G16B16A16_UNORM };
+constexpr DXGI_FORMAT kNormalmapFormats[kMaxTextureFormats] = { DXGI_FORMAT_R32G32B32A32_FLOAT, DXGI_FORMAT_R16G16B16A16_FLOAT, DXGI_FORMAT_R16G16_SNORM };
+
 //================================================================================
 // OceanApp extends FrameworkApp
 // Framework provided by Dr David Moore.
@@ -46,6 +55,12 @@ public:
 		f32	 m_choppy;
 		f32	 m_heightAdjust;
 		f32	 m_reflectivity;
+		v4	 m_vDispMul[FFTWrapper::kMaxCascades];	// Heightmap texel to displacement, for the packed heightmap
+		v4	 m_vDispAdd[FFTWrapper::kMaxCascades];
+		v4	 m_vCascadeTiles;		// Repeats of every cascade's patch over the tile
+		f32	 m_packedNormals;		// XZ normals with a separate foam mask
+		f32	 m_cascadeCount;
+		f32	 m_padding[2];
 	};
 
 	// Constant buffer per draw
@@ -71,6 +86,8 @@ public:
 		f32	 m_heightAdjust;
 		f32	 m_foamIntensity;
 		f32	 m_texSize;
+		v4	 m_vDispMul;			// Heightmap texel to displacement, for the packed heightmap
+		v4	 m_vDispAdd;
 	};
 
 	void on_init(SystemsInterface& systems) override
@@ -79,8 +96,35 @@ public:
 		systems.pCamera->eye = v3(250.f, 670.f, 1250.f);
 		systems.pCamera->look_at(v3(300.f, 0.f, 300.f));
 
-		// Random Seed
-		srand(time(NULL));
+		//--------------------- Execution Configuration ---------------------//
+		// Configurations.h defaults, then Ocean.cfg, then the command line
+		LoadPipelineSettings(m_settings, "Ocean.cfg");
+		ParsePipelineArgs(m_settings, __argc, __argv);
+
+		m_pipeline = CreatePipeline(m_settings.mode);
+		m_wrapper = m_pipeline->Create_Wrapper(m_settings);
+		m_timescale = m_settings.timescale;
+		m_seaState = m_wrapper->getSeaState();
+		m_windAngle = atan2f(m_seaState.windZ, m_seaState.windX);
+
+		// A baked sequence replaces the CPU simulation, and can be baked first
+		if (!m_settings.sequence.empty() && !m_pipeline->Uses_GPGPU())
+		{
+			if (m_settings.bakePeriod > 0)
+				OceanSequence::Bake(*m_pipeline, *m_wrapper, { m_lambda, m_heightAdj, m_foamInt, m_timescale, m_seaState, m_seaStateVersion },
+					m_settings.bakePeriod, m_settings.sequence);
+
+			// The textures are created in the format of the frames
+			m_sequence = OceanSequence::Open(m_settings.sequence, m_wrapper->getWidth(), m_wrapper->getCascadeCount());
+			if (m_sequence)
+				m_wrapper->setTextureFormat(kTexturePacked);
+		}
+		else if (!m_settings.sequence.empty())
+		{
+			debugF("OceanApp: the GPGPU configuration can't play back a sequence.\n");
+		}
+
+		const uint32_t gridSize = m_wrapper->getWidth();
 
 		//--------------------- Shaders Compilation ---------------------//
 		// compile the ocean shader.
@@ -122,34 +166,50 @@ public:
 		//--------------------- Constant Buffers Initialisation ---------------------//
 		// Create Per Frame Constant Buffer.
 		m_pPerFrameCB = create_constant_buffer<PerFrameCBData>(systems.pD3DDevice);
-		m_perFrameCBData.m_gridSize = SIZE_OF_GRID;
+		m_perFrameCBData.m_gridSize = (f32)gridSize;
+
+		// Every cascade is a slice of the textures, summed by the shaders
+		const uint32_t cascades = m_wrapper->getCascadeCount();
+		float cascadeTiles[FFTWrapper::kMaxCascades] = {};
+		for (uint32_t c = 0; c < cascades; ++c)
+			cascadeTiles[c] = m_wrapper->getPatchSize(0) / m_wrapper->getPatchSize(c);
+		m_perFrameCBData.m_vCascadeTiles = v4(cascadeTiles[0], cascadeTiles[1], cascadeTiles[2], cascadeTiles[3]);
+		m_perFrameCBData.m_cascadeCount = (f32)cascades;
 
 		// Create Per Draw Constant Buffer.
 		m_pPerDrawCB = create_constant_buffer<PerDrawCBData>(systems.pD3DDevice);		
 
 		// Create cs Buffer.
 		m_pOceanCsCB = create_constant_buffer<OceanCsCBData>(systems.pD3DDevice);
-		m_oceanCsCBData.m_gridSize = SIZE_OF_GRID;
+		m_oceanCsCBData.m_gridSize = (f32)gridSize;
 
 		// Create Normals Calculation CS Buffer.
 		m_pNormCsCB = create_constant_buffer<NormCsCBData>(systems.pD3DDevice);
-		m_normCsCBData.m_texSize = SIZE_OF_GRID;
+		m_normCsCBData.m_texSize = (f32)gridSize;
 
 		// We need a sampler state to define wrapping and mipmap parameters.
 		m_pSamplerState = create_basic_sampler(systems.pD3DDevice, D3D11_TEXTURE_ADDRESS_WRAP);
 
 
 		//--------------------- Textures Initialisation ---------------------//
-		// Initialise heightmap texture
-		m_heightmapTexture.init_custom(systems.pD3DDevice, SIZE_OF_GRID, true);
+		// Initialise heightmap texture, in the upload format of the wrapper
+		const TextureFormat textureFormat = m_wrapper->getTextureFormat();
+		m_heightmapTexture.init_custom(systems.pD3DDevice, gridSize, true, kHeightmapFormats[textureFormat], cascades);
 
-		// Initialise normalmap texture
-#ifdef GPGPU_NORM_CD
-		m_normalmapTexture.init_custom(systems.pD3DDevice, SIZE_OF_GRID, false);
-#endif // GPGPU_NORM_CD
-#if defined(CPU_NORM_CD) | defined(CPU_NORM_FFT)
-		m_normalmapTexture.init_custom(systems.pD3DDevice, SIZE_OF_GRID, true);
-#endif // CPU_NORM_CD | CPU_NORM_FFT
+		// Initialise normalmap texture, written by a compute shader in RGBA32F on the GPGPU path
+		if (m_pipeline->Uses_GPGPU())
+		{
+			m_normalmapTexture.init_custom(systems.pD3DDevice, gridSize, false, DXGI_FORMAT_R32G32B32A32_FLOAT, cascades);
+		}
+		else
+		{
+			m_normalmapTexture.init_custom(systems.pD3DDevice, gridSize, true, kNormalmapFormats[textureFormat], cascades);
+
+			// The packed normal map keeps the foam flags in a texture of their own
+			if (textureFormat == kTexturePacked)
+				m_foamMaskTexture.init_custom(systems.pD3DDevice, gridSize, true, DXGI_FORMAT_R8_UNORM, cascades);
+		}
+		m_perFrameCBData.m_packedNormals = (m_foamMaskTexture.getSRV() != nullptr) ? 1.0f : 0.0f;
 
 		// Initialise foam texture
 		m_foamTexture.init_from_image(systems.pD3DDevice, "Assets/Textures/Ocean_Foam.png", false, true);
@@ -159,16 +219,25 @@ public:
 
 
 		//--------------------- Initialisation of Philips Spectrum, h0 and h0conjugate. ---------------------//
-		m_wrapper.Generate_Heightmap();
+		// Nothing is simulated while a sequence plays
+		if (!m_sequence)
+			m_wrapper->Generate_Heightmap();
+
+		// The CPU configurations can simulate on a worker, one frame ahead
+		m_threads = m_wrapper->getThreadCount();
+		if (m_settings.async && !m_pipeline->Uses_GPGPU() && !m_sequence)
+			m_async.reset(new AsyncSimulation(*m_pipeline, *m_wrapper, { m_lambda, m_heightAdj, m_foamInt, m_timescale, m_seaState, m_seaStateVersion }));
+		else if (m_settings.async && m_pipeline->Uses_GPGPU())
+			debugF("OceanApp: the GPGPU configuration can't run asynchronously.\n");
 
 
 		//--------------------- Compute Shader (Ocean) Buffers Initialisation ---------------------//
-		uint32_t buffSize = m_wrapper.getHeight() * m_wrapper.getWidth();
+		uint32_t buffSize = m_wrapper->getHeight() * m_wrapper->getWidth();
 
 		// Stractured buffers to pass their views into the CS, and a reader buffer to get the results.
-		CreateStructuredBuffer(systems.pD3DDevice, sizeof(float), buffSize, m_wrapper.getKMag(), &g_pBufKMag);
-		CreateStructuredBuffer(systems.pD3DDevice, sizeof(Vec2), buffSize, m_wrapper.getH0Tilde(), &g_pBufH0t);
-		CreateStructuredBuffer(systems.pD3DDevice, sizeof(Vec2), buffSize, m_wrapper.getH0TildeConj(), &g_pBufH0tc);
+		CreateStructuredBuffer(systems.pD3DDevice, sizeof(float), buffSize, m_wrapper->getKMag(), &g_pBufKMag);
+		CreateStructuredBuffer(systems.pD3DDevice, sizeof(Vec2), buffSize, m_wrapper->getH0Tilde(), &g_pBufH0t);
+		CreateStructuredBuffer(systems.pD3DDevice, sizeof(Vec2), buffSize, m_wrapper->getH0TildeConj(), &g_pBufH0tc);
 		CreateStructuredBuffer(systems.pD3DDevice, sizeof(Vec2), buffSize, nullptr, &g_pBufHtilde);
 		CreateReaderBuffer(systems.pD3DDevice, systems.pD3DContext, g_pBufHtilde, &g_pBufReader);
 
@@ -270,9 +339,42 @@ public:
 		ImGui::SliderFloat("Reflectivity", &m_reflectFrag, 0.0f, 1.0f);
 		ImGui::Separator();
 
-#ifdef GPGPU_NORM_CD
 		ImGui::SliderFloat("Timescale", &m_timescale, 0.0f, 0.1f);
-#endif //GPGPU_NORM_CD
+
+		// The worker applies the thread count to its next frame
+		if (ImGui::SliderInt("CPU Threads", &m_threads, 1, omp_get_max_threads()) && !m_async)
+			m_wrapper->setThreadCount(m_threads);
+		ImGui::Separator();
+
+		// Sea state, rebuilt and faded in by the simulation over the next frames.
+		// A sequence plays back the sea state it was baked with.
+		if (m_sequence)
+		{
+			ImGui::TextDisabled("Sea state: baked into the sequence");
+		}
+		else
+		{
+			int spectrum = m_seaState.model;
+			int spreading = m_seaState.spreading;
+			bool seaStateChanged = false;
+			seaStateChanged |= ImGui::Combo("Spectrum", &spectrum,
+				[](void*, int item, const char** text) { *text = SpectrumModelName((SpectrumModel)item); return true; }, nullptr, kMaxSpectrumModels);
+			seaStateChanged |= ImGui::Combo("Spreading", &spreading,
+				[](void*, int item, const char** text) { *text = SpreadingFunctionName((SpreadingFunction)item); return true; }, nullptr, kMaxSpreadingFunctions);
+			seaStateChanged |= ImGui::SliderFloat("Wind Speed", &m_seaState.windSpeed, 1.0f, 40.0f, "%.1f m/s");
+			seaStateChanged |= ImGui::SliderAngle("Wind Direction", &m_windAngle, -180.0f, 180.0f);
+			seaStateChanged |= ImGui::SliderFloat("Fetch", &m_seaState.fetch, 1000.0f, 1000000.0f, "%.0f m", 3.0f);
+			seaStateChanged |= ImGui::SliderFloat("Depth", &m_seaState.depth, 1.0f, 100.0f, "%.1f m");
+
+			if (seaStateChanged)
+			{
+				m_seaState.model = (SpectrumModel)spectrum;
+				m_seaState.spreading = (SpreadingFunction)spreading;
+				m_seaState.windX = cosf(m_windAngle);
+				m_seaState.windZ = sinf(m_windAngle);
+				++m_seaStateVersion;
+			}
+		}
 
 		ImGui::Columns(3);
 		ImGui::Checkbox("Wireframe", &m_onlyWireframe);
@@ -283,6 +385,25 @@ public:
 		ImGui::NextColumn();
 		ImGui::Checkbox("Pause", &m_pause);
 		ImGui::Columns(1);
+		ImGui::Separator();
+		ImGui::Text("Pipeline: %s, %ux%u, %s FFT", PipelineModeName(m_pipeline->Mode()), m_wrapper->getWidth(), m_wrapper->getHeight(),
+			FFTBackendName(m_wrapper->getFFTBackend()));
+		ImGui::Text("FFT planning: %.3f s, %.2f MFLOP per frame", m_wrapper->getPlanningTime(), m_wrapper->getPlanFlops() * 1e-6);
+		ImGui::Text("Spectrum kernels: %s, %.0f%% of the bins live", SimdLevelName(m_wrapper->getSimdLevel()), m_wrapper->getLiveBinFraction() * 100.0f);
+		ImGui::Text("Textures: %s", TextureFormatName(m_wrapper->getTextureFormat()));
+		ImGui::Text("Seed: %u%s", m_wrapper->getSeed(), m_wrapper->isSpectrumCached() ? ", spectrum from the cache" : "");
+		ImGui::Text("Sea state: %.0f%%", m_wrapper->getRebuildProgress() * 100.0f);
+		if (m_sequence)
+		{
+			ImGui::Text("Sequence: frame %u of %u, %.1f s loop, seed %u", m_sequence->Frame_At(m_sequenceTime), m_sequence->getFrameCount(),
+				m_sequence->getPeriod(), m_sequence->getSeed());
+		}
+		if (m_async)
+		{
+			ImGui::Text("Async: frame %llu of %llu, %.2f ms simulation", (unsigned long long)m_async->getFrameIndex(),
+				(unsigned long long)m_async->getLatestFrame(), m_async->getSimulationTime());
+			ImGui::Text("Latency: %llu frames, %.2f ms", (unsigned long long)m_async->getFrameLatency(), m_async->getLatency());
+		}
 		ImGui::End();
 		
 		// Note: Every system update should happen after the ImGui updates
@@ -305,71 +426,92 @@ public:
 		if (m_pause)
 			return;
 		
-//--------------------------------- GPGPU Execution ---------------------------------//
-#ifdef GPGPU_NORM_CD
+//--------------------------------- Simulation Step ---------------------------------//
+		const PipelineFrame frame = { m_lambda, m_heightAdj, m_foamInt, m_timescale, m_seaState, m_seaStateVersion };
 
-		//---------------------------------------------------------------------------
-		// This order of functions excecution was chosen to properly synchronise
-		// the CPU with the GPU. This way we can fully load the command buffer before
-		// Present is called. After that we give the GPU plenty of time to execute 
-		// all of its commands before the CPU needs these resources again.
-		// The cost of this optimisation is the first two frames.
-		//---------------------------------------------------------------------------
-		m_oceanCsCBData.m_time += m_timescale;			// Increase time
-		m_wrapper.Fill_Horizontal_Displacement();		// Fill the input for the horizontal displacement
-		m_wrapper.IFFT_Thread();						// Run the IFFTs in parallel
-		m_wrapper.Fill_Texture();						// Fill the heightmap texture
-
-		// Update Heightmap texture to use in the GPU
+		// Frames of a sequence come straight from the file
+		if (m_sequence)
 		{
-			ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
-			//  Disable GPU access to the texture data.
-			systems.pD3DContext->Map(m_heightmapTexture.getTexture(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-			//  Update the texture here.
-			memcpy(mappedResource.pData, m_wrapper.getImageOut(), (m_wrapper.getHeight() * m_wrapper.getWidth() * 4 * 4));
-			//  Re-enable GPU access to the texture data.
-			systems.pD3DContext->Unmap(m_heightmapTexture.getTexture(), 0);
+			m_sequenceTime = fmodf(m_sequenceTime + m_timescale, m_sequence->getPeriod());
+			upload_textures(systems, m_sequence->getFrame(m_sequence->Frame_At(m_sequenceTime)));
+			return;
 		}
 
-		compute_normals_cs(systems);							// Dispatch Normals calculation compute shader
-		read_htilde(systems);									// Map GPU resource and copy to CPU input
-		compute_htilde_cs(systems);								// Dispatch Htilde calculation compute shader
-#endif //GPGPU_NORM_CD
+		// The worker simulates the next frame while the newest finished one is rendered
+		if (m_async)
+		{
+			if (m_async->Acquire())
+				upload_textures(systems, m_async->getTextures());
 
-//--------------------------------- CPU only Executions ---------------------------------//
-#if defined(CPU_NORM_CD) | defined(CPU_NORM_FFT)
-		
-		m_wrapper.Fill_htilde_and_Displacements();				// Fill the input for the IFFT
-		m_wrapper.IFFT_Thread();								// Run the IFFTs in parallel
-		m_wrapper.Fill_Texture();								// Fill the heightmap texture
+			m_async->Submit(frame, m_threads);
+			return;
+		}
 
-#if defined(CPU_NORM_FFT)
-		m_wrapper.Fill_Normals_FFT(m_lambda, m_foamInt);						// Fill Normal map using FFT
-#elif defined(CPU_NORM_CD)
-		m_wrapper.Fill_Normals_Central_Diff(m_lambda, m_heightAdj, m_foamInt);	// Fill Normal map using Central Difference
-#endif 
+		// CPU side of the execution configuration
+		m_pipeline->Step(*m_wrapper, frame);
+		upload_textures(systems, m_wrapper->getTextures());
 
-		// Update Heightmap texture
+//--------------------------------- GPGPU Execution ---------------------------------//
+		if (m_pipeline->Uses_GPGPU())
 		{
-			ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
-			//  Disable GPU access to the texture data.
-			systems.pD3DContext->Map(m_heightmapTexture.getTexture(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-			//  Update the texture here.
-			memcpy(mappedResource.pData, m_wrapper.getImageOut(), (m_wrapper.getHeight() * m_wrapper.getWidth() * 4 * 4));
-			//  Re-enable GPU access to the texture data.
-			systems.pD3DContext->Unmap(m_heightmapTexture.getTexture(), 0);
+			//---------------------------------------------------------------------------
+			// This order of functions excecution was chosen to properly synchronise
+			// the CPU with the GPU. This way we can fully load the command buffer before
+			// Present is called. After that we give the GPU plenty of time to execute 
+			// all of its commands before the CPU needs these resources again.
+			// The cost of this optimisation is the first two frames.
+			//---------------------------------------------------------------------------
+			m_oceanCsCBData.m_time += m_timescale;				// Increase time
+
+			// A sea state change has replaced the spectrum
+			if (m_wrapper->getSpectrumVersion() != m_spectrumVersion)
+			{
+				systems.pD3DContext->UpdateSubresource(g_pBufH0t, 0, nullptr, m_wrapper->getH0Tilde(), 0, 0);
+				systems.pD3DContext->UpdateSubresource(g_pBufH0tc, 0, nullptr, m_wrapper->getH0TildeConj(), 0, 0);
+				m_spectrumVersion = m_wrapper->getSpectrumVersion();
+			}
+
+			compute_normals_cs(systems);							// Dispatch Normals calculation compute shader
+			read_htilde(systems);									// Map GPU resource and copy to CPU input
+			compute_htilde_cs(systems);								// Dispatch Htilde calculation compute shader
 		}
-		//Update Normalmap texture
+	}
+
+	void upload_textures(SystemsInterface &systems, const FFTWrapper::TextureSet& textures)
+	{
+		for (uint32_t c = 0; c < m_wrapper->getCascadeCount(); ++c)
 		{
-			ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
-			//  Disable GPU access to the texture data.
-			systems.pD3DContext->Map(m_normalmapTexture.getTexture(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-			//  Update the texture here.
-			memcpy(mappedResource.pData, m_wrapper.getNormalOut(), (m_wrapper.getHeight() * m_wrapper.getWidth() * 4 * 4));
-			//  Re-enable GPU access to the texture data.
-			systems.pD3DContext->Unmap(m_normalmapTexture.getTexture(), 0);
+			// Update Heightmap texture, and how the shaders decode it
+			upload_texture(systems, m_heightmapTexture, c, m_wrapper->getImageTexels(textures, c), m_wrapper->getImageTexelBytes());
+
+			float dispMul[3], dispAdd[3];
+			m_wrapper->getDisplacementDecode(textures, dispMul, dispAdd, c);
+			m_perFrameCBData.m_vDispMul[c] = v4(dispMul[0], dispMul[1], dispMul[2], 1.0f);
+			m_perFrameCBData.m_vDispAdd[c] = v4(dispAdd[0], dispAdd[1], dispAdd[2], 0.0f);
+
+			// CPU only Executions, the GPGPU normal map comes from a compute shader
+			if (!m_pipeline->Uses_GPGPU())
+			{
+				//Update Normalmap texture
+				upload_texture(systems, m_normalmapTexture, c, m_wrapper->getNormalTexels(textures, c), m_wrapper->getNormalTexelBytes());
+
+				if (m_foamMaskTexture.getSRV())
+					upload_texture(systems, m_foamMaskTexture, c, m_wrapper->getFoamTexels(textures, c), 1);
+			}
 		}
-#endif // CPU_NORM_CD | CPU_NORM_FFT
+
+		// The GPGPU configuration only simulates the first cascade
+		m_normCsCBData.m_vDispMul = m_perFrameCBData.m_vDispMul[0];
+		m_normCsCBData.m_vDispAdd = m_perFrameCBData.m_vDispAdd[0];
+	}
+
+	void upload_texture(SystemsInterface &systems, Texture& texture, const uint32_t& slice, const void* texels, const uint32_t& texelBytes)
+	{
+		const uint32_t rowBytes = m_wrapper->getWidth() * texelBytes;
+
+		// The texture arrays live in GPU memory, every cascade is a slice of its own
+		systems.pD3DContext->UpdateSubresource(texture.getTexture(), D3D11CalcSubresource(0, slice, 1), nullptr,
+			texels, rowBytes, rowBytes * m_wrapper->getHeight());
 	}
 
 	void on_render(SystemsInterface& systems) override
@@ -406,7 +548,7 @@ public:
 		systems.pD3DContext->CSSetConstantBuffers(2, 1, buffers);
 
 		// Dispatch Compute Shader
-		systems.pD3DContext->Dispatch(SIZE_OF_GRID / 4, SIZE_OF_GRID / 4, 1);
+		systems.pD3DContext->Dispatch(m_wrapper->getWidth() / 4, m_wrapper->getHeight() / 4, 1);
 
 		// Unbind all buffers to clean up
 		ID3D11ShaderResourceView* nullSRV[] = { NULL, NULL, NULL };
@@ -430,13 +572,17 @@ public:
 		systems.pD3DContext->Map(g_pBufReader, 0, D3D11_MAP_READ, 0, &mappedResource);
 		p = (Vec2*)mappedResource.pData;
 		
-		// Copy result to FFT input
-		uint32_t arraySize = SIZE_OF_GRID * SIZE_OF_GRID;
-		fftwf_complex * temp_pFFTin = m_wrapper.getFFTin(0);
-		for (uint32_t n = 0; n < arraySize; ++n)
+		// Copy result to FFT input, which only holds the half spectrum in c2r mode
+		uint32_t gridSize = m_wrapper->getWidth();
+		uint32_t specWidth = m_wrapper->getSpectrumWidth();
+		fftwf_complex * temp_pFFTin = m_wrapper->getFFTin(kFieldHeight);
+		for (uint32_t j = 0; j < gridSize; ++j)
 		{
-			temp_pFFTin[n][0] = p[n].x;
-			temp_pFFTin[n][1] = p[n].y;
+			for (uint32_t i = 0; i < specWidth; ++i)
+			{
+				temp_pFFTin[j * specWidth + i][0] = p[j * gridSize + i].x;
+				temp_pFFTin[j * specWidth + i][1] = p[j * gridSize + i].y;
+			}
 		}
 		systems.pD3DContext->Unmap(g_pBufReader, 0);
 	}
@@ -458,7 +604,7 @@ public:
 		systems.pD3DContext->CSSetConstantBuffers(0, 1, buffers);
 
 		// Dispatch Compute Shader
-		systems.pD3DContext->Dispatch(SIZE_OF_GRID / 4, SIZE_OF_GRID / 4, 1);
+		systems.pD3DContext->Dispatch(m_wrapper->getWidth() / 4, m_wrapper->getHeight() / 4, 1);
 
 		// Unbind all buffers to clean up
 		ID3D11ShaderResourceView* nullSRV[] = { NULL };
@@ -494,6 +640,10 @@ public:
 		// Bind the sky texture for reflections and refractions
 		m_skyMapTexture.bind(systems.pD3DContext, ShaderStage::kPixel, 3);
 
+		// Foam flags of the packed normal map
+		ID3D11ShaderResourceView* foamMaskSRV[] = { m_foamMaskTexture.getSRV() };
+		systems.pD3DContext->PSSetShaderResources(4, 1, foamMaskSRV);
+
 		// Set blend depth stencil states
 		// Option for Wireframe mode.
 		if(m_onlyWireframe)
@@ -626,9 +776,18 @@ private:
 	Texture m_heightmapTexture;
 	Texture m_normalmapTexture;
 	Texture m_foamTexture;
+	Texture m_foamMaskTexture;		// Only for packed CPU normal maps
+
+	// Simulation, created once the execution configuration is known
+	PipelineSettings m_settings;
+	std::unique_ptr<SimulationPipeline> m_pipeline;
+	std::unique_ptr<FFTWrapper> m_wrapper;
+	std::unique_ptr<AsyncSimulation> m_async;		// Destroyed before the wrapper it runs
+	std::unique_ptr<OceanSequence> m_sequence;		// Played back instead of simulating
+	float m_sequenceTime = 0.0f;
+	int m_threads = 0;
 
 	// Singletons
-	FFTWrapper & m_wrapper = FFTWrapper::getInstance(SIZE_OF_GRID);
 	OceanTile &Tile = OceanTile::getInstance();
 	
 	// Sampler State
@@ -691,6 +850,12 @@ private:
 	float m_heightAdj = 1.2f;
 	float m_reflectFrag = 0.6f;
 
+	// Sea state asked of the simulation, which changes to it when the version changes
+	SeaState m_seaState;
+	uint32_t m_seaStateVersion = 0;
+	float m_windAngle = 0.0f;
+	uint32_t m_spectrumVersion = 0;		// Of the h0 buffers on the GPU
+
 	// Imgui Checkboxes
 	bool m_onlyWireframe = false;
 	bool m_showHeightmaps = false;
@@ -13,13 +13,21 @@ cbuffer NormCalcCB : register(b0)
 	float  heightAdjust;
 	float  foamInt;
 	float  texSize;
+	float4 dispMul;		// Heightmap texel to displacement, for packed heightmaps
+	float4 dispAdd;
 };
 
 /////////////////////////////////////////////////////////////////
 // Textures
 /////////////////////////////////////////////////////////////////
-Texture2D<float4> texHeightmap : register(t0);
-RWTexture2D<float4> texNormals : register(u0);
+// Texture arrays of the first cascade, the only one simulated on the GPU
+Texture2DArray<float4> texHeightmap : register(t0);
+RWTexture2DArray<float4> texNormals : register(u0);
+
+float3 Displacement(uint2 coord)
+{
+	return texHeightmap[uint3(coord, 0)].xyz * dispMul.xyz + dispAdd.xyz;
+}
 
 /////////////////////////////////////////////////////////////////
 // Compute Shader
@@ -46,17 +54,20 @@ void CS_Normals(uint3 DTid : SV_DispatchThreadID)
 	float Jxx, Jyy, Jxy, Jyx, jacobian;
 	int jacobianVal;
 	float3 va, vb, normals;
+	float3 d11 = Displacement(DTid.xy);
+	float3 d21 = Displacement(xNext);
+	float3 d12 = Displacement(zNext);
 
 	// Normals and Jacobian calculation
-	s11 = heightAdjust * texHeightmap[DTid.xy].y;
+	s11 = heightAdjust * d11.y;
 
-	s21 = heightAdjust * texHeightmap[xNext].y;
-	Jxx = 1 + lambda * (-texHeightmap[xNext].x + texHeightmap[DTid.xy].x) * foamInt;
-	Jxy = lambda * (-texHeightmap[xNext].z + texHeightmap[DTid.xy].z) * foamInt;
+	s21 = heightAdjust * d21.y;
+	Jxx = 1 + lambda * (-d21.x + d11.x) * foamInt;
+	Jxy = lambda * (-d21.z + d11.z) * foamInt;
 
-	s12 = heightAdjust * texHeightmap[zNext].y;
-	Jyy = 1 + lambda * (-texHeightmap[zNext].z + texHeightmap[DTid.xy].z) * foamInt;
-	Jyx = lambda * (-texHeightmap[zNext].x + texHeightmap[DTid.xy].x) * foamInt;
+	s12 = heightAdjust * d12.y;
+	Jyy = 1 + lambda * (-d12.z + d11.z) * foamInt;
+	Jyx = lambda * (-d12.x + d11.x) * foamInt;
 
 	va = normalize(float3(2.0f, 0.0f, s21 - s11));
 	vb = normalize(float3(0.0f, 2.0f, s12 - s11));
@@ -68,5 +79,5 @@ void CS_Normals(uint3 DTid : SV_DispatchThreadID)
 	else
 		jacobianVal = 0.0f;
 
-	texNormals[DTid.xy] = float4(normals.xzy, jacobianVal);
+	texNormals[uint3(DTid.xy, 0)] = float4(normals.xzy, jacobianVal);
 }
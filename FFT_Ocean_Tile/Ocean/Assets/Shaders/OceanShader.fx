@@ -37,6 +37,12 @@ cbuffer PerFrameCB : register(b0)
 	float  lambda;
 	float  heightAdjust;
 	float  reflectivity;
+	float4 vDispMul[4];		// Heightmap texel to displacement of every cascade, for packed heightmaps
+	float4 vDispAdd[4];
+	float4 vCascadeTiles;	// Repeats of every cascade's patch over the tile
+	float  packedNormals;	// XZ normals, with the foam flags in g_TexFoamMask
+	float  cascadeCount;
+	float2 padding;
 };
 
 cbuffer PerDrawCB : register(b1)
@@ -56,12 +62,25 @@ cbuffer csCB : register(b2)
 /////////////////////////////////////////////////////////////////
 // Textures
 /////////////////////////////////////////////////////////////////
-Texture2D<float4> g_Tex0 : register(t0);
-Texture2D<float4> g_TexNormals : register(t1);
+Texture2DArray<float4> g_Tex0 : register(t0);			// A slice per cascade
+Texture2DArray<float4> g_TexNormals : register(t1);
 Texture2D<float4> g_TexFoam : register(t2);
 TextureCube g_TexSky : register(t3);
+Texture2DArray<float> g_TexFoamMask : register(t4);
 SamplerState g_Sampler0 : register (s0);
 
+/////////////////////////////////////////////////////////////////
+// Helpers
+/////////////////////////////////////////////////////////////////
+
+// Unit normal of a texel, packed normals only keep X and Z
+float3 UnpackNormal(float3 normals)
+{
+	if (packedNormals > 0)
+		return float3(normals.x, sqrt(saturate(1 - normals.x * normals.x - normals.y * normals.y)), normals.y);
+	return normals;
+}
+
 /////////////////////////////////////////////////////////////////
 // Vertex Shader
 /////////////////////////////////////////////////////////////////
@@ -73,15 +92,25 @@ PixelInput VS_Ocean(VertexInput IN)
 	// Constants
 	float4 oceanColor = float4(0.2f, 0.36f, 0.6f, 1);
 
-	// Sampling
-	uint3 sampleCoord = uint3((gridSize-1) * IN.uv, 0);
-	float3 distex = g_Tex0.Load(sampleCoord);
-	float3 normals = g_TexNormals.Load(sampleCoord);
+	// Sampling, every cascade repeats its smaller patch over the tile. The
+	// displacements add up, and so do the slopes of the normals.
+	float3 distex = 0;
+	float2 slopes = 0;
+	for (uint c = 0; c < (uint)cascadeCount; ++c)
+	{
+		uint2 texel = uint2((gridSize-1) * IN.uv * vCascadeTiles[c]) % (uint)gridSize;
+		uint4 sampleCoord = uint4(texel, c, 0);
+
+		distex += g_Tex0.Load(sampleCoord).xyz * vDispMul[c].xyz + vDispAdd[c].xyz;
+
+		float3 normals = UnpackNormal(g_TexNormals.Load(sampleCoord).xyz);
+		slopes += normals.xz / max(normals.y, 1e-3f);
+	}
 
 	// Calculate Displacement and Normals
 	float3 displacement = float3(lambda * (-distex.x), heightAdjust * (distex.y), lambda * (-distex.z));
 	IN.pos += displacement;
-	IN.normal = normalize(normals);
+	IN.normal = normalize(float3(slopes.x, 1, slopes.y));
 
 	// World position
 	float4 worldPos = mul(float4(IN.pos, 1.0), matModel);
@@ -113,8 +142,6 @@ float4 PS_Ocean(PixelInput IN) : SV_TARGET
 	float3 reflection = normalize(reflect(eyeVector, normal));
 
 	// Sampling
-	float4 heightSample = g_Tex0.Sample(g_Sampler0, IN.uv);
-	float4 normalSample = g_TexNormals.Sample(g_Sampler0, IN.uv);
 	float4 reflectionColour = g_TexSky.Sample(g_Sampler0, reflection);
 	float4 foamSample = g_TexFoam.Sample(g_Sampler0, IN.uv * 2);
 
@@ -122,9 +149,15 @@ float4 PS_Ocean(PixelInput IN) : SV_TARGET
 	float brightness = max(dot(-lightDir, normal), 0.0f) + ambient;
 	float4 lightedColour = oceanColor * brightness;
 
-	// Add Foam by using the folding map, stored into normalSample.w
+	// Add Foam by using the folding map of any cascade, stored into the normals' w or the foam mask
+	float folding = 0;
+	for (uint c = 0; c < (uint)cascadeCount; ++c)
+	{
+		float3 sampleCoord = float3(frac(IN.uv * vCascadeTiles[c]), c);
+		folding = max(folding, (packedNormals > 0) ? g_TexFoamMask.Sample(g_Sampler0, sampleCoord) : g_TexNormals.Sample(g_Sampler0, sampleCoord).w);
+	}
 	float4 foamlessColour = lerp(lightedColour, reflectionColour, reflectivity);
-	return foamlessColour + (normalSample.w * foamSample);
+	return foamlessColour + (folding * foamSample);
 }
 
 /////////////////////////////////////////////////////////////////
@@ -29,8 +29,8 @@ struct PixelInput
 /////////////////////////////////////////////////////////////////
 // Textures
 /////////////////////////////////////////////////////////////////
-Texture2D<float4> g_TexDispl : register(t0);
-Texture2D<float4> g_TexNormal : register(t1);
+Texture2DArray<float4> g_TexDispl : register(t0);		// Shows the first cascade
+Texture2DArray<float4> g_TexNormal : register(t1);
 SamplerState g_Sampler0 : register (s0);
 
 
@@ -72,7 +72,7 @@ float4 PS_UI(PixelInput IN) : SV_TARGET
 		if (IN.pos.x > locationX1 && IN.pos.x < locationX1 + size)
 		{
 			float2 coords = float2((IN.pos.x - locationX1) / size, (IN.pos.y - locationY1) / size);
-			float4 smpl = g_TexDispl.Sample(g_Sampler0, coords);
+			float4 smpl = g_TexDispl.Sample(g_Sampler0, float3(coords, 0));
 			return float4(smpl.xxx, 1);
 		}
 
@@ -80,7 +80,7 @@ float4 PS_UI(PixelInput IN) : SV_TARGET
 		if (IN.pos.x > locationX2 && IN.pos.x < locationX2 + size)
 		{
 			float2 coords = float2((IN.pos.x - locationX2) / size, (IN.pos.y - locationY1) / size);
-			float4 smpl = g_TexDispl.Sample(g_Sampler0, coords);
+			float4 smpl = g_TexDispl.Sample(g_Sampler0, float3(coords, 0));
 			return float4(smpl.yyy, 1);
 		}
 
@@ -88,7 +88,7 @@ float4 PS_UI(PixelInput IN) : SV_TARGET
 		if (IN.pos.x > locationX3 && IN.pos.x < locationX3 + size)
 		{
 			float2 coords = float2((IN.pos.x - locationX3) / size, (IN.pos.y - locationY1) / size);
-			float4 smpl = g_TexDispl.Sample(g_Sampler0, coords);
+			float4 smpl = g_TexDispl.Sample(g_Sampler0, float3(coords, 0));
 			return float4(smpl.zzz, 1);
 		}
 	}
@@ -99,7 +99,7 @@ float4 PS_UI(PixelInput IN) : SV_TARGET
 		if (IN.pos.x > locationX1 && IN.pos.x < locationX1 + size)
 		{
 			float2 coords = float2((IN.pos.x - locationX1) / size, (IN.pos.y - locationY2) / size);
-			float4 smpl = g_TexNormal.Sample(g_Sampler0, coords);
+			float4 smpl = g_TexNormal.Sample(g_Sampler0, float3(coords, 0));
 			return float4(smpl.xxx, 1);
 		}
 
@@ -107,7 +107,7 @@ float4 PS_UI(PixelInput IN) : SV_TARGET
 		if (IN.pos.x > locationX2 && IN.pos.x < locationX2 + size)
 		{
 			float2 coords = float2((IN.pos.x - locationX2) / size, (IN.pos.y - locationY2) / size);
-			float4 smpl = g_TexNormal.Sample(g_Sampler0, coords);
+			float4 smpl = g_TexNormal.Sample(g_Sampler0, float3(coords, 0));
 			return float4(smpl.yyy, 1);
 		}
 
@@ -115,7 +115,7 @@ float4 PS_UI(PixelInput IN) : SV_TARGET
 		if (IN.pos.x > locationX3 && IN.pos.x < locationX3 + size)
 		{
 			float2 coords = float2((IN.pos.x - locationX3) / size, (IN.pos.y - locationY2) / size);
-			float4 smpl = g_TexNormal.Sample(g_Sampler0, coords);
+			float4 smpl = g_TexNormal.Sample(g_Sampler0, float3(coords, 0));
 			return float4(smpl.zzz, 1);
 		}
 
@@ -123,7 +123,7 @@ float4 PS_UI(PixelInput IN) : SV_TARGET
 		if (IN.pos.x > locationX4 && IN.pos.x < locationX4 + size)
 		{
 			float2 coords = float2((IN.pos.x - locationX4) / size, (IN.pos.y - locationY2) / size);
-			float4 smpl = g_TexNormal.Sample(g_Sampler0, coords);
+			float4 smpl = g_TexNormal.Sample(g_Sampler0, float3(coords, 0));
 			return float4(smpl.www, 1);
 		}
 	}
@@ -134,7 +134,7 @@ float4 PS_UI(PixelInput IN) : SV_TARGET
 		if (IN.pos.x > locationX1 && IN.pos.x < locationX1 + size2)
 		{
 			float2 coords = float2((IN.pos.x - locationX1) / size2, (IN.pos.y - locationY3) / size2);
-			float4 smpl = g_TexDispl.Sample(g_Sampler0, coords);
+			float4 smpl = g_TexDispl.Sample(g_Sampler0, float3(coords, 0));
 			return float4(smpl.xyz, 1);
 		}
 
@@ -142,7 +142,7 @@ float4 PS_UI(PixelInput IN) : SV_TARGET
 		if (IN.pos.x > locationX4 && IN.pos.x < locationX4 + size2)
 		{
 			float2 coords = float2((IN.pos.x - locationX4) / size2, (IN.pos.y - locationY3) / size2);
-			float4 smpl = g_TexNormal.Sample(g_Sampler0, coords);
+			float4 smpl = g_TexNormal.Sample(g_Sampler0, float3(coords, 0));
 			return float4(smpl.xzy, 1);
 		}
 	}
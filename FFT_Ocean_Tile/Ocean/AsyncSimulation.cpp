@@ -0,0 +1,105 @@
+#include "AsyncSimulation.h"
+
+AsyncSimulation::AsyncSimulation(SimulationPipeline& pipeline, FFTWrapper& wrapper, const PipelineFrame& first)
+	:m_pipeline(pipeline), m_wrapper(wrapper), m_latestFrame(0), m_simulationMs(0)
+{
+	// Three sets in flight: the wrapper's own, and one in each of the
+	// front and middle slots. The back slot starts out empty.
+	for (uint32_t slot(0); slot < 3; ++slot)
+	{
+		if (&m_frames.Slot(slot) != &m_frames.Back())
+			m_wrapper.Allocate_Texture_Set(m_frames.Slot(slot).textures);
+	}
+
+	// The renderer always has a frame to show
+	Request request;
+	request.frame = first;
+	request.threads = m_wrapper.getThreadCount();
+	request.time = Clock::now();
+
+	Simulate(request);
+	Acquire();
+
+	m_worker = std::thread(&AsyncSimulation::Worker_Loop, this);
+}
+
+AsyncSimulation::~AsyncSimulation()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_terminating = true;
+	}
+	m_wake.notify_one();
+	m_worker.join();
+
+	// The wrapper frees the set it holds
+	for (uint32_t slot(0); slot < 3; ++slot)
+		FFTWrapper::Free_Texture_Set(m_frames.Slot(slot).textures);
+}
+
+void AsyncSimulation::Submit(const PipelineFrame& frame, const int& threads)
+{
+	Request& request = m_requests.Back();
+	request.frame = frame;
+	request.threads = threads;
+	request.index = ++m_submitted;
+	request.time = Clock::now();
+	m_requests.Publish();
+
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_pending = true;
+	}
+	m_wake.notify_one();
+}
+
+bool AsyncSimulation::Acquire()
+{
+	if (!m_frames.Acquire())
+		return false;
+
+	m_latencyMs = std::chrono::duration<double, std::milli>(Clock::now() - m_frames.Front().requested).count();
+	return true;
+}
+
+void AsyncSimulation::Worker_Loop()
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_wakeMutex);
+			m_wake.wait(lock, [this] { return m_pending || m_terminating; });
+			if (m_terminating)
+				break;
+
+			m_pending = false;
+		}
+
+		if (m_requests.Acquire())
+			Simulate(m_requests.Front());
+	}
+}
+
+void AsyncSimulation::Simulate(const Request& request)
+{
+	const Clock::time_point start = Clock::now();
+
+	if (request.threads != m_wrapper.getThreadCount())
+		m_wrapper.setThreadCount(request.threads);
+
+	m_pipeline.Step(m_wrapper, request.frame);
+
+	// The finished set goes into the back slot, which is published as the
+	// newest frame. The wrapper carries on with the set of the slot it replaced,
+	// which the renderer has given up.
+	Frame& finished = m_frames.Back();
+	m_wrapper.Exchange_Textures(finished.textures);
+	finished.index = request.index;
+	finished.requested = request.time;
+
+	m_frames.Publish();
+	m_wrapper.Exchange_Textures(m_frames.Back().textures);
+
+	m_simulationMs.store(std::chrono::duration<double, std::milli>(Clock::now() - start).count(), std::memory_order_relaxed);
+	m_latestFrame.store(request.index, std::memory_order_release);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "SimulationPipeline.h"
+#include "TripleBuffer.h"
+
+//================================================================================
+// Runs the CPU side of an execution configuration on a worker thread, one
+// frame ahead of the renderer. Submit asks for the next frame and returns
+// at once, and Acquire takes the newest frame the worker has finished, so
+// a frame costs max(simulation, render) instead of their sum.
+//
+// Finished frames are handed over through a triple buffer of texture sets,
+// which the worker exchanges with the wrapper's own set, so no texels are
+// copied and neither thread waits for the other. Only configurations without
+// GPGPU work can run asynchronously, the GPGPU path writes htilde into the
+// wrapper from the render thread.
+//================================================================================
+class AsyncSimulation
+{
+public:
+	// Simulates the first frame before returning. From then on only the worker
+	// touches the wrapper, which has to outlive this object.
+	AsyncSimulation(SimulationPipeline& pipeline, FFTWrapper& wrapper, const PipelineFrame& first);
+	~AsyncSimulation();
+
+	AsyncSimulation(AsyncSimulation const&) = delete; // Don't Implement
+	void operator=(AsyncSimulation const&) = delete;   // Don't Implement
+
+	// Render thread. Asks for the next frame. Requests made while the worker
+	// is busy replace each other, only the newest one is simulated.
+	void Submit(const PipelineFrame& frame, const int& threads);
+
+	// Render thread. Takes the newest finished frame, false if the acquired one still is.
+	bool Acquire();
+
+	// The acquired frame, numbered by its Submit, the first frame being 0
+	inline const FFTWrapper::TextureSet& getTextures() { return m_frames.Front().textures; }
+	inline uint64_t getFrameIndex() { return m_frames.Front().index; }
+
+	// Newest finished frame, which may not have been acquired yet
+	inline uint64_t getLatestFrame() { return m_latestFrame.load(std::memory_order_acquire); }
+
+	// From the Submit of the acquired frame to its Acquire, in ms and in frames submitted since
+	inline double getLatency() { return m_latencyMs; }
+	inline uint64_t getFrameLatency() { return m_submitted - getFrameIndex(); }
+
+	// Time the worker spent on its last frame, in ms
+	inline double getSimulationTime() { return m_simulationMs.load(std::memory_order_relaxed); }
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct Frame
+	{
+		FFTWrapper::TextureSet textures;	// Empty in the back slot, whose set is lent to the wrapper
+		uint64_t index = 0;
+		Clock::time_point requested;
+	};
+
+	struct Request
+	{
+		PipelineFrame frame;
+		int threads = 0;
+		uint64_t index = 0;
+		Clock::time_point time;
+	};
+
+	void Worker_Loop();
+	void Simulate(const Request& request);
+
+	SimulationPipeline& m_pipeline;
+	FFTWrapper& m_wrapper;
+
+	// Finished frames, from the worker to the renderer
+	TripleBuffer<Frame> m_frames;
+
+	// Frame requests, from the renderer to the worker
+	TripleBuffer<Request> m_requests;
+
+	// Only puts the worker to sleep between requests, the data goes through the triple buffers
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wake;
+	bool m_pending = false;
+	bool m_terminating = false;
+
+	std::thread m_worker;
+
+	// Render thread
+	uint64_t m_submitted = 0;
+	double m_latencyMs = 0;
+
+	// Written by the worker
+	std::atomic<uint64_t> m_latestFrame;
+	std::atomic<double> m_simulationMs;
+};
@@ -0,0 +1,239 @@
+#include "BuoyancySolver.h"
+#include <algorithm>
+#include <cmath>
+
+#include <omp.h>
+
+namespace
+{
+	// Contiguous bands of [0, count), every edge but the last on a multiple of align
+	void Band_Range(const int& band, const int& bandCount, const uint32_t& count, const uint32_t& align, uint32_t& begin, uint32_t& end)
+	{
+		const uint32_t units = (count + align - 1) / align;
+
+		begin = std::min(count, (uint32_t)((uint64_t)units * band / bandCount) * align);
+		end = std::min(count, (uint32_t)((uint64_t)units * (band + 1) / bandCount) * align);
+	}
+
+	// Batches of queries start on whole AVX2 vectors
+	const uint32_t kQueryAlign = 8;
+}
+
+BuoyancySolver::BuoyancySolver(const int& threads)
+{
+	setThreadCount(threads);
+}
+
+void BuoyancySolver::setThreadCount(const int& threads)
+{
+	m_threadCount = (threads > 0) ? threads : omp_get_max_threads();
+}
+
+uint32_t BuoyancySolver::Add_Body(const float position[3], const float& mass, const BuoyancyProbe* probes, const uint32_t& probeCount)
+{
+	const uint32_t body = getBodyCount();
+
+	m_positionX.push_back(position[0]);
+	m_positionY.push_back(position[1]);
+	m_positionZ.push_back(position[2]);
+	m_velocityX.push_back(0);
+	m_velocityY.push_back(0);
+	m_velocityZ.push_back(0);
+	m_mass.push_back(mass);
+	m_firstProbe.push_back(getProbeCount());
+	m_probeCount.push_back(probeCount);
+
+	for (uint32_t p(0); p < probeCount; ++p)
+	{
+		m_offsetX.push_back(probes[p].offset[0]);
+		m_offsetY.push_back(probes[p].offset[1]);
+		m_offsetZ.push_back(probes[p].offset[2]);
+		m_radius.push_back(probes[p].radius);
+		m_drag.push_back(probes[p].drag);
+		m_probeBody.push_back(body);
+	}
+
+	return body;
+}
+
+void BuoyancySolver::Clear()
+{
+	for (std::vector<float>* bodyArray : { &m_positionX, &m_positionY, &m_positionZ, &m_velocityX, &m_velocityY, &m_velocityZ, &m_mass })
+		bodyArray->clear();
+	for (std::vector<float>* probeArray : { &m_offsetX, &m_offsetY, &m_offsetZ, &m_radius, &m_drag })
+		probeArray->clear();
+
+	m_firstProbe.clear();
+	m_probeCount.clear();
+	m_probeBody.clear();
+}
+
+void BuoyancySolver::getPosition(const uint32_t& body, float position[3])
+{
+	position[0] = m_positionX[body];
+	position[1] = m_positionY[body];
+	position[2] = m_positionZ[body];
+}
+
+void BuoyancySolver::getVelocity(const uint32_t& body, float velocity[3])
+{
+	velocity[0] = m_velocityX[body];
+	velocity[1] = m_velocityY[body];
+	velocity[2] = m_velocityZ[body];
+}
+
+void BuoyancySolver::Step(OceanSurface& surface, const float& timeStep)
+{
+	const uint32_t probes = getProbeCount();
+	if (probes == 0)
+		return;
+
+	// The scratch arrays only grow when bodies are added
+	for (std::vector<float>* scratch : { &m_forceX, &m_forceY, &m_forceZ, &m_sortedX, &m_sortedZ,
+		&m_waterHeight, &m_waterVelocityX, &m_waterVelocityY, &m_waterVelocityZ })
+		scratch->resize(probes);
+	m_tile.resize(probes);
+	m_order.resize(probes);
+
+	// Tiles of the first cascade, whose texels span the most metres
+	m_tilesAcross = std::max(1u, surface.getWidth() / kTileTexels);
+	m_tilesPerMetre = surface.isReady() ? m_tilesAcross / surface.getTileSize() : 0.0f;
+	m_tileStart.assign((size_t)m_threadCount * m_tilesAcross * m_tilesAcross, 0);
+
+#pragma omp parallel num_threads(m_threadCount)
+	{
+		const int thread = omp_get_thread_num();
+		const int threadCount = omp_get_num_threads();
+
+		Sort_Probes(thread, threadCount);
+#pragma omp barrier
+		Sample_Probes(surface, thread, threadCount);
+#pragma omp barrier
+		Integrate_Bodies(timeStep, thread, threadCount);
+	}
+}
+
+void BuoyancySolver::Sort_Probes(const int& thread, const int& threadCount)
+{
+	const uint32_t tileCount = m_tilesAcross * m_tilesAcross;
+	const int32_t tileMask = (int32_t)m_tilesAcross - 1;
+	uint32_t* start = m_tileStart.data() + (size_t)thread * tileCount;
+
+	uint32_t begin, end;
+	Band_Range(thread, threadCount, getProbeCount(), 1, begin, end);
+
+	// Count the probes of this band on every tile
+	for (uint32_t p(begin); p < end; ++p)
+	{
+		const uint32_t body = m_probeBody[p];
+		const float x = m_positionX[body] + m_offsetX[p];
+		const float z = m_positionZ[body] + m_offsetZ[p];
+
+		if (!m_sortProbes)
+		{
+			m_order[p] = p;
+			m_sortedX[p] = x;
+			m_sortedZ[p] = z;
+			continue;
+		}
+
+		// Negative tiles wrap as well, in two's complement
+		const int32_t tu = (int32_t)floor(x * m_tilesPerMetre) & tileMask;
+		const int32_t tv = (int32_t)floor(z * m_tilesPerMetre) & tileMask;
+		m_tile[p] = tv * m_tilesAcross + tu;
+		++start[m_tile[p]];
+	}
+
+	if (!m_sortProbes)
+		return;
+
+#pragma omp barrier
+#pragma omp single
+	{
+		// Every tile's probes in the order of the threads, so the sort is stable
+		uint32_t next = 0;
+		for (uint32_t tile(0); tile < tileCount; ++tile)
+		{
+			for (int t(0); t < threadCount; ++t)
+			{
+				const uint32_t count = m_tileStart[(size_t)t * tileCount + tile];
+				m_tileStart[(size_t)t * tileCount + tile] = next;
+				next += count;
+			}
+		}
+	}
+
+	for (uint32_t p(begin); p < end; ++p)
+	{
+		const uint32_t body = m_probeBody[p];
+		const uint32_t s = start[m_tile[p]]++;
+
+		m_order[s] = p;
+		m_sortedX[s] = m_positionX[body] + m_offsetX[p];
+		m_sortedZ[s] = m_positionZ[body] + m_offsetZ[p];
+	}
+}
+
+void BuoyancySolver::Sample_Probes(OceanSurface& surface, const int& thread, const int& threadCount)
+{
+	uint32_t begin, end;
+	Band_Range(thread, threadCount, getProbeCount(), kQueryAlign, begin, end);
+	if (begin == end)
+		return;
+
+	SurfaceBatch out;
+	out.height = m_waterHeight.data() + begin;
+	out.velocityX = m_waterVelocityX.data() + begin;
+	out.velocityY = m_waterVelocityY.data() + begin;
+	out.velocityZ = m_waterVelocityZ.data() + begin;
+	surface.Query_Batch(m_sortedX.data() + begin, m_sortedZ.data() + begin, end - begin, out);
+
+	for (uint32_t s(begin); s < end; ++s)
+	{
+		const uint32_t p = m_order[s];
+		const uint32_t body = m_probeBody[p];
+		const float radius = m_radius[p];
+
+		// Depth of the sphere's bottom under the water, up to its diameter, and
+		// the volume of the spherical cap below the surface
+		const float bottom = m_positionY[body] + m_offsetY[p] - radius;
+		const float depth = std::min(std::max(m_waterHeight[s] - bottom, 0.0f), 2 * radius);
+		const float volume = kfPi * depth * depth * (3 * radius - depth) / 3;
+
+		// Drag towards the water's velocity, by how deep the probe is
+		const float drag = (radius > 0) ? m_drag[p] * depth / (2 * radius) : 0.0f;
+
+		m_forceX[p] = drag * (m_waterVelocityX[s] - m_velocityX[body]);
+		m_forceY[p] = drag * (m_waterVelocityY[s] - m_velocityY[body]) + kfWaterDensity * kfGravity * volume;
+		m_forceZ[p] = drag * (m_waterVelocityZ[s] - m_velocityZ[body]);
+	}
+}
+
+void BuoyancySolver::Integrate_Bodies(const float& timeStep, const int& thread, const int& threadCount)
+{
+	uint32_t begin, end;
+	Band_Range(thread, threadCount, getBodyCount(), 1, begin, end);
+
+	for (uint32_t b(begin); b < end; ++b)
+	{
+		float forceX = 0, forceY = 0, forceZ = 0;
+
+		const uint32_t last = m_firstProbe[b] + m_probeCount[b];
+		for (uint32_t p(m_firstProbe[b]); p < last; ++p)
+		{
+			forceX += m_forceX[p];
+			forceY += m_forceY[p];
+			forceZ += m_forceZ[p];
+		}
+
+		// Semi-implicit Euler, the new velocity moves the body
+		const float oneOverMass = 1.0f / m_mass[b];
+		m_velocityX[b] += forceX * oneOverMass * timeStep;
+		m_velocityY[b] += (forceY * oneOverMass - kfGravity) * timeStep;
+		m_velocityZ[b] += forceZ * oneOverMass * timeStep;
+
+		m_positionX[b] += m_velocityX[b] * timeStep;
+		m_positionY[b] += m_velocityY[b] * timeStep;
+		m_positionZ[b] += m_velocityZ[b] * timeStep;
+	}
+}
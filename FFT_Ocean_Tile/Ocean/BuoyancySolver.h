@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "OceanSurface.h"
+
+// A sphere fixed to a body, which the water pushes up and drags along
+struct BuoyancyProbe
+{
+	float offset[3];		// m, from the body's position
+	float radius;			// m
+	float drag;				// kg/s, when the probe is under water
+};
+
+//================================================================================
+// Floats many rigid bodies on an OceanSurface. Bodies are kept as arrays of
+// every component, and hold their probes as one run of the probe arrays.
+// Bodies only translate, so their probes keep their offsets.
+//
+// Every Step moves all the probes to their bodies, sorts them by the tile of
+// the heightmap they fall on, samples the surface for the whole sorted batch
+// at once, and integrates every body over its probes. The counting sort is
+// linear, and keeps the gathers of neighbouring queries on the same cache
+// lines. Every stage splits its arrays into one band per thread, so the
+// solver scales with the OpenMP threads it is given.
+//================================================================================
+class BuoyancySolver
+{
+public:
+	// Texels along the side of a tile the probes are sorted by
+	static const uint32_t kTileTexels = 16;
+
+	// threads 0 uses all of them
+	explicit BuoyancySolver(const int& threads);
+
+	BuoyancySolver(BuoyancySolver const&) = delete; // Don't Implement
+	void operator=(BuoyancySolver const&) = delete;   // Don't Implement
+
+	// Returns the index of the new body, at rest at position
+	uint32_t Add_Body(const float position[3], const float& mass, const BuoyancyProbe* probes, const uint32_t& probeCount);
+	void Clear();
+
+	// Advances every body by timeStep seconds on the surface's latest frame
+	void Step(OceanSurface& surface, const float& timeStep);
+
+	void getPosition(const uint32_t& body, float position[3]);
+	void getVelocity(const uint32_t& body, float velocity[3]);
+
+	// 0 uses all of them
+	void setThreadCount(const int& threads);
+	inline int getThreadCount() { return m_threadCount; }
+
+	// Unsorted probes are sampled in the order of their bodies
+	inline void setSortProbes(const bool& sort) { m_sortProbes = sort; }
+	inline bool isSortingProbes() { return m_sortProbes; }
+
+	inline uint32_t getBodyCount() { return (uint32_t)m_mass.size(); }
+	inline uint32_t getProbeCount() { return (uint32_t)m_probeBody.size(); }
+
+private:
+	void Sort_Probes(const int& thread, const int& threadCount);
+	void Sample_Probes(OceanSurface& surface, const int& thread, const int& threadCount);
+	void Integrate_Bodies(const float& timeStep, const int& thread, const int& threadCount);
+
+	const float kfGravity = 9.81f;
+	const float kfWaterDensity = 1025;		// kg/m^3, sea water
+	const float kfPi = 3.1415926f;
+
+	int m_threadCount;
+	bool m_sortProbes = true;
+
+	// Bodies
+	std::vector<float> m_positionX, m_positionY, m_positionZ;
+	std::vector<float> m_velocityX, m_velocityY, m_velocityZ;
+	std::vector<float> m_mass;
+	std::vector<uint32_t> m_firstProbe, m_probeCount;
+
+	// Probes, in the order of their bodies
+	std::vector<float> m_offsetX, m_offsetY, m_offsetZ;
+	std::vector<float> m_radius, m_drag;
+	std::vector<uint32_t> m_probeBody;
+	std::vector<uint32_t> m_tile;					// Tile of every probe this step
+	std::vector<float> m_forceX, m_forceY, m_forceZ;
+
+	// Probes in tile order: the probe, where it is and the water there
+	std::vector<uint32_t> m_order;
+	std::vector<float> m_sortedX, m_sortedZ;
+	std::vector<float> m_waterHeight, m_waterVelocityX, m_waterVelocityY, m_waterVelocityZ;
+
+	// Probes per tile counted by every thread, then where each thread's first one goes
+	std::vector<uint32_t> m_tileStart;
+	uint32_t m_tilesAcross = 1;
+	float m_tilesPerMetre = 0;
+};
@@ -1,18 +1,114 @@
 #pragma once
 
 //================================================================================
-// #Defines to test different execution configurations.
+// Default execution configuration. The grid size, execution configuration,
+// planner policy, cascades, threads and timescale are only defaults, which
+// Ocean.cfg and the command line override at start-up (see SimulationPipeline.h).
 // Proposed configuration:
 //
 // #define SIZE_OF_GRID 512
-// #define GPGPU_NORM_CD
+// #define OCEAN_PIPELINE kPipelineGpgpuNormCD
 //================================================================================
 
-// Size of grid.
+// Default size of grid.
 #define SIZE_OF_GRID 512		// Grid size 512
 //#define SIZE_OF_GRID 256		// Grid size 256
 
-// Execution Configurations. Choose only one at a time.
-#define GPGPU_NORM_CD			// Usage of GPGPU, Normals calculated with central difference.
-//#define CPU_NORM_FFT			// No usage of GPGPU, Normals calculated with additional FFTs.
-//#define CPU_NORM_CD			// No usage of GPGPU, Normals calculated with central difference.
\ No newline at end of file
+// Default execution configuration:
+// kPipelineGpgpuNormCD		Usage of GPGPU, Normals calculated with central difference.
+// kPipelineCpuNormFFT		No usage of GPGPU, Normals calculated with additional FFTs.
+// kPipelineCpuNormCD		No usage of GPGPU, Normals calculated with central difference.
+#define OCEAN_PIPELINE kPipelineGpgpuNormCD
+
+// Default simulated time per frame, in every execution configuration.
+#define OCEAN_TIMESCALE 0.04f
+
+// FFT Configurations. Choose at most one at a time.
+//#define FFT_C2R				// Hermitian spectrum, complex-to-real IFFTs on the half spectrum.
+//#define FFT_PACKED_DISP		// Hermitian spectrum, X and Z displacements packed into one complex IFFT.
+
+// Batched IFFTs. Can be combined with the FFT Configurations above.
+//#define FFT_BATCHED			// All fields in one allocation, transformed by one fftwf_plan_many_dft.
+
+// Default FFT backend, also a start-up setting:
+// kBackendFFTW			Prebuilt FFTW.
+// kBackendStockham		In-tree SIMD Stockham FFT, power-of-two grids only.
+// Grids the chosen backend can't transform fall back to another one.
+#define FFT_BACKEND kBackendFFTW
+
+// Builds the FFTW backend, which links the prebuilt x86 FFTW. Without it
+// every IFFT runs on the in-tree backend and nothing else has to be linked.
+#define FFT_BACKEND_FFTW
+
+// FFTW planning policy: kPlanEstimate, kPlanMeasure, kPlanPatient or kPlanExhaustive.
+// Anything above kPlanEstimate is opt-in: it is measured on the first launch and cached as wisdom.
+#define FFT_PLANNER_POLICY kPlanEstimate
+
+// Number of spectrum cascades, 1 to 4. Every cascade covers a 4 times smaller
+// patch than the previous one, and all of them share the same IFFTs. The
+// renderer keeps every cascade in a slice of its textures and sums them.
+// The GPGPU configuration only simulates a single cascade.
+#define OCEAN_CASCADES 1
+
+// Threads for the per-frame CPU passes and FFTW. 0 uses every hardware thread.
+#define CPU_THREADS 0
+
+// Default for running the CPU configurations on a worker thread, one frame
+// ahead of the renderer, also a start-up setting. The GPGPU configuration
+// always runs on the render thread.
+#define OCEAN_ASYNC false
+
+// Default upload format of the CPU textures, also a start-up setting:
+// kTextureRGBA32F		Float heightmap and normal map, 32 bytes per texel.
+// kTextureRGBA16F		Half heightmap and normal map, 16 bytes per texel.
+// kTexturePacked		16 bit heightmap with a per-frame range, 16 bit XZ normals
+//						and an 8 bit foam mask, 13 bytes per texel.
+#define OCEAN_TEXTURES kTextureRGBA32F
+
+// Seed of the initial spectrum, also a start-up setting. Every bin draws its
+// random numbers from the seed and its own index, so a seed gives the same
+// ocean on any machine and thread count. 0 picks a new seed every launch.
+#define OCEAN_SEED 0
+
+// Cache the initial spectrum of a fixed seed in a file in the working directory,
+// which later launches map instead of building the spectrum again. Also a
+// start-up setting.
+#define OCEAN_SPECTRUM_CACHE true
+
+// Default wave spectrum, also a start-up setting along with the wind speed,
+// fetch and depth: kSpectrumPhillips, kSpectrumPiersonMoskowitz,
+// kSpectrumJONSWAP or kSpectrumTMA.
+#define OCEAN_SPECTRUM kSpectrumPhillips
+
+// Default directional spreading: kSpreadingCos2, kSpreadingCos2s or kSpreadingNone.
+#define OCEAN_SPREADING kSpreadingCos2
+
+// Frames the CPU configurations take to fade to a sea state changed at
+// runtime, once its spectrum has been rebuilt. The GPGPU configuration
+// swaps to the new spectrum at once.
+#define SEA_STATE_FADE_FRAMES 90
+
+// Energy pruning of the CPU configurations, also a start-up setting. Columns
+// of the spectrum that together carry no more than this fraction of a cascade's
+// variance are dropped from the per-frame work. 0 only drops the columns
+// without any waves, which changes nothing on screen, and a negative value
+// keeps every column.
+#define OCEAN_PRUNE_ENERGY 0.0f
+
+// Baked sequence the CPU configurations play back instead of simulating, also
+// a start-up setting. "" simulates every frame.
+#define OCEAN_SEQUENCE ""
+
+// Seconds of ocean baked into the sequence at start-up before it is played
+// back, also a start-up setting. The waves are made to repeat over this
+// period. 0 plays back the sequence that is there.
+#define OCEAN_BAKE_PERIOD 0.0f
+
+// Modes that need the spectrum to be Hermitian, i.e. htilde(-k) = conj(htilde(k)).
+#if defined(FFT_C2R) | defined(FFT_PACKED_DISP)
+#define HERMITIAN_SPECTRUM
+#endif // FFT_C2R | FFT_PACKED_DISP
+
+#if defined(FFT_C2R) && defined(FFT_PACKED_DISP)
+#error "FFT_C2R and FFT_PACKED_DISP are different FFT Configurations, choose at most one."
+#endif // FFT_C2R && FFT_PACKED_DISP
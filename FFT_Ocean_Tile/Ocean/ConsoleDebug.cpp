@@ -0,0 +1,15 @@
+#include <cstdarg>
+#include <cstdio>
+
+//================================================================================
+// Console stand-in for the Framework's debug output, used by the simulation.
+// Linked by the console tools, which have no Framework, instead of by the
+// application.
+//================================================================================
+void debugF(const char * format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
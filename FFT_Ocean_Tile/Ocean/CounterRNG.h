@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+//================================================================================
+// Counter-based random numbers, Philox4x32-10 (Salmon et al., "Parallel Random
+// Numbers: As Easy as 1, 2, 3"). Every value is a pure function of a key and
+// a counter, so any element of a stream can be generated on its own, in any
+// order and on any thread, with the same result.
+//================================================================================
+namespace CounterRNG
+{
+	const uint32_t kPhiloxM0 = 0xD2511F53;
+	const uint32_t kPhiloxM1 = 0xCD9E8D57;
+	const uint32_t kPhiloxW0 = 0x9E3779B9;		// Golden ratio
+	const uint32_t kPhiloxW1 = 0xBB67AE85;		// sqrt(3) - 1
+	const int kPhiloxRounds = 10;
+
+	inline uint32_t MulHiLo(const uint32_t& a, const uint32_t& b, uint32_t& hi)
+	{
+		const uint64_t product = (uint64_t)a * b;
+		hi = (uint32_t)(product >> 32);
+		return (uint32_t)product;
+	}
+
+	// Four random words of counter ctr under key
+	inline void Philox4x32(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4])
+	{
+		uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+		uint32_t k0 = key[0], k1 = key[1];
+		uint32_t hi0, hi1;
+
+		for (int r(0); r < kPhiloxRounds; ++r)
+		{
+			const uint32_t lo0 = MulHiLo(kPhiloxM0, c0, hi0);
+			const uint32_t lo1 = MulHiLo(kPhiloxM1, c2, hi1);
+
+			c0 = hi1 ^ c1 ^ k0;
+			c1 = lo1;
+			c2 = hi0 ^ c3 ^ k1;
+			c3 = lo0;
+
+			k0 += kPhiloxW0;
+			k1 += kPhiloxW1;
+		}
+
+		out[0] = c0;
+		out[1] = c1;
+		out[2] = c2;
+		out[3] = c3;
+	}
+
+	// Uniform in (0, 1], never 0 so it can go through a log
+	inline float UnitInterval(const uint32_t& word)
+	{
+		return ((word >> 8) + 1) * (1.0f / 16777216.0f);
+	}
+
+	// Four standard normal samples, element index of stream, under seed.
+	// Box-Muller on the two pairs of uniforms.
+	inline void Gaussian4(const uint32_t& seed, const uint32_t& stream, const uint32_t& index, float out[4])
+	{
+		const float kfTwoPi = 6.283185307f;
+		const uint32_t key[2] = { seed, 0x4F434541 };	// "OCEA"
+		const uint32_t ctr[4] = { index, stream, 0, 0 };
+		uint32_t words[4];
+
+		Philox4x32(ctr, key, words);
+
+		for (int p(0); p < 2; ++p)
+		{
+			const float radius = sqrtf(-2.0f * logf(UnitInterval(words[2 * p])));
+			const float angle = kfTwoPi * UnitInterval(words[2 * p + 1]);
+
+			out[2 * p + 0] = radius * cosf(angle);
+			out[2 * p + 1] = radius * sinf(angle);
+		}
+	}
+}
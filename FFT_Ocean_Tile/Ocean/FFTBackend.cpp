@@ -0,0 +1,47 @@
+#include "FFTBackend.h"
+#include "StockhamBackend.h"
+
+namespace
+{
+	const char* kBackendNames[kMaxBackends] = { "fftw", "stockham" };
+}
+
+FFTBackend* GetFFTBackend(const FFTBackendKind& kind)
+{
+	switch (kind)
+	{
+#ifdef FFT_BACKEND_FFTW
+	case kBackendFFTW:
+		return GetFFTWBackend();
+#endif // FFT_BACKEND_FFTW
+	case kBackendStockham:
+	{
+		static StockhamBackend stockham;
+		return &stockham;
+	}
+	default:
+		return nullptr;
+	}
+}
+
+FFTBackend* SelectFFTBackend(const FFTBackendKind& preferred, const FFTBatch& batch)
+{
+	FFTBackend* backend = GetFFTBackend(preferred);
+	if (backend && backend->Supports(batch))
+		return backend;
+
+	for (int b(0); b < kMaxBackends; ++b)
+	{
+		FFTBackend* fallback = GetFFTBackend((FFTBackendKind)b);
+		if (fallback && fallback->Supports(batch))
+			return fallback;
+	}
+
+	// Nothing built in handles this batch, its plans will be null
+	return backend ? backend : GetFFTBackend(kBackendStockham);
+}
+
+const char* FFTBackendName(const FFTBackendKind& kind)
+{
+	return (kind >= 0 && kind < kMaxBackends) ? kBackendNames[kind] : "unknown";
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "Configurations.h"
+
+// Only for fftwf_complex. The FFTW library itself is only linked by the FFTW backend.
+#include "fftw3.h"
+
+// FFTW planning rigour, from quickest to plan to quickest to execute
+enum PlannerPolicy
+{
+	kPlanEstimate,
+	kPlanMeasure,
+	kPlanPatient,
+	kPlanExhaustive
+};
+
+enum FFTBackendKind
+{
+	kBackendFFTW,		// Prebuilt FFTW, built with FFT_BACKEND_FFTW
+	kBackendStockham,	// In-tree SIMD Stockham FFT, power-of-two grids only
+	kMaxBackends
+};
+
+// howmany unnormalised backward 2D transforms of size x size, one after the
+// other. Complex-to-real transforms read size * (size / 2 + 1) bins and write
+// size * size floats each, complex ones size * size complex values.
+struct FFTBatch
+{
+	uint32_t size;
+	uint32_t howmany;
+	bool realOutput;
+};
+
+//================================================================================
+// A planned batch. Plans may be shared by several FFTWrapper instances, so
+// they only hold the layout and run on whichever arrays they are given.
+//================================================================================
+class FFTPlan
+{
+public:
+	virtual ~FFTPlan() {}
+
+	// The arrays have to be laid out and aligned like the planned ones.
+	// Complex-to-real transforms may overwrite their input.
+	virtual void Execute(fftwf_complex* in, void* out) = 0;
+
+	// Execute for inputs that only hold zeros in some columns, with one flag
+	// per column of every transform, 1 for the zero ones. Backends that can
+	// skip them in their first pass leave them holding zeros, the others run
+	// the whole transform.
+	virtual void Execute_Sparse(fftwf_complex* in, void* out, const uint8_t* /*zeroColumns*/) { Execute(in, out); }
+	virtual bool Skips_Zero_Columns() { return false; }
+
+	// Arithmetic of one Execute, in flops
+	virtual double Flops() = 0;
+};
+
+//================================================================================
+// Everything FFTWrapper needs from an FFT library: buffers, plans and their
+// execution.
+//================================================================================
+class FFTBackend
+{
+public:
+	virtual ~FFTBackend() {}
+
+	virtual FFTBackendKind Kind() = 0;
+	virtual bool Supports(const FFTBatch& batch) = 0;
+
+	// Buffers aligned for the backend's vector loads
+	virtual void* Allocate(const size_t& bytes) = 0;
+	virtual void Free(void* buffer) = 0;
+
+	// Planning may overwrite in and out. Returns nullptr for unsupported batches.
+	virtual std::shared_ptr<FFTPlan> Create_Plan(const FFTBatch& batch, fftwf_complex* in, void* out,
+		const int& threads, const PlannerPolicy& policy) = 0;
+};
+
+// nullptr for backends left out of this build
+FFTBackend* GetFFTBackend(const FFTBackendKind& kind);
+
+// The preferred backend if it is built and supports the batch, otherwise
+// the first one that does
+FFTBackend* SelectFFTBackend(const FFTBackendKind& preferred, const FFTBatch& batch);
+
+const char* FFTBackendName(const FFTBackendKind& kind);
+
+#ifdef FFT_BACKEND_FFTW
+// Defined in FFTWBackend.cpp
+FFTBackend* GetFFTWBackend();
+#endif // FFT_BACKEND_FFTW
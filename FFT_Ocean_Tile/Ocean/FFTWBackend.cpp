@@ -0,0 +1,186 @@
+#include "FFTBackend.h"
+
+#ifdef FFT_BACKEND_FFTW
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#ifdef _MSC_VER
+#include <intrin.h>			// For the CPU brand string
+#else
+#include <cpuid.h>
+#endif // _MSC_VER
+
+#pragma comment(lib, "libfftw3f-3.lib")
+
+// Console and debug output, from the Framework in the application
+void debugF(const char * format, ...);
+
+//--------------------------------------------------------------------------------------
+// FFTW plans shared between FFTWrapper instances. Every batch with the same
+// layout, planner policy and FFTW thread count executes the same plan on its
+// own arrays, for as long as any of them holds it.
+//--------------------------------------------------------------------------------------
+namespace
+{
+	const unsigned int kWisdomCacheVersion = 1;
+
+	typedef std::tuple<uint32_t, uint32_t, bool, int, int> PlanKey;
+	std::map<PlanKey, std::weak_ptr<FFTPlan>> g_planCache;
+
+	// The FFTW planner and wisdom functions are not thread safe
+	std::mutex g_plannerMutex;
+	bool g_fftwThreadsInitialised = false;
+
+	unsigned int Planner_Flags(const PlannerPolicy& policy)
+	{
+		switch (policy)
+		{
+		case kPlanMeasure:		return FFTW_MEASURE;
+		case kPlanPatient:		return FFTW_PATIENT;
+		case kPlanExhaustive:	return FFTW_EXHAUSTIVE;
+		default:				return FFTW_ESTIMATE;
+		}
+	}
+
+	std::string Wisdom_Cache_Path(const uint32_t& size, const int& threads)
+	{
+		// Wisdom is only valid for the machine and thread count it was measured with,
+		// so the cache is keyed by cache version, grid size, threads and CPU model.
+		int cpuInfo[4] = { 0 };
+		char brand[49] = { 0 };
+
+		for (unsigned int leaf(0); leaf < 3; ++leaf)
+		{
+#ifdef _MSC_VER
+			__cpuid(cpuInfo, 0x80000002 + leaf);
+#else
+			__get_cpuid(0x80000002 + leaf, (unsigned int*)&cpuInfo[0], (unsigned int*)&cpuInfo[1],
+				(unsigned int*)&cpuInfo[2], (unsigned int*)&cpuInfo[3]);
+#endif // _MSC_VER
+			memcpy(brand + 16 * leaf, cpuInfo, sizeof(cpuInfo));
+		}
+
+		// Keep the CPU model file name friendly
+		std::string cpu;
+		for (const char* c = brand; *c != '\0'; ++c)
+		{
+			if (isalnum((unsigned char)*c))
+				cpu += *c;
+			else if (!cpu.empty() && cpu.back() != '_')
+				cpu += '_';
+		}
+		while (!cpu.empty() && cpu.back() == '_')
+			cpu.pop_back();
+
+		return "fftwf_wisdom_v" + std::to_string(kWisdomCacheVersion)
+			+ "_" + std::to_string(size)
+			+ "_t" + std::to_string(threads)
+			+ "_" + (cpu.empty() ? std::string("unknown") : cpu) + ".wis";
+	}
+
+	class FFTWPlan : public FFTPlan
+	{
+	public:
+		FFTWPlan(const fftwf_plan& plan, const bool& realOutput) :m_plan(plan), m_realOutput(realOutput) {}
+
+		~FFTWPlan()
+		{
+			std::lock_guard<std::mutex> lock(g_plannerMutex);
+			fftwf_destroy_plan(m_plan);
+		}
+
+		void Execute(fftwf_complex* in, void* out) override
+		{
+			if (m_realOutput)
+				fftwf_execute_dft_c2r(m_plan, in, (float*)out);
+			else
+				fftwf_execute_dft(m_plan, in, (fftwf_complex*)out);
+		}
+
+		double Flops() override
+		{
+			double add, mul, fma;
+			fftwf_flops(m_plan, &add, &mul, &fma);
+			return add + mul + 2 * fma;
+		}
+
+	private:
+		const fftwf_plan m_plan;
+		const bool m_realOutput;
+	};
+
+	class FFTWBackend : public FFTBackend
+	{
+	public:
+		FFTBackendKind Kind() override { return kBackendFFTW; }
+		bool Supports(const FFTBatch&) override { return true; }
+
+		void* Allocate(const size_t& bytes) override { return fftwf_malloc(bytes); }
+		void Free(void* buffer) override { fftwf_free(buffer); }
+
+		std::shared_ptr<FFTPlan> Create_Plan(const FFTBatch& batch, fftwf_complex* in, void* out,
+			const int& threads, const PlannerPolicy& policy) override
+		{
+			std::lock_guard<std::mutex> lock(g_plannerMutex);
+
+			std::weak_ptr<FFTPlan>& cached = g_planCache[PlanKey(batch.size, batch.howmany, batch.realOutput, threads, policy)];
+			std::shared_ptr<FFTPlan> plan = cached.lock();
+			if (plan)
+				return plan;	// Another instance already paid for the planning
+
+			// FFTW parallelism
+			if (!g_fftwThreadsInitialised)
+			{
+				fftwf_init_threads();
+				g_fftwThreadsInitialised = true;
+			}
+			fftwf_plan_with_nthreads(threads);
+
+			// Measured plans are only paid for once per machine
+			const std::string wisdomPath = Wisdom_Cache_Path(batch.size, threads);
+			if (policy != kPlanEstimate && !fftwf_import_wisdom_from_filename(wisdomPath.c_str()))
+				debugF("FFTWBackend: no wisdom cache found, measuring plans.\n");
+
+			const int n = (int)batch.size;
+			const int dims[2] = { n, n };
+			const int specSize = n * (batch.realOutput ? n / 2 + 1 : n);
+			const unsigned int flags = Planner_Flags(policy);
+
+			fftwf_plan fftwPlan;
+			if (batch.realOutput)
+			{
+				fftwPlan = fftwf_plan_many_dft_c2r(2, dims, batch.howmany,
+					in, nullptr, 1, specSize,
+					(float*)out, nullptr, 1, n * n, flags);
+			}
+			else
+			{
+				fftwPlan = fftwf_plan_many_dft(2, dims, batch.howmany,
+					in, nullptr, 1, specSize,
+					(fftwf_complex*)out, nullptr, 1, n * n, FFTW_BACKWARD, flags);
+			}
+
+			if (policy != kPlanEstimate && !fftwf_export_wisdom_to_filename(wisdomPath.c_str()))
+				debugF("FFTWBackend: could not write the wisdom cache.\n");
+
+			if (!fftwPlan)
+				return nullptr;
+
+			plan = std::make_shared<FFTWPlan>(fftwPlan, batch.realOutput);
+			cached = plan;
+			return plan;
+		}
+	};
+}
+
+FFTBackend* GetFFTWBackend()
+{
+	static FFTWBackend fftw;
+	return &fftw;
+}
+
+#endif // FFT_BACKEND_FFTW
@@ -1,316 +1,1205 @@
 #include "FFTWrapper.h"
 #include "Framework.h"
-#include <random>			// For Gaussian Samples
+#include <random>			// For std::random_device
+#include "CounterRNG.h"		// For Gaussian Samples
 #include <fstream>			// For File Output
-
-FFTWrapper::FFTWrapper(const int& gridsize)
-	:m_height(gridsize), m_width(gridsize)
+#include <algorithm>
+#include <cstring>
+
+FFTWrapper::FFTWrapper(const int& gridsize, const PlannerPolicy& policy, const int& threads, const int& cascades,
+	const NormalsSource& normals, const FFTBackendKind& backend)
+#ifdef FFT_C2R
+	:m_width(gridsize), m_height(gridsize), m_specWidth(gridsize / 2 + 1), m_realOutput(true),
+#else
+	:m_width(gridsize), m_height(gridsize), m_specWidth(gridsize), m_realOutput(false),
+#endif // FFT_C2R
+	m_cascadeCount(std::min(std::max(cascades, 1), (int)kMaxCascades)), m_normals(normals), m_plannerPolicy(policy)
 {
-	m_kVectors = new Vec2[m_width * m_height];
-	m_kMag = new float[m_width * m_height];
+	// Every cascade covers kfCascadeScale times less ground than the previous one
+	m_patchSize[0] = kfWorldUnit;
+	for (uint32_t c(1); c < kMaxCascades; ++c)
+		m_patchSize[c] = m_patchSize[c - 1] / kfCascadeScale;
+
+	AllocateSpectrum(m_spectrum, m_specWidth * m_height * m_cascadeCount);
+	m_simdLevel = DetectSimdLevel();
+	setThreadCount(threads);
 
-	m_h0tilde = new Vec2[m_width * m_height];
-	m_h0tildeConj = new Vec2[m_width * m_height];
+	// Texture array layout, one slice per cascade
+	Allocate_Texture_Set(m_textures);
 
-	m_cosLookup = new int[m_width * m_height];
-	m_sinLookup = new int[m_width * m_height];
-	m_cosPrecalc = new std::vector<float>[m_width * m_height];
-	m_sinPrecalc = new std::vector<float>[m_width * m_height];
+	// The first packed frame sets the displacement ranges
+	for (uint32_t c(0); c < kMaxCascades; ++c)
+	{
+		for (int ch(0); ch < 3; ++ch)
+		{
+			m_dispNext[c][ch] = 0;
+			m_dispPeak[c][ch] = 0;
+		}
+	}
 
-	pImageOut = new float[m_width * m_height * 4];
-	pNormalOut = new float[m_width * m_height * 4];
+#ifdef FFT_BATCHED
+	// The slopes for the normals are transformed in the same batch as the other fields
+	m_batchedSlopes = (m_normals == kNormalsFFT);
+	m_saveHtilde = false;
+#else
+	// c2r IFFTs overwrite htilde, which the separate normals FFTs still need
+	m_batchedSlopes = false;
+#ifdef FFT_C2R
+	m_saveHtilde = (m_normals == kNormalsFFT);
+#else
+	m_saveHtilde = false;
+#endif // FFT_C2R
+#endif // FFT_BATCHED
+
+	// Fields transformed every frame, in memory order. The slopes for the
+	// normals only get their own fields when they are batched.
+	m_fieldCount = 0;
+	m_fields[m_fieldCount++] = kFieldHeight;
+	m_fields[m_fieldCount++] = kFieldDispX;
+#ifndef FFT_PACKED_DISP
+	m_fields[m_fieldCount++] = kFieldDispZ;
+#endif // FFT_PACKED_DISP
+	if (m_batchedSlopes)
+	{
+		m_fields[m_fieldCount++] = kFieldSlopeX;
+#ifndef FFT_PACKED_DISP
+		m_fields[m_fieldCount++] = kFieldSlopeZ;
+#endif // FFT_PACKED_DISP
+	}
 
-	m_FFTin[0] = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * m_width * m_height);
-	m_FFTin[1] = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * m_width * m_height);
-	m_FFTin[2] = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * m_width * m_height);
-	m_FFTout[0] = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * m_width * m_height);
-	m_FFTout[1] = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * m_width * m_height);
-	m_FFTout[2] = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * m_width * m_height);
+	for (int f(0); f < kMaxFields; ++f)
+	{
+		m_FFTin[f] = nullptr;
+		m_FFTout[f] = nullptr;
+		m_FFTreal[f] = nullptr;
+	}
 
-	// FFTW parallelism
-	fftwf_init_threads();
-	fftwf_plan_with_nthreads(omp_get_max_threads());
+	// Buffers and plans come from the configured backend, or from one
+	// that handles this grid size
+	m_backend = SelectFFTBackend(backend, { m_width, m_cascadeCount, m_realOutput });
+
+	// Every field holds one transform per cascade
+	const uint32_t specSize = m_specWidth * m_height * m_cascadeCount;
+	const uint32_t gridSize = m_width * m_height * m_cascadeCount;
+
+	// Only the non-redundant half of a Hermitian spectrum is stored in c2r mode
+	m_FFTin[kFieldHeight] = (fftwf_complex*)m_backend->Allocate(sizeof(fftwf_complex) * specSize * m_fieldCount);
+
+#ifdef FFT_C2R
+	// Complex-to-real IFFTs write straight into real arrays
+	m_FFTreal[kFieldHeight] = (float*)m_backend->Allocate(sizeof(float) * gridSize * m_fieldCount);
+	m_outStride = 1;
+	m_gridKernels = SelectGridKernels<1>(m_width);
+#else
+	// Only the real part of the complex outputs is used
+	m_FFTout[kFieldHeight] = (fftwf_complex*)m_backend->Allocate(sizeof(fftwf_complex) * gridSize * m_fieldCount);
+	m_outStride = 2;
+	m_gridKernels = SelectGridKernels<2>(m_width);
+#endif // FFT_C2R
+
+	for (uint32_t f(0); f < m_fieldCount; ++f)
+	{
+		m_FFTin[m_fields[f]] = m_FFTin[kFieldHeight] + f * specSize;
+#ifdef FFT_C2R
+		m_FFTreal[m_fields[f]] = m_FFTreal[kFieldHeight] + f * gridSize;
+#else
+		m_FFTout[m_fields[f]] = m_FFTout[kFieldHeight] + f * gridSize;
+		m_FFTreal[m_fields[f]] = &m_FFTout[m_fields[f]][0][0];
+#endif // FFT_C2R
+	}
 
-	m_plan[0] = fftwf_plan_dft_2d(m_width, m_height, m_FFTin[0], m_FFTout[0], FFTW_BACKWARD, FFTW_ESTIMATE);
-	m_plan[1] = fftwf_plan_dft_2d(m_width, m_height, m_FFTin[1], m_FFTout[1], FFTW_BACKWARD, FFTW_ESTIMATE);
-	m_plan[2] = fftwf_plan_dft_2d(m_width, m_height, m_FFTin[2], m_FFTout[2], FFTW_BACKWARD, FFTW_ESTIMATE);
+#ifdef FFT_PACKED_DISP
+	// Z comes out as the imaginary part of the packed X field
+	m_FFTreal[kFieldDispZ] = m_FFTreal[kFieldDispX] + 1;
+	if (m_batchedSlopes)
+		m_FFTreal[kFieldSlopeZ] = m_FFTreal[kFieldSlopeX] + 1;
+#endif // FFT_PACKED_DISP
 
+	if (!m_batchedSlopes)
+	{
+		// The normals FFTs reuse the displacement fields
+		m_FFTin[kFieldSlopeX] = m_FFTin[kFieldDispX];
+		m_FFTin[kFieldSlopeZ] = m_FFTin[kFieldDispZ];
+		m_FFTreal[kFieldSlopeX] = m_FFTreal[kFieldDispX];
+		m_FFTreal[kFieldSlopeZ] = m_FFTreal[kFieldDispZ];
+	}
+
+	m_outputs = { m_FFTreal[kFieldHeight], m_FFTreal[kFieldDispX], m_FFTreal[kFieldDispZ],
+		m_FFTreal[kFieldSlopeX], m_FFTreal[kFieldSlopeZ] };
+
+	if (m_saveHtilde)
+		m_htildeSaved = (fftwf_complex*)m_backend->Allocate(sizeof(fftwf_complex) * specSize);
+
+	// Outputs of the per-frame spectrum kernels
+	m_spectrumFields.htilde = m_FFTin[kFieldHeight];
+	m_spectrumFields.htildeCopy = m_htildeSaved;
+	m_spectrumFields.dispX = m_FFTin[kFieldDispX];
+	m_spectrumFields.dispZ = m_FFTin[kFieldDispZ];
+	m_spectrumFields.slopeX = m_batchedSlopes ? m_FFTin[kFieldSlopeX] : nullptr;
+	m_spectrumFields.slopeZ = m_batchedSlopes ? m_FFTin[kFieldSlopeZ] : nullptr;
+#ifdef FFT_PACKED_DISP
+	m_spectrumFields.packed = true;
+#else
+	m_spectrumFields.packed = false;
+#endif // FFT_PACKED_DISP
+
+	// Plans are shared with every other instance of the same size
+	Acquire_Plans();
+	Report_Plans();
 }
 
 FFTWrapper::~FFTWrapper()
 {
-	delete[] m_kVectors;
-	delete[] m_kMag;
+	Free_Spectrum_Array(m_kVectors);
+	Free_Spectrum_Array(m_kMag);
+
+	Free_Spectrum_Array(m_h0tilde);
+	Free_Spectrum_Array(m_h0tildeConj);
+	Free_Spectrum_Array(m_h0target);
+	Free_Spectrum_Array(m_h0targetConj);
+
+	FreeSpectrum(m_spectrum);
+
+	Free_Texture_Set(m_textures);
+	delete[] m_rowWindow;
+
+	Release_Plans();
+
+	// Every field lives in the allocation of the height field
+	m_backend->Free(m_FFTin[kFieldHeight]);
+#ifdef FFT_C2R
+	m_backend->Free(m_FFTreal[kFieldHeight]);
+#else
+	m_backend->Free(m_FFTout[kFieldHeight]);
+#endif // FFT_C2R
+
+	if (m_htildeSaved)
+		m_backend->Free(m_htildeSaved);
+}
+
+void FFTWrapper::Acquire_Plans()
+{
+	m_planThreads = m_threadCount;
+
+	CStopWatch planTimer;
+	planTimer.startTimer();
+
+#ifdef FFT_BATCHED
+	// A single plan transforms every field of every cascade, so
+	// the backend's threads are only forked and joined once per frame
+	const FFTBatch batch = { m_width, m_fieldCount * m_cascadeCount, m_realOutput };
+	m_plan[0] = m_backend->Create_Plan(batch, m_FFTin[kFieldHeight], IFFT_Output(kFieldHeight), m_planThreads, m_plannerPolicy);
+#else
+	// One plan per field, covering the field in every cascade
+	const FFTBatch batch = { m_width, m_cascadeCount, m_realOutput };
+	for (uint32_t f(0); f < m_fieldCount; ++f)
+	{
+		const FFTField field = m_fields[f];
+		m_plan[field] = m_backend->Create_Plan(batch, m_FFTin[field], IFFT_Output(field), m_planThreads, m_plannerPolicy);
+	}
+#endif // FFT_BATCHED
+
+	planTimer.stopTimer();
+	m_planningTime = planTimer.getElapsedTime();
+
+	if (!m_plan[kFieldHeight])
+		debugF("FFTWrapper: no FFT backend in this build handles %ux%u grids.\n", m_width, m_height);
+}
+
+void FFTWrapper::Release_Plans()
+{
+	// Shared plans are destroyed with their last user
+	for (int p(0); p < kMaxFields; ++p)
+		m_plan[p].reset();
+}
+
+void FFTWrapper::Execute_Plan(const int& p)
+{
+	// The plans may belong to another instance, so they are run on
+	// this instance's arrays. Field p's arrays start every batch.
+	m_plan[p]->Execute_Sparse(m_FFTin[p], IFFT_Output(p), m_deadBins ? m_zeroColumns.data() : nullptr);
+}
+
+void FFTWrapper::Report_Plans()
+{
+	m_planFlops = 0;
+
+	for (int p(0); p < kMaxFields; ++p)
+	{
+		if (m_plan[p])
+			m_planFlops += m_plan[p]->Flops();
+	}
+
+	debugF("FFTWrapper: %s %ux%u IFFTs planned in %.3f s, %.2f MFLOP per frame, %s spectrum kernels, %s grid kernels, %d threads.\n",
+		FFTBackendName(m_backend->Kind()), m_width, m_height, m_planningTime, m_planFlops * 1e-6, SimdLevelName(m_simdLevel),
+		m_gridKernels.specialisedSize ? "specialised" : "generic", m_threadCount);
+}
+
+void FFTWrapper::setWind(const Vec2& direction, const float& speed)
+{
+	const Vec2 windNormal = normal(direction);
+	m_seaState.windX = windNormal.x;
+	m_seaState.windZ = windNormal.y;
+	m_seaState.windSpeed = speed;
+}
+
+void FFTWrapper::setSeaState(const SeaState& state)
+{
+	m_seaState = state;
+	setWind({ state.windX, state.windZ }, state.windSpeed);
+}
+
+void FFTWrapper::setThreadCount(const int& threads)
+{
+	m_threadCount = (threads > 0) ? threads : omp_get_max_threads();
+
+	delete[] m_rowWindow;
+	m_rowWindow = new float[m_threadCount * kWindowRows * 3 * m_width];
+}
+
+void FFTWrapper::setTimeStep(const float& timeStep)
+{
+	if (timeStep == m_timeStep)
+		return;
+
+	// The waves carry on from where they are, only the step changes
+	m_timeStep = timeStep;
+	Precalculate_Steps();
+}
+
+void FFTWrapper::setTextureFormat(const TextureFormat& format)
+{
+	Free_Texture_Set(m_textures);
+	m_textureFormat = format;
+	Allocate_Texture_Set(m_textures);
+}
+
+void FFTWrapper::Allocate_Texture_Set(TextureSet& set)
+{
+	const uint32_t texels = m_width * m_height * m_cascadeCount;
+
+	set = TextureSet();
+	set.image = new float[texels * 4];
+	set.normal = new float[texels * 4];
+
+	switch (m_textureFormat)
+	{
+	case kTextureRGBA16F:
+		set.imagePacked = new uint16_t[texels * 4];
+		set.normalPacked = new uint16_t[texels * 4];
+		break;
+	case kTexturePacked:
+		set.imagePacked = new uint16_t[texels * 4];
+		set.normalPacked = new uint16_t[texels * 2];
+		set.foamPacked = new uint8_t[texels];
+		break;
+	default:
+		break;
+	}
+}
+
+void FFTWrapper::Free_Texture_Set(TextureSet& set)
+{
+	delete[] set.image;
+	delete[] set.normal;
+	delete[] set.imagePacked;
+	delete[] set.normalPacked;
+	delete[] set.foamPacked;
+
+	set = TextureSet();
+}
+
+const void* FFTWrapper::getImageTexels(const TextureSet& set, const unsigned int& cascade)
+{
+	const uint32_t slice = cascade * m_width * m_height;
 
-	delete[] m_h0tilde;
-	delete[] m_h0tildeConj;
+	if (!set.imagePacked)
+		return set.image + slice * 4;
 
-	delete[] m_cosLookup;
-	delete[] m_sinLookup;
-	delete[] m_cosPrecalc;
-	delete[] m_sinPrecalc;
+	return set.imagePacked + slice * 4;
+}
+
+const void* FFTWrapper::getNormalTexels(const TextureSet& set, const unsigned int& cascade)
+{
+	const uint32_t slice = cascade * m_width * m_height;
 
-	delete[] pImageOut;
-	delete[] pNormalOut;
+	if (!set.normalPacked)
+		return set.normal + slice * 4;
 
-	fftwf_destroy_plan(m_plan[2]);
-	fftwf_destroy_plan(m_plan[1]);
-	fftwf_destroy_plan(m_plan[0]);
+	return set.normalPacked + slice * (m_textureFormat == kTexturePacked ? 2 : 4);
+}
 
-	fftwf_free(m_FFTin[0]);
-	fftwf_free(m_FFTin[1]);
-	fftwf_free(m_FFTin[2]);
-	fftwf_free(m_FFTout[0]);
-	fftwf_free(m_FFTout[1]);
-	fftwf_free(m_FFTout[2]);
+const uint8_t* FFTWrapper::getFoamTexels(const TextureSet& set, const unsigned int& cascade)
+{
+	return set.foamPacked ? set.foamPacked + cascade * m_width * m_height : nullptr;
+}
 
+unsigned int FFTWrapper::getImageTexelBytes()
+{
+	return (m_textureFormat == kTextureRGBA32F) ? 16 : 8;
 }
 
-float FFTWrapper::Philips_Spectrum(const Vec2& vK, float& kMag)
+unsigned int FFTWrapper::getNormalTexelBytes()
 {
-	// Philips Spectrum calculation for specific k Vector
-	float L = (m_windSpeed * m_windSpeed) / kfGravity;
-	float k2 = sqr(kMag);
-	float normDot = sqr(dot(normal(vK, kMag), m_windNormal)); 
-	float numer = exp(-1.0f / (k2 * sqr(L)));
-	float denom = sqr(k2);
-	return m_amplitude * (numer / denom) * normDot;
+	switch (m_textureFormat)
+	{
+	case kTextureRGBA16F:	return 8;
+	case kTexturePacked:	return 4;
+	default:				return 16;
+	}
+}
+
+void FFTWrapper::getDisplacementDecode(const TextureSet& set, float mul[3], float add[3], const unsigned int& cascade)
+{
+	// UNORM texels map [0, 1] back onto [-scale, scale]
+	for (int ch(0); ch < 3; ++ch)
+	{
+		const bool packed = (m_textureFormat == kTexturePacked);
+		mul[ch] = packed ? 2 * set.dispScale[cascade][ch] : 1.0f;
+		add[ch] = packed ? -set.dispScale[cascade][ch] : 0.0f;
+	}
+}
+
+uint32_t FFTWrapper::Pack_Chunk_Rows()
+{
+	if (m_textureFormat == kTextureRGBA32F)
+		return m_height;
+
+	return std::max(1u, kPackChunkBytes / (m_width * 4 * (uint32_t)sizeof(float)));
+}
+
+void FFTWrapper::Pack_Image_Rows(const uint32_t& cascade, const uint32_t& rowBegin, const uint32_t& rowEnd, float peak[3])
+{
+	const uint32_t slice = cascade * m_width * m_height;
+	const float* texels = m_textures.image + slice * 4;
+
+	switch (m_textureFormat)
+	{
+	case kTextureRGBA16F:
+		PackHalfTexels(texels, m_textures.imagePacked + slice * 4, rowBegin * m_width, rowEnd * m_width, m_simdLevel);
+		break;
+	case kTexturePacked:
+		PackDisplacementTexels(texels, m_textures.imagePacked + slice * 4, m_textures.dispScale[cascade], peak,
+			rowBegin * m_width, rowEnd * m_width, m_simdLevel);
+		break;
+	default:
+		break;
+	}
+}
+
+void FFTWrapper::Pack_Normal_Rows(const uint32_t& cascade, const uint32_t& rowBegin, const uint32_t& rowEnd)
+{
+	const uint32_t slice = cascade * m_width * m_height;
+	const float* texels = m_textures.normal + slice * 4;
+
+	switch (m_textureFormat)
+	{
+	case kTextureRGBA16F:
+		PackHalfTexels(texels, m_textures.normalPacked + slice * 4, rowBegin * m_width, rowEnd * m_width, m_simdLevel);
+		break;
+	case kTexturePacked:
+		PackNormalTexels(texels, (int16_t*)m_textures.normalPacked + slice * 2, m_textures.foamPacked + slice,
+			rowBegin * m_width, rowEnd * m_width, m_simdLevel);
+		break;
+	default:
+		break;
+	}
+}
+
+void FFTWrapper::Begin_Image_Packing()
+{
+	// This frame is quantised with the range measured on the last one
+	for (uint32_t c(0); c < m_cascadeCount; ++c)
+	{
+		for (int ch(0); ch < 3; ++ch)
+		{
+			m_textures.dispScale[c][ch] = m_dispNext[c][ch];
+			m_dispPeak[c][ch] = 0;
+		}
+	}
+}
+
+void FFTWrapper::Merge_Displacement_Peaks(const float peak[kMaxCascades][3])
+{
+	if (m_textureFormat != kTexturePacked)
+		return;
+
+#pragma omp critical
+	{
+		for (uint32_t c(0); c < m_cascadeCount; ++c)
+		{
+			for (int ch(0); ch < 3; ++ch)
+				m_dispPeak[c][ch] = std::max(m_dispPeak[c][ch], peak[c][ch]);
+		}
+	}
+}
+
+void FFTWrapper::Finish_Image_Packing()
+{
+	if (m_textureFormat != kTexturePacked)
+		return;
+
+	for (uint32_t c(0); c < m_cascadeCount; ++c)
+	{
+		bool clipped = false;
+		for (int ch(0); ch < 3; ++ch)
+		{
+			clipped |= m_dispPeak[c][ch] > m_textures.dispScale[c][ch];
+			m_dispNext[c][ch] = m_dispPeak[c][ch] * kfDispHeadroom;
+		}
+
+		if (!clipped)
+			continue;
+
+		// Waves grew past the range of the last frame, which only happens on
+		// sudden changes of the sea state, so the slice is packed again
+		for (int ch(0); ch < 3; ++ch)
+			m_textures.dispScale[c][ch] = m_dispNext[c][ch];
+
+#pragma omp parallel num_threads(m_threadCount)
+		{
+			uint32_t begin, end;
+			float peak[3] = { 0, 0, 0 };
+			Band_Range(omp_get_thread_num(), omp_get_num_threads(), m_height, 1, begin, end);
+
+			Pack_Image_Rows(c, begin, end, peak);
+		}
+	}
+}
+
+void FFTWrapper::Band_Range(const int& band, const int& bandCount, const uint32_t& count, const uint32_t& align, uint32_t& begin, uint32_t& end)
+{
+	// Contiguous bands of [0, count), every edge but the last on a multiple of align
+	const uint32_t units = (count + align - 1) / align;
+
+	begin = std::min(count, (uint32_t)((uint64_t)units * band / bandCount) * align);
+	end = std::min(count, (uint32_t)((uint64_t)units * (band + 1) / bandCount) * align);
 }
 
 void FFTWrapper::Fill_K_Vectors()
 {
-	// Fill the k Vectors array
+	// Fill the k Vectors array, one grid per cascade
 	int height2 = m_height / 2;
 	int width2 = m_width / 2;
 	uint32_t n = 0;
 	
-	float kz, kx;
+	float kz, kx, patch;
 
-	for (int j = 0; j < m_height; ++j)
+	for (uint32_t c(0); c < m_cascadeCount; ++c)
 	{
-		kz = kfTwoPi * (j) / kfWorldUnit;
-		for (int i = 0; i < m_width; ++i)
+		patch = m_patchSize[c];
+
+		for (int j = 0; j < m_height; ++j)
 		{
-			kx = kfTwoPi * (i) / kfWorldUnit;
+#ifdef HERMITIAN_SPECTRUM
+			// Signed frequencies in FFT order, so that -k is also on the grid
+			kz = kfTwoPi * (j < height2 ? j : j - (int)m_height) / patch;
+#else
+			kz = kfTwoPi * (j) / patch;
+#endif // HERMITIAN_SPECTRUM
+			for (int i = 0; i < m_width; ++i)
+			{
+#ifdef HERMITIAN_SPECTRUM
+				kx = kfTwoPi * (i < width2 ? i : i - (int)m_width) / patch;
+#else
+				kx = kfTwoPi * (i) / patch;
+#endif // HERMITIAN_SPECTRUM
+
+				m_kVectors[n] = { kx, kz };
+				m_kMag[n] = magnitude(m_kVectors[n]);
+
+				// Avoid division by zero
+				if (m_kMag[n] < 0.0001f)
+					m_kMag[n] = 0.0001f;
+
+				++n;
+			}
+		}
+	}
+}
+
+float FFTWrapper::Cascade_Weight(const uint32_t& cascade, const float& kMag)
+{
+	// Each cascade only keeps the wavenumbers below kfCascadeSplit times
+	// its Nyquist wavenumber that the previous cascade doesn't cover, so
+	// no wave is simulated twice. The spectrum shapes already scale the
+	// amplitudes with the cascade's bin area.
+	const float kLow = (cascade == 0) ? 0.0f : kfCascadeSplit * kfPi * m_width / m_patchSize[cascade - 1];
+	const float kHigh = (cascade + 1 == m_cascadeCount) ? INFINITY : kfCascadeSplit * kfPi * m_width / m_patchSize[cascade];
 
-			m_kVectors[n] = { kx, kz };
-			m_kMag[n] = magnitude(m_kVectors[n]);
+	if (kMag < kLow || kMag >= kHigh)
+		return 0.0f;
 
-			// Avoid division by zero
-			if (m_kMag[n] < 0.0001f)
-				m_kMag[n] = 0.0001f;
+	return 1.0f;
+}
+
+void FFTWrapper::Fill_Spectrum_SoA()
+{
+	// Gather the initial spectrum into the columns of the IFFT input,
+	// split into real and imaginary planes for the SIMD kernels
+	uint32_t i, s;
+	float oneOverKMag;
 
-			++n;
+	for (uint32_t c(0); c < m_cascadeCount; ++c)
+	{
+		for (uint32_t j(0); j < m_height; ++j)
+		{
+			for (uint32_t col(0); col < m_specWidth; ++col)
+			{
+				i = (c * m_height + j) * m_width + col;
+				s = (c * m_height + j) * m_specWidth + col;
+
+				oneOverKMag = 1.0f / m_kMag[i];
+
+				m_spectrum.h0Re[s] = m_h0tilde[i].x;
+				m_spectrum.h0Im[s] = m_h0tilde[i].y;
+				m_spectrum.h0ConjRe[s] = m_h0tildeConj[i].x;
+				m_spectrum.h0ConjIm[s] = m_h0tildeConj[i].y;
+
+				m_spectrum.kx[s] = m_kVectors[i].x;
+				m_spectrum.kz[s] = m_kVectors[i].y;
+				m_spectrum.kxOverK[s] = m_kVectors[i].x * oneOverKMag;
+				m_spectrum.kzOverK[s] = m_kVectors[i].y * oneOverKMag;
+			}
 		}
 	}
 }
 
-void FFTWrapper::Precalculate_Sinusoids()
+void FFTWrapper::Precalculate_Rotors()
+{
+	// Every wave starts at t = 0
+	Set_Time(0);
+	Precalculate_Steps();
+}
+
+void FFTWrapper::Set_Time(const double& time)
 {
-	// Precalculate all sinusoids on the first frame to
-	// calculate the exp terms using Euler's formula. 
-	// Variable "step" works like timescale
+	// The dead bins are turned as well, so they have nothing to catch up on
+	m_rotorFrame = 0;
+	m_deadTime = 0;
+	m_time = time;
+
+#pragma omp parallel for num_threads(m_threadCount) schedule(static)
+	for (int s = 0; s < (int)(m_specWidth * m_height * m_cascadeCount); ++s)
+	{
+		const uint32_t i = (s / m_specWidth) * m_width + s % m_specWidth;
+		const double phase = Angular_Frequency(m_kMag[i]) * time;
+
+		m_spectrum.rotorCos[s] = (float)cos(phase);
+		m_spectrum.rotorSin[s] = (float)sin(phase);
+	}
+}
+
+void FFTWrapper::Precalculate_Steps()
+{
+	// Precalculate the rotation every wave goes through in one frame,
+	// so the exp terms of Euler's formula only cost one complex
+	// multiplication per frame. m_timeStep works like timescale.
 
 	float omegaK = 0;
-	float wavePeriod = 0;
-	float step = 0.05f;
+	uint32_t i, s;
 
-	// For the CPU implementation, we can precalculate all sinusoids
-	// and store them into vectors of different sizes.
-	// This however disables timescaling, so another solution should be 
-	// found if the game needs to support that.
+	for (uint32_t c(0); c < m_cascadeCount; ++c)
+	{
+		for (uint32_t j(0); j < m_height; ++j)
+		{
+			for (uint32_t col(0); col < m_specWidth; ++col)
+			{
+				i = (c * m_height + j) * m_width + col;
+				s = (c * m_height + j) * m_specWidth + col;
 
-	memset(m_cosLookup, 0, m_width * m_height * sizeof(int));
-	memset(m_sinLookup, 0, m_width * m_height * sizeof(int));
+				omegaK = (float)Angular_Frequency(m_kMag[i]);
 
-	for (uint32_t i(0); i < (m_width * m_height); ++i)
+				m_spectrum.stepCos[s] = cos(omegaK * m_timeStep);
+				m_spectrum.stepSin[s] = sin(omegaK * m_timeStep);
+			}
+		}
+	}
+}
+
+double FFTWrapper::Angular_Frequency(const float& kMag)
+{
+	const double omega = sqrt(kfGravity * kMag);
+	if (m_loopPeriod <= 0)
+		return omega;
+
+	const double omegaLoop = kfTwoPi / m_loopPeriod;
+	return floor(omega / omegaLoop + 0.5) * omegaLoop;
+}
+
+void FFTWrapper::Evaluate_Spectrum(const SpectrumShape& shape, const uint32_t& cascade, const uint32_t& n, const uint32_t& count,
+	float* variance, float* opposite)
+{
+	const uint32_t bin = cascade * m_width * m_height + n;
+	EvaluateSpectrum(shape, &m_kVectors[bin].x, m_kMag + bin, variance, opposite, count, m_simdLevel);
+}
+
+Vec2 FFTWrapper::H0tilde_Bin(const uint32_t& cascade, const uint32_t& n, const float& variance)
+{
+#ifdef HERMITIAN_SPECTRUM
+	const uint32_t i = n % m_width;
+	const uint32_t j = n / m_width;
+
+	// The Nyquist row and column are their own negatives and cannot hold
+	// the odd displacement terms, so they are left empty.
+	if (i == m_width / 2 || j == m_height / 2)
+		return { 0, 0 };
+#endif // HERMITIAN_SPECTRUM
+
+	// Four Gaussian samples with mean 0 and standard deviation 1 per bin,
+	// the first two for h0tilde and the others for h0tildeConjugate
+	float gauss[4];
+	CounterRNG::Gaussian4(m_seed, cascade, n, gauss);
+
+	const float rootOfPh = sqrt(variance) * kfOneOverRoot2 * Cascade_Weight(cascade, m_kMag[cascade * m_width * m_height + n]);
+
+	return { gauss[0] * rootOfPh, gauss[1] * rootOfPh };
+}
+
+Vec2 FFTWrapper::H0tildeConj_Bin(const uint32_t& cascade, const uint32_t& n, const float& opposite)
+{
+	// Independent of h0tilde(-k). The Hermitian spectrum reads its conjugate
+	// back from h0tilde in Fill_h0tildeConj_Rows instead.
+	float gauss[4];
+	CounterRNG::Gaussian4(m_seed, cascade, n, gauss);
+
+	const float rootOfPh = sqrt(opposite) * kfOneOverRoot2 * Cascade_Weight(cascade, m_kMag[cascade * m_width * m_height + n]);
+
+	return { gauss[2] * rootOfPh, -gauss[3] * rootOfPh };
+}
+
+void FFTWrapper::Fill_h0tilde()
+{
+	// A seed of 0 gives a different ocean every launch. The seed drawn
+	// is kept, so the same ocean is generated again from then on.
+	if (m_seed == 0)
+		m_seed = std::max(1u, (uint32_t)std::random_device()());
+
+	// Every cascade's bins cover (2 pi / patch)^2
+	for (uint32_t c(0); c < m_cascadeCount; ++c)
+		m_spectrumShape[c] = MakeSpectrumShape(m_seaState, sqr(kfTwoPi / m_patchSize[c]), sqr(kfTwoPi / m_patchSize[0]), m_width);
+
+	const uint32_t rowCount = m_height * m_cascadeCount;
+	Fill_h0tilde_Rows(m_spectrumShape, m_h0tilde, m_h0tildeConj, 0, rowCount);
+#ifdef HERMITIAN_SPECTRUM
+	Fill_h0tildeConj_Rows(m_h0tilde, m_h0tildeConj, 0, rowCount);
+#endif // HERMITIAN_SPECTRUM
+}
+
+#ifdef HERMITIAN_SPECTRUM
+// The Hermitian h0tildeConj is left to Fill_h0tildeConj_Rows
+void FFTWrapper::Fill_h0tilde_Rows(const SpectrumShape* shapes, Vec2* h0tilde, Vec2* /* h0tildeConj */, const uint32_t& rowBegin, const uint32_t& rowEnd)
+#else
+void FFTWrapper::Fill_h0tilde_Rows(const SpectrumShape* shapes, Vec2* h0tilde, Vec2* h0tildeConj, const uint32_t& rowBegin, const uint32_t& rowEnd)
+#endif // HERMITIAN_SPECTRUM
+{
+	// Every bin has its own random numbers, so the bins can be filled in
+	// any order, by any number of threads, with the same results. The
+	// spectrum is evaluated a row at a time by the vector kernels.
+#pragma omp parallel num_threads(m_threadCount)
 	{
-		omegaK = sqrt(kfGravity * m_kMag[i]);
+		std::vector<float> variance(m_width);
+#ifndef HERMITIAN_SPECTRUM
+		std::vector<float> opposite(m_width);
+#endif // !HERMITIAN_SPECTRUM
 
-		wavePeriod = kfTwoPi / omegaK;
+#pragma omp for schedule(static)
+		for (int row = (int)rowBegin; row < (int)rowEnd; ++row)
+		{
+			const uint32_t c = row / m_height;
+			const uint32_t first = (row % m_height) * m_width;
+			Vec2* h0Row = h0tilde + row * m_width;
+#ifdef HERMITIAN_SPECTRUM
+			Evaluate_Spectrum(shapes[c], c, first, m_width, variance.data(), nullptr);
+
+			for (uint32_t i(0); i < m_width; ++i)
+				h0Row[i] = H0tilde_Bin(c, first + i, variance[i]);
+#else
+			Vec2* h0ConjRow = h0tildeConj + row * m_width;
+			Evaluate_Spectrum(shapes[c], c, first, m_width, variance.data(), opposite.data());
+
+			for (uint32_t i(0); i < m_width; ++i)
+			{
+				h0Row[i] = H0tilde_Bin(c, first + i, variance[i]);
+				h0ConjRow[i] = H0tildeConj_Bin(c, first + i, opposite[i]);
+			}
+#endif // HERMITIAN_SPECTRUM
+		}
+	}
+}
 
-		m_cosPrecalc[i].clear();
-		m_sinPrecalc[i].clear();
+void FFTWrapper::Fill_h0tildeConj_Rows(const Vec2* h0tilde, Vec2* h0tildeConj, const uint32_t& rowBegin, const uint32_t& rowEnd)
+{
+	// Read back instead of generating h0tilde(-k) again
+#pragma omp parallel for num_threads(m_threadCount) schedule(static)
+	for (int row = (int)rowBegin; row < (int)rowEnd; ++row)
+	{
+		const uint32_t c = row / m_height;
+		const uint32_t j = row % m_height;
+		const Vec2* h0Cascade = h0tilde + c * m_width * m_height;
 
-		// Every wave has a different period, so to precalculate them
-		// we need to precalculate different amounts of "screenshots" for each wave
-		for (float time_unit(0); time_unit < wavePeriod; time_unit += step)
+		for (uint32_t i(0); i < m_width; ++i)
 		{
-			m_cosPrecalc[i].push_back(cos(omegaK * time_unit));
-			m_sinPrecalc[i].push_back(sin(omegaK * time_unit));
+			const Vec2& h0Neg = h0Cascade[Negative_K_Index(i, j)];
+			h0tildeConj[row * m_width + i] = { h0Neg.x, -h0Neg.y };
 		}
 	}
 }
 
-void FFTWrapper::Fill_h0tilde()
+void FFTWrapper::Request_Sea_State(const SeaState& state, const uint32_t& fadeFrames)
+{
+	const uint32_t binCount = m_width * m_height * m_cascadeCount;
+
+	if (!m_h0target)
+	{
+		m_h0target = new Vec2[binCount];
+		m_h0targetConj = new Vec2[binCount];
+	}
+
+	// Cut short by another change, the blend on screen becomes the active spectrum
+	if (m_rebuildStage == kRebuildFade && m_fadeFrame > 0)
+	{
+		const float weight = (float)m_fadeFrame / m_fadeFrames;
+		const float keep = 1.0f - weight;
+
+#pragma omp parallel for num_threads(m_threadCount) schedule(static)
+		for (int n = 0; n < (int)binCount; ++n)
+		{
+			const Vec2& h0 = m_h0tilde[n];
+			const Vec2& h0Conj = m_h0tildeConj[n];
+			m_h0tilde[n] = { keep * h0.x + weight * m_h0target[n].x, keep * h0.y + weight * m_h0target[n].y };
+			m_h0tildeConj[n] = { keep * h0Conj.x + weight * m_h0targetConj[n].x, keep * h0Conj.y + weight * m_h0targetConj[n].y };
+		}
+	}
+
+	m_targetState = state;
+	const Vec2 windNormal = normal({ state.windX, state.windZ });
+	m_targetState.windX = windNormal.x;
+	m_targetState.windZ = windNormal.y;
+
+	for (uint32_t c(0); c < m_cascadeCount; ++c)
+		m_targetShape[c] = MakeSpectrumShape(m_targetState, sqr(kfTwoPi / m_patchSize[c]), sqr(kfTwoPi / m_patchSize[0]), m_width);
+
+	m_rebuildStage = kRebuildSpectrum;
+	m_rebuildRow = 0;
+	m_fadeFrame = 0;
+	m_fadeFrames = fadeFrames;
+	m_rebuildProgress.store(0.0f, std::memory_order_relaxed);
+}
+
+void FFTWrapper::Update_Spectrum()
 {
-	std::random_device rd;
-	std::mt19937 e2(rd());
+	if (m_rebuildStage == kRebuildIdle)
+		return;
 
-	// Gaussian distribution with mean 0 and standard deviation 1
-	std::normal_distribution<> dist(0, 1);
+	const uint32_t rowCount = m_height * m_cascadeCount;
+	const uint32_t chunkRows = std::max(1u, kRebuildChunkBins / m_width);
+
+#ifdef HERMITIAN_SPECTRUM
+	const uint32_t buildRows = 2 * rowCount;
+#else
+	const uint32_t buildRows = rowCount;
+#endif // HERMITIAN_SPECTRUM
+
+	if (m_rebuildStage == kRebuildSpectrum || m_rebuildStage == kRebuildConjugate)
+	{
+		const uint32_t row = m_rebuildRow % rowCount;
+		const uint32_t rowEnd = std::min(row + chunkRows, rowCount);
 
-	const float oneOverRoot2 = 1.0f / sqrt(2.f);
+		if (m_rebuildStage == kRebuildSpectrum)
+			Fill_h0tilde_Rows(m_targetShape, m_h0target, m_h0targetConj, row, rowEnd);
+		else
+			Fill_h0tildeConj_Rows(m_h0target, m_h0targetConj, row, rowEnd);
 
-	for (uint32_t n(0); n < (m_width * m_height); ++n)
+		m_rebuildRow += rowEnd - row;
+		if (m_rebuildRow == buildRows)
+		{
+			// Both spectra are on screen during the fade
+			m_rebuildStage = kRebuildFade;
+			Prune_Spectrum(true);
+		}
+		else if (m_rebuildRow == rowCount)
+			m_rebuildStage = kRebuildConjugate;
+	}
+	else
 	{
-		// Fill h0tilde
-		float rootOfPh = sqrt(Philips_Spectrum(m_kVectors[n], m_kMag[n]));
-		rootOfPh *= oneOverRoot2;
-		m_h0tilde[n] = { (float)dist(e2) * rootOfPh, (float)dist(e2) * rootOfPh };
+		// The last fade frame is the new spectrum exactly
+		m_fadeFrame = std::min(m_fadeFrame + 1, m_fadeFrames);
+		const float weight = (m_fadeFrames > 0) ? (float)m_fadeFrame / m_fadeFrames : 1.0f;
+		Blend_Spectrum(weight);
 
-		// Fill h0tildeConjugate
-		rootOfPh = sqrt(Philips_Spectrum({ -m_kVectors[n].x , -m_kVectors[n].y }, m_kMag[n]));
-		rootOfPh *= oneOverRoot2;
-		m_h0tildeConj[n] = { (float)dist(e2) * rootOfPh, -(float)dist(e2) * rootOfPh };
+		if (m_fadeFrame == m_fadeFrames)
+		{
+			std::swap(m_h0tilde, m_h0target);
+			std::swap(m_h0tildeConj, m_h0targetConj);
+			std::copy(m_targetShape, m_targetShape + kMaxCascades, m_spectrumShape);
+			m_seaState = m_targetState;
+			m_rebuildStage = kRebuildIdle;
+			++m_spectrumVersion;
+			Prune_Spectrum(false);
+		}
 	}
+
+	// In frames, a chunk of rows or a fade step each
+	const uint32_t stageChunks = (rowCount + chunkRows - 1) / chunkRows;
+	const uint32_t buildChunks = stageChunks * (buildRows / rowCount);
+	const uint32_t doneChunks = (m_rebuildRow / rowCount) * stageChunks + (m_rebuildRow % rowCount + chunkRows - 1) / chunkRows;
+	const float progress = (float)(doneChunks + m_fadeFrame) / (buildChunks + m_fadeFrames);
+	m_rebuildProgress.store((m_rebuildStage == kRebuildIdle) ? 1.0f : progress, std::memory_order_relaxed);
 }
 
-void FFTWrapper::Fill_htilde_and_Displacements()
+void FFTWrapper::Prune_Spectrum(const bool& withTarget)
 {
-	Vec2 expPos, expNeg, temp;
-	Vec2 htilde, dispX, dispZ;
-	float oneOverKMag;
+	const uint32_t binAlign = kCacheLineSize / sizeof(float);
+
+	std::vector<double> height(m_specWidth), slope(m_specWidth);
+	std::vector<float> share(m_specWidth);
+	std::vector<uint32_t> order(m_specWidth);
+	std::vector<uint8_t> dead(m_specWidth * m_cascadeCount, 0);
 
-	for (uint32_t i(0); i < (m_width * m_height); ++i)
+	// The rotors of the dead bins haven't turned since the last pruning, and
+	// catch up before any of them comes back to life
+	for (const BinSpan& span : m_deadSpans)
 	{
-		oneOverKMag = 1.0f / m_kMag[i];
+		for (uint32_t s(span.begin); s < span.end; ++s)
+		{
+			const uint32_t i = (s / m_specWidth) * m_width + s % m_specWidth;
+			const double phase = Angular_Frequency(m_kMag[i]) * m_deadTime;
+			const float stepCos = (float)cos(phase);
+			const float stepSin = (float)sin(phase);
+			const float rotorCos = m_spectrum.rotorCos[s];
+
+			m_spectrum.rotorCos[s] = rotorCos * stepCos - m_spectrum.rotorSin[s] * stepSin;
+			m_spectrum.rotorSin[s] = rotorCos * stepSin + m_spectrum.rotorSin[s] * stepCos;
+		}
+	}
+	m_deadTime = 0;
 
-		// Lookup the precalculated sin and cos values
-		++m_cosLookup[i];
-		++m_sinLookup[i];
+	for (uint32_t c(0); c < m_cascadeCount && m_pruneEnergy >= 0; ++c)
+	{
+		// Height and slope variance of every column of the IFFT input. The
+		// slopes weigh the short waves by k^2, which the normals need.
+		std::fill(height.begin(), height.end(), 0.0);
+		std::fill(slope.begin(), slope.end(), 0.0);
 
-		if (m_cosLookup[i] >= m_cosPrecalc[i].size())
-			m_cosLookup[i] = 0;
-		if (m_sinLookup[i] >= m_sinPrecalc[i].size())
-			m_sinLookup[i] = 0;
+		for (uint32_t j(0); j < m_height; ++j)
+		{
+			for (uint32_t col(0); col < m_specWidth; ++col)
+			{
+				const uint32_t i = (c * m_height + j) * m_width + col;
+				double energy = sqr(m_h0tilde[i].x) + sqr(m_h0tilde[i].y) + sqr(m_h0tildeConj[i].x) + sqr(m_h0tildeConj[i].y);
 
-		// exp values calculated with Euler's formula
-		expPos = { m_cosPrecalc[i][m_cosLookup[i]], m_sinPrecalc[i][m_sinLookup[i]] };
-		expNeg = { expPos.x, -expPos.y };
+				if (withTarget)
+					energy += sqr(m_h0target[i].x) + sqr(m_h0target[i].y) + sqr(m_h0targetConj[i].x) + sqr(m_h0targetConj[i].y);
 
-		// Fill htilde
-		htilde = addComplex(multComplex(m_h0tilde[i], expPos), multComplex(m_h0tildeConj[i], expNeg));
-		m_FFTin[0][i][0] = htilde.x;	
-		m_FFTin[0][i][1] = htilde.y;
+				height[col] += energy;
+				slope[col] += energy * sqr(m_kMag[i]);
+			}
+		}
 
-		// Fill Displacement (X-Axis)
-		dispX = multComplex({ 0, -m_kVectors[i].x * oneOverKMag }, htilde);
-		m_FFTin[1][i][0] = dispX.x;	
-		m_FFTin[1][i][1] = dispX.y;
+		double heightTotal = 0, slopeTotal = 0;
+		for (uint32_t col(0); col < m_specWidth; ++col)
+		{
+			heightTotal += height[col];
+			slopeTotal += slope[col];
+		}
 
-		// Fill Displacement (Z-Axis)
-		dispZ = multComplex({ 0, -m_kVectors[i].y * oneOverKMag }, htilde);
-		m_FFTin[2][i][0] = dispZ.x;	
-		m_FFTin[2][i][1] = dispZ.y;	
+		const double heightScale = (heightTotal > 0) ? 1.0 / heightTotal : 0.0;
+		const double slopeScale = (slopeTotal > 0) ? 1.0 / slopeTotal : 0.0;
+
+		for (uint32_t col(0); col < m_specWidth; ++col)
+		{
+			share[col] = (float)std::max(height[col] * heightScale, slope[col] * slopeScale);
+			order[col] = col;
+		}
+		std::sort(order.begin(), order.end(), [&](const uint32_t& a, const uint32_t& b) { return share[a] < share[b]; });
+
+		// The quietest columns go, for as long as they leave out no more than
+		// the budget of either variance. A budget of 0 only drops the columns
+		// with no waves at all.
+		double heightPruned = 0, slopePruned = 0;
+		for (uint32_t n(0); n < m_specWidth; ++n)
+		{
+			const uint32_t col = order[n];
+			if ((heightPruned + height[col]) * heightScale > m_pruneEnergy || (slopePruned + slope[col]) * slopeScale > m_pruneEnergy)
+				break;
+
+			heightPruned += height[col];
+			slopePruned += slope[col];
+			dead[c * m_specWidth + col] = 1;
+		}
+	}
+
+	// Live columns, widened to whole cache lines of the row, which the
+	// kernels can fill with whole vectors. Dead columns stay zero.
+	for (uint32_t c(0); c < m_cascadeCount; ++c)
+	{
+		uint8_t* cascadeDead = dead.data() + c * m_specWidth;
+
+		for (uint32_t line(0); line < m_specWidth; line += binAlign)
+		{
+			const uint32_t lineEnd = std::min(line + binAlign, m_specWidth);
+			if (std::find(cascadeDead + line, cascadeDead + lineEnd, 0) != cascadeDead + lineEnd)
+				std::fill(cascadeDead + line, cascadeDead + lineEnd, 0);
+		}
+	}
+
+	// Runs of live and dead columns in every row. Rows that are live or dead
+	// from end to end merge with their neighbours.
+	m_liveSpans.clear();
+	m_deadSpans.clear();
+	m_liveBins = 0;
+	m_deadBins = 0;
+
+	for (uint32_t row(0); row < m_height * m_cascadeCount; ++row)
+	{
+		const uint8_t* rowDead = dead.data() + (row / m_height) * m_specWidth;
+
+		for (uint32_t col(0); col < m_specWidth;)
+		{
+			uint32_t runEnd = col + 1;
+			while (runEnd < m_specWidth && rowDead[runEnd] == rowDead[col])
+				++runEnd;
+
+			std::vector<BinSpan>& spans = rowDead[col] ? m_deadSpans : m_liveSpans;
+			uint32_t& bins = rowDead[col] ? m_deadBins : m_liveBins;
+			const uint32_t begin = row * m_specWidth + col;
+			const uint32_t end = row * m_specWidth + runEnd;
+
+			if (!spans.empty() && spans.back().end == begin)
+				spans.back().end = end;
+			else
+				spans.push_back({ begin, end, bins });
+
+			bins += end - begin;
+			col = runEnd;
+		}
+	}
+
+	m_liveFraction.store((float)m_liveBins / (m_liveBins + m_deadBins), std::memory_order_relaxed);
+
+	// The plans transform every field of every cascade, or every cascade of one field
+	m_zeroColumns.resize(m_fieldCount * m_cascadeCount * m_specWidth);
+	for (uint32_t t(0); t < m_fieldCount * m_cascadeCount; ++t)
+		std::copy(dead.begin() + (t % m_cascadeCount) * m_specWidth, dead.begin() + (t % m_cascadeCount + 1) * m_specWidth, m_zeroColumns.begin() + t * m_specWidth);
+
+	m_clearDeadBins = m_realOutput && m_plan[kFieldHeight] && !m_plan[kFieldHeight]->Skips_Zero_Columns();
+
+	// Columns that have just died still hold the waves of the last frame
+	for (uint32_t f(0); f < m_fieldCount; ++f)
+	{
+		fftwf_complex* field = m_FFTin[m_fields[f]];
+		for (const BinSpan& span : m_deadSpans)
+			memset(field + span.begin, 0, (span.end - span.begin) * sizeof(fftwf_complex));
+	}
+
+	if (m_htildeSaved)
+	{
+		for (const BinSpan& span : m_deadSpans)
+			memset(m_htildeSaved + span.begin, 0, (span.end - span.begin) * sizeof(fftwf_complex));
 	}
 }
 
-void FFTWrapper::Fill_Horizontal_Displacement()
+void FFTWrapper::Clear_Dead_Bins(const SpectrumFields& fields)
 {
-	float oneOverKMag;
+	fftwf_complex* const outputs[] = { fields.htilde, fields.htildeCopy, fields.dispX, fields.dispZ, fields.slopeX, fields.slopeZ };
+
+	For_Span_Band(m_deadSpans, m_deadBins, [&](const uint32_t& begin, const uint32_t& end)
+	{
+		for (fftwf_complex* field : outputs)
+		{
+			if (field)
+				memset(field + begin, 0, (end - begin) * sizeof(fftwf_complex));
+		}
+	});
+}
+
+void FFTWrapper::Blend_Spectrum(const float& weight)
+{
+	// Same gather as Fill_Spectrum_SoA, only for h0
+	const float keep = 1.0f - weight;
+	const int rowCount = (int)(m_height * m_cascadeCount);
 
-	// Fill horizontal displacement only.
+#pragma omp parallel for num_threads(m_threadCount) schedule(static)
+	for (int row = 0; row < rowCount; ++row)
+	{
+		for (uint32_t col(0); col < m_specWidth; ++col)
+		{
+			const uint32_t i = row * m_width + col;
+			const uint32_t s = row * m_specWidth + col;
 
-	for (uint32_t i(0); i < (m_width * m_height); ++i)
+			m_spectrum.h0Re[s] = keep * m_h0tilde[i].x + weight * m_h0target[i].x;
+			m_spectrum.h0Im[s] = keep * m_h0tilde[i].y + weight * m_h0target[i].y;
+			m_spectrum.h0ConjRe[s] = keep * m_h0tildeConj[i].x + weight * m_h0targetConj[i].x;
+			m_spectrum.h0ConjIm[s] = keep * m_h0tildeConj[i].y + weight * m_h0targetConj[i].y;
+		}
+	}
+}
+
+void FFTWrapper::Fill_htilde_and_Displacements()
+{
+	// Rounding slowly changes the length of the rotors, so every so
+	// often they are scaled back onto the unit circle.
+	const bool renormalise = (++m_rotorFrame % kRotorRenormFrames) == 0;
+	m_deadTime += m_timeStep;
+	m_time += m_timeStep;
+
+	// Only the live columns of the IFFT input are filled, which
+	// are in the half spectrum in c2r mode.
+#pragma omp parallel num_threads(m_threadCount)
 	{
-		oneOverKMag = 1.0f / m_kMag[i];
+		For_Span_Band(m_liveSpans, m_liveBins, [&](const uint32_t& begin, const uint32_t& end)
+		{
+			AdvanceSpectrum(m_spectrum, m_spectrumFields, begin, end, renormalise, m_simdLevel);
+		});
+
+		if (m_clearDeadBins)
+			Clear_Dead_Bins(m_spectrumFields);
+	}
+}
+
+void FFTWrapper::Fill_Horizontal_Displacement()
+{
+	// Fill horizontal displacement only, from the htilde already in m_FFTin
+	SpectrumFields fields = m_spectrumFields;
+	fields.slopeX = nullptr;
+	fields.slopeZ = nullptr;
+
+	SpectrumFields cleared = fields;
+	cleared.htilde = nullptr;
+	cleared.htildeCopy = nullptr;
 
-		m_FFTin[1][i][0] = (1) * m_kVectors[i].x * m_FFTin[0][i][1] * oneOverKMag;
-		m_FFTin[1][i][1] = (-1) * m_kVectors[i].x * m_FFTin[0][i][0] * oneOverKMag;
+#pragma omp parallel num_threads(m_threadCount)
+	{
+		For_Span_Band(m_liveSpans, m_liveBins, [&](const uint32_t& begin, const uint32_t& end)
+		{
+			FillDerivedFields(m_spectrum, fields, begin, end, m_simdLevel);
+		});
 
-		m_FFTin[2][i][0] = (1) * m_kVectors[i].y * m_FFTin[0][i][1] * oneOverKMag;
-		m_FFTin[2][i][1] = (-1) * m_kVectors[i].y * m_FFTin[0][i][0] * oneOverKMag;
+		if (m_clearDeadBins)
+			Clear_Dead_Bins(cleared);
 	}
 }
 
 void FFTWrapper::Fill_Texture()
 {
-	for (uint32_t n(0); n < m_height * m_width; ++n)
-	{
+	const uint32_t rowAlign = std::max(1u, kCacheLineSize / (m_width * (uint32_t)sizeof(float)));
+	const uint32_t chunkRows = Pack_Chunk_Rows();
 
 #define SHOWFFT
 //#define SHOWHTILDE
 
-#ifdef SHOWFFT
+	Begin_Image_Packing();
+
+#pragma omp parallel num_threads(m_threadCount)
+	{
+		uint32_t rowBegin, rowEnd;
+		Band_Range(omp_get_thread_num(), omp_get_num_threads(), m_height, rowAlign, rowBegin, rowEnd);
 
-		pImageOut[4 * n + 0] = (m_FFTout[1][n][0]) / (m_height);	//X
-		pImageOut[4 * n + 1] = (m_FFTout[0][n][0]) / (m_height);	//Y
-		pImageOut[4 * n + 2] = (m_FFTout[2][n][0]) / (m_height);	//Z
-		pImageOut[4 * n + 3] = 1;
+		float peak[kMaxCascades][3] = {};
 
+#ifdef SHOWFFT
+		for (uint32_t c(0); c < m_cascadeCount; ++c)
+		{
+			for (uint32_t row(rowBegin); row < rowEnd; row += chunkRows)
+			{
+				const uint32_t chunkEnd = std::min(rowEnd, row + chunkRows);
+				m_gridKernels.fillTexture(m_width, Cascade_Outputs(c), m_textures.image + c * m_width * m_height * 4, row, chunkEnd);
+				Pack_Image_Rows(c, row, chunkEnd, peak[c]);
+			}
+		}
 #endif // SHOWFFT
 
 		// Only for debugging purposes
 #ifdef SHOWHTILDE
 		// htilde representation in the frequency domain
-		pImageOut[4 * n + 0] = (m_FFTin[0][n][0]) * 50;	
-		pImageOut[4 * n + 1] = (m_FFTin[0][n][1]) * 50;	
-		pImageOut[4 * n + 2] = 0;
-		pImageOut[4 * n + 3] = 1;
+		for (uint32_t n(rowBegin * m_width); n < rowEnd * m_width; ++n)
+		{
+			m_textures.image[4 * n + 0] = (m_FFTin[kFieldHeight][n][0]) * 50;	
+			m_textures.image[4 * n + 1] = (m_FFTin[kFieldHeight][n][1]) * 50;	
+			m_textures.image[4 * n + 2] = 0;
+			m_textures.image[4 * n + 3] = 1;
+		}
 #endif // SHOWHTILDE
+
+		Merge_Displacement_Peaks(peak);
 	}
+
+	Finish_Image_Packing();
 }
 
 void FFTWrapper::Fill_Normals_FFT(const float& choppy, const float& foamInt)
 {
-	uint32_t n;
-	int xNext, zNext, nInd;
-	float s11, s21, s12;
-	float Jxx, Jyy, Jxy, Jyx, jacobian;
+	const uint32_t rowAlign = std::max(1u, kCacheLineSize / (m_width * (uint32_t)sizeof(float)));
+	const uint32_t chunkRows = Pack_Chunk_Rows();
 
 	float intensity = 1 / (m_height / (1 + foamInt));
 	intensity = (foamInt == 0) ? 0 : intensity;
 
-	for (int j(0); j < m_height; ++j)
+	// The Jacobian only reads the displacements, so it runs before
+	// the slope IFFTs, which may overwrite them
+#pragma omp parallel num_threads(m_threadCount)
 	{
-		for (int i(0); i < m_width; ++i)
-		{
-			// Jacobian Calculation
-			xNext = (i == m_width - 1) ? xNext = 0 : xNext = i + 1;
-			zNext = (j == m_height - 1) ? zNext = 0 : zNext = j + 1;
+		uint32_t rowBegin, rowEnd;
+		Band_Range(omp_get_thread_num(), omp_get_num_threads(), m_height, rowAlign, rowBegin, rowEnd);
 
-			n = j * m_height + i;
-
-			nInd = j * m_height + xNext;
-			Jxx = 1 + choppy * (-m_FFTout[1][nInd][0] + m_FFTout[1][n][0]) * intensity;
-			Jxy = choppy * (-m_FFTout[2][nInd][0] + m_FFTout[2][n][0]) * intensity;
-
-			nInd = zNext * m_height + i;
-			Jyy = 1 + choppy * (-m_FFTout[2][nInd][0] + m_FFTout[2][n][0]) * intensity;
-			Jyx = choppy * (-m_FFTout[1][nInd][0] + m_FFTout[1][n][0]) * intensity;
-
-			jacobian = (Jxx * Jyy) - (Jxy * Jyx);
-
-			pNormalOut[4 * n + 3] = (jacobian < 0) ? 1.0f : 0.0f;
+		for (uint32_t c(0); c < m_cascadeCount; ++c)
+			m_gridKernels.fillFoam(m_width, Cascade_Outputs(c), choppy, intensity, m_textures.normal + c * m_width * m_height * 4, rowBegin, rowEnd);
+	}
 
-			// Preparation for IFFT execution
-			m_FFTin[1][n][0] = -1 * m_kVectors[n].x * m_FFTin[0][n][1];
-			m_FFTin[1][n][1] = m_kVectors[n].x * m_FFTin[0][n][0];
+	if (!m_batchedSlopes)
+	{
+		// Preparation for IFFT execution. A c2r IFFT has overwritten m_FFTin[kFieldHeight].
+		SpectrumFields fields = m_spectrumFields;
+		fields.htilde = m_saveHtilde ? m_htildeSaved : m_FFTin[kFieldHeight];
+		fields.dispX = nullptr;
+		fields.dispZ = nullptr;
+		fields.slopeX = m_FFTin[kFieldSlopeX];
+		fields.slopeZ = m_FFTin[kFieldSlopeZ];
+
+		SpectrumFields cleared = fields;
+		cleared.htilde = nullptr;
+		cleared.htildeCopy = nullptr;
+
+#pragma omp parallel num_threads(m_threadCount)
+		{
+			For_Span_Band(m_liveSpans, m_liveBins, [&](const uint32_t& begin, const uint32_t& end)
+			{
+				FillDerivedFields(m_spectrum, fields, begin, end, m_simdLevel);
+			});
 
-			m_FFTin[2][n][0] = -1 * m_kVectors[n].y * m_FFTin[0][n][1];
-			m_FFTin[2][n][1] = m_kVectors[n].y * m_FFTin[0][n][0];
+			if (m_clearDeadBins)
+				Clear_Dead_Bins(cleared);
 		}
-	}
 
-	// IFFT execution
-	fftwf_execute(m_plan[1]);
-	fftwf_execute(m_plan[2]);
+		// IFFT execution, reusing the displacement plans
+		Execute_Plan(kFieldDispX);
+#ifndef FFT_PACKED_DISP
+		Execute_Plan(kFieldDispZ);
+#endif // FFT_PACKED_DISP
+	}
 
-	for (n = 0; n < m_height * m_width; ++n)
+	// The slopes were transformed along with the other fields when batched
+#pragma omp parallel num_threads(m_threadCount)
 	{
-		pNormalOut[4 * n + 0] = (m_FFTout[1][n][0]);		//X
-		pNormalOut[4 * n + 1] = 2500;						//Y
-		pNormalOut[4 * n + 2] = (m_FFTout[2][n][0]);		//Z
+		uint32_t rowBegin, rowEnd;
+		Band_Range(omp_get_thread_num(), omp_get_num_threads(), m_height, rowAlign, rowBegin, rowEnd);
+
+		for (uint32_t c(0); c < m_cascadeCount; ++c)
+		{
+			for (uint32_t row(rowBegin); row < rowEnd; row += chunkRows)
+			{
+				const uint32_t chunkEnd = std::min(rowEnd, row + chunkRows);
+				m_gridKernels.fillSlopeNormals(m_width, Cascade_Outputs(c), m_textures.normal + c * m_width * m_height * 4, row, chunkEnd);
+				Pack_Normal_Rows(c, row, chunkEnd);
+			}
+		}
 	}
 }
 
 void FFTWrapper::Fill_Normals_Central_Diff(const float& choppy, const float &heightAdj, const float& foamInt)
 {
-	int xNext, zNext, n, nInd;
-	float s11, s21, s12;
-	float Jxx, Jyy, Jxy, Jyx, jacobian;
-	v3 va, vb, normals;
+	const uint32_t rowAlign = std::max(1u, kCacheLineSize / (m_width * (uint32_t)sizeof(float)));
 
 	float intensity = 1 / (m_height / (1 + foamInt));
 	intensity = (foamInt == 0) ? 0 : intensity;
@@ -318,56 +1207,226 @@ void FFTWrapper::Fill_Normals_Central_Diff(const float& choppy, const float &hei
 	// Calculate the Jacobian along with the normals
 	// with central difference
 
-	for (int j(0); j < m_height; ++j)
+#pragma omp parallel num_threads(m_threadCount)
 	{
-		for (int i(0); i < m_width; ++i)
+		uint32_t rowBegin, rowEnd;
+		int xNext, zNext, n, nInd;
+		float s11, s21, s12;
+		float Jxx, Jyy, Jxy, Jyx, jacobian;
+		v3 va, vb, normals;
+
+		Band_Range(omp_get_thread_num(), omp_get_num_threads(), m_height, rowAlign, rowBegin, rowEnd);
+
+		for (uint32_t c(0); c < m_cascadeCount; ++c)
 		{
-			xNext = (i == m_width - 1) ? xNext = 0 : xNext = i + 1;
-			zNext = (j == m_height - 1) ? zNext = 0 : zNext = j + 1;
+			// One texture array slice and one transform per cascade
+			const float* image = m_textures.image + c * m_width * m_height * 4;
+			float* normalOut = m_textures.normal + c * m_width * m_height * 4;
+			const OutputFields out = Cascade_Outputs(c);
+
+			for (int j(rowBegin); j < (int)rowEnd; ++j)
+			{
+				for (int i(0); i < m_width; ++i)
+				{
+					xNext = (i == m_width - 1) ? xNext = 0 : xNext = i + 1;
+					zNext = (j == m_height - 1) ? zNext = 0 : zNext = j + 1;
 
-			n = j * m_height + i;
-			s11 = heightAdj * pImageOut[4 * n + 1];
+					n = j * m_height + i;
+					s11 = heightAdj * image[4 * n + 1];
 
 
-			nInd = j * m_height + xNext;
-			s21 = heightAdj * pImageOut[4 * nInd + 1];
-			Jxx = 1 + choppy * (-m_FFTout[1][nInd][0] + m_FFTout[1][n][0]) * intensity;
-			Jxy = choppy * (-m_FFTout[2][nInd][0] + m_FFTout[2][n][0]) * intensity;
+					nInd = j * m_height + xNext;
+					s21 = heightAdj * image[4 * nInd + 1];
+					Jxx = 1 + choppy * (-out.dispX[nInd * m_outStride] + out.dispX[n * m_outStride]) * intensity;
+					Jxy = choppy * (-out.dispZ[nInd * m_outStride] + out.dispZ[n * m_outStride]) * intensity;
 
 
-			nInd = zNext * m_height + i;
-			s12 = heightAdj * pImageOut[4 * nInd + 1];
-			Jyy = 1 + choppy * (-m_FFTout[2][nInd][0] + m_FFTout[2][n][0]) * intensity;
-			Jyx = choppy * (-m_FFTout[1][nInd][0] + m_FFTout[1][n][0]) * intensity;
+					nInd = zNext * m_height + i;
+					s12 = heightAdj * image[4 * nInd + 1];
+					Jyy = 1 + choppy * (-out.dispZ[nInd * m_outStride] + out.dispZ[n * m_outStride]) * intensity;
+					Jyx = choppy * (-out.dispX[nInd * m_outStride] + out.dispX[n * m_outStride]) * intensity;
 
-			va = v3(2.0f, 0.0f, s21 - s11);
-			va.Normalize();
+					va = v3(2.0f, 0.0f, s21 - s11);
+					va.Normalize();
 
-			vb = v3(0.0f, 2.0f, s12 - s11);
-			vb.Normalize();
+					vb = v3(0.0f, 2.0f, s12 - s11);
+					vb.Normalize();
 
-			normals = va.Cross(vb);	
-			jacobian = (Jxx * Jyy) - (Jxy * Jyx);
+					normals = va.Cross(vb);	
+					jacobian = (Jxx * Jyy) - (Jxy * Jyx);
 
-			pNormalOut[4 * n + 0] = normals.x;	//X
-			pNormalOut[4 * n + 1] = normals.z;	//Y (inverted axis)
-			pNormalOut[4 * n + 2] = normals.y;	//Z
-			pNormalOut[4 * n + 3] = (jacobian < 0) ? 1.0f : 0.0f;
+					normalOut[4 * n + 0] = normals.x;	//X
+					normalOut[4 * n + 1] = normals.z;	//Y (inverted axis)
+					normalOut[4 * n + 2] = normals.y;	//Z
+					normalOut[4 * n + 3] = (jacobian < 0) ? 1.0f : 0.0f;
+				}
+
+				Pack_Normal_Rows(c, j, j + 1);
+			}
 		}
 	}
 }
 
 
+void FFTWrapper::Fill_Texture_and_Normals_Central_Diff(const float& choppy, const float &heightAdj, const float& foamInt)
+{
+	// Same results as Fill_Texture followed by Fill_Normals_Central_Diff, but
+	// every IFFT output row is read once. The +z neighbours come from a rolling
+	// window of two rows, and the +x wrap is peeled off the end of the row.
+	const uint32_t rowAlign = std::max(1u, kCacheLineSize / (m_width * (uint32_t)sizeof(float)));
+	const uint32_t chunkRows = Pack_Chunk_Rows();
+
+	float intensity = 1 / (m_height / (1 + foamInt));
+	intensity = (foamInt == 0) ? 0 : intensity;
+
+	Begin_Image_Packing();
+
+#pragma omp parallel num_threads(m_threadCount)
+	{
+		uint32_t rowBegin, rowEnd;
+		Band_Range(omp_get_thread_num(), omp_get_num_threads(), m_height, rowAlign, rowBegin, rowEnd);
+
+		float* window = m_rowWindow + omp_get_thread_num() * kWindowRows * 3 * m_width;
+		float peak[kMaxCascades][3] = {};
+
+		for (uint32_t c(0); c < m_cascadeCount; ++c)
+		{
+			const uint32_t slice = c * m_width * m_height * 4;
+
+			// Every chunk reloads its first row into the window
+			for (uint32_t row(rowBegin); row < rowEnd; row += chunkRows)
+			{
+				const uint32_t chunkEnd = std::min(rowEnd, row + chunkRows);
+				m_gridKernels.fillOutputsCentralDiff(m_width, Cascade_Outputs(c), choppy, heightAdj, intensity,
+					window, m_textures.image + slice, m_textures.normal + slice, row, chunkEnd);
+
+				Pack_Image_Rows(c, row, chunkEnd, peak[c]);
+				Pack_Normal_Rows(c, row, chunkEnd);
+			}
+		}
+
+		Merge_Displacement_Peaks(peak);
+	}
+
+	Finish_Image_Packing();
+}
+
+SpectrumCacheKey FFTWrapper::Spectrum_Cache_Key()
+{
+	// Every member is cleared, so keys of the same sea state are the same bytes
+	SpectrumCacheKey key = {};
+
+	key.width = m_width;
+	key.height = m_height;
+	key.cascades = m_cascadeCount;
+#ifdef HERMITIAN_SPECTRUM
+	key.hermitian = 1;
+#endif // HERMITIAN_SPECTRUM
+	key.seed = m_seed;
+	for (uint32_t c(0); c < m_cascadeCount; ++c)
+		key.patchSize[c] = m_patchSize[c];
+	key.seaState = m_seaState;
+
+	return key;
+}
+
+void FFTWrapper::Spectrum_Array_Bytes(uint64_t bytes[SpectrumCache::kMaxArrays])
+{
+	const uint64_t binCount = (uint64_t)m_width * m_height * m_cascadeCount;
+
+	bytes[SpectrumCache::kArrayKVectors] = binCount * sizeof(Vec2);
+	bytes[SpectrumCache::kArrayKMag] = binCount * sizeof(float);
+	bytes[SpectrumCache::kArrayH0tilde] = binCount * sizeof(Vec2);
+	bytes[SpectrumCache::kArrayH0tildeConj] = binCount * sizeof(Vec2);
+}
+
+void FFTWrapper::Attach_Spectrum_Arrays(std::unique_ptr<SpectrumCache> cache)
+{
+	// The rebuild target is allocated again by the next sea state change
+	Free_Spectrum_Array(m_kVectors);
+	Free_Spectrum_Array(m_kMag);
+	Free_Spectrum_Array(m_h0tilde);
+	Free_Spectrum_Array(m_h0tildeConj);
+	Free_Spectrum_Array(m_h0target);
+	Free_Spectrum_Array(m_h0targetConj);
+
+	m_spectrumCache = std::move(cache);
+
+	if (m_spectrumCache)
+	{
+		m_kVectors = (Vec2*)m_spectrumCache->getArray(SpectrumCache::kArrayKVectors);
+		m_kMag = (float*)m_spectrumCache->getArray(SpectrumCache::kArrayKMag);
+		m_h0tilde = (Vec2*)m_spectrumCache->getArray(SpectrumCache::kArrayH0tilde);
+		m_h0tildeConj = (Vec2*)m_spectrumCache->getArray(SpectrumCache::kArrayH0tildeConj);
+	}
+	else
+	{
+		// Per-cascade arrays are stored one cascade after the other
+		m_kVectors = new Vec2[m_width * m_height * m_cascadeCount];
+		m_kMag = new float[m_width * m_height * m_cascadeCount];
+
+		m_h0tilde = new Vec2[m_width * m_height * m_cascadeCount];
+		m_h0tildeConj = new Vec2[m_width * m_height * m_cascadeCount];
+	}
+}
+
 void FFTWrapper::Generate_Heightmap()
 {
+	// A seed of 0 is a new ocean every launch, which is never worth caching
+	const bool cacheable = m_spectrumCacheEnabled && m_seed != 0;
+	uint64_t bytes[SpectrumCache::kMaxArrays];
+	Spectrum_Array_Bytes(bytes);
+
+	std::unique_ptr<SpectrumCache> cache;
+	if (cacheable)
+		cache = SpectrumCache::Open(Spectrum_Cache_Key(), bytes);
+
+	// A new spectrum replaces any sea state change in progress
+	m_rebuildStage = kRebuildIdle;
+	m_rebuildProgress.store(1.0f, std::memory_order_relaxed);
+
 	// Initialisation of the model
-	Fill_K_Vectors();
-	Fill_h0tilde();
+	const bool cached = (cache != nullptr);
+	Attach_Spectrum_Arrays(std::move(cache));
+
+	if (!cached)
+	{
+		Fill_K_Vectors();
+		Fill_h0tilde();
+
+		const void* const arrays[SpectrumCache::kMaxArrays] = { m_kVectors, m_kMag, m_h0tilde, m_h0tildeConj };
+		if (cacheable && !SpectrumCache::Write(Spectrum_Cache_Key(), arrays, bytes))
+			debugF("FFTWrapper: could not write the spectrum cache.\n");
+	}
+	else
+	{
+		for (uint32_t c(0); c < m_cascadeCount; ++c)
+			m_spectrumShape[c] = MakeSpectrumShape(m_seaState, sqr(kfTwoPi / m_patchSize[c]), sqr(kfTwoPi / m_patchSize[0]), m_width);
+	}
 
-#if defined(CPU_NORM_CD) | defined(CPU_NORM_FFT)
-	Precalculate_Sinusoids();
-#endif // CPU_NORM_CD | CPU_NORM_FFT
+	Fill_Spectrum_SoA();
+	Prune_Spectrum(false);
 
+	// Every instance can be advanced on the CPU, whatever the configuration
+	Precalculate_Rotors();
+}
+
+void FFTWrapper::Advance_Frame(const float& choppy, const float& heightAdj, const float& foamInt)
+{
+	// One time step of the CPU simulation, from htilde to both textures
+	Update_Spectrum();
+	Fill_htilde_and_Displacements();
+	IFFT_Thread();
+
+	if (m_normals == kNormalsFFT)
+	{
+		Fill_Texture();
+		Fill_Normals_FFT(choppy, foamInt);
+	}
+	else
+	{
+		Fill_Texture_and_Normals_Central_Diff(choppy, heightAdj, foamInt);
+	}
 }
 
 void FFTWrapper::IFFT_Thread()
@@ -375,7 +1434,9 @@ void FFTWrapper::IFFT_Thread()
 	// Parallel IFFT execution for the calculation 
 	// of the heightmap and the horizontal displacement 
 
-	fftwf_execute(m_plan[0]);
-	fftwf_execute(m_plan[1]);
-	fftwf_execute(m_plan[2]);
+	for (int p(0); p < kMaxFields; ++p)
+	{
+		if (m_plan[p])
+			Execute_Plan(p);
+	}
 }
@@ -1,20 +1,28 @@
 #pragma once
 
 // Import the header.
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cmath>
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <omp.h>
 
 #include "Configurations.h"
 #include "hr_time.h"
-
-#include "fftw3.h"
-#pragma comment(lib, "libfftw3f-3.lib")
+#include "SpectrumKernels.h"
+#include "GridKernels.h"
+#include "FFTBackend.h"
+#include "TexturePacking.h"
+#include "SpectrumModels.h"
+#include "SpectrumCache.h"
 
 struct Vec2
 {
@@ -22,90 +30,434 @@ struct Vec2
 	float y;
 };
 
-class FFTWrapper
+// Fields of the IFFT buffers. Packed modes keep Z in the imaginary part
+// of the X field, so kFieldDispZ and kFieldSlopeZ only exist as outputs.
+enum FFTField
 {
+	kFieldHeight,
+	kFieldDispX,
+	kFieldDispZ,
+	kFieldSlopeX,
+	kFieldSlopeZ,
+	kMaxFields
+};
 
-// Singleton Pattern
-public:
-	static FFTWrapper& getInstance(const int& gridsize)
-	{
-		static FFTWrapper instance(gridsize);
-		return instance;
-	}
-
-private:
-	FFTWrapper(const int& gridsize);
+// Where the normal map comes from. FFT normals transform the slopes,
+// which needs more fields than central difference.
+enum NormalsSource
+{
+	kNormalsCentralDiff,
+	kNormalsFFT
+};
 
+// One ocean simulation. Any number of instances can live side by side,
+// and instances of the same grid size share their FFTW plans.
+// The IFFTs run on the given backend, or on one that handles the grid size.
+class FFTWrapper
+{
 public:
+	FFTWrapper(const int& gridsize, const PlannerPolicy& policy = FFT_PLANNER_POLICY, const int& threads = CPU_THREADS,
+		const int& cascades = OCEAN_CASCADES, const NormalsSource& normals = kNormalsCentralDiff,
+		const FFTBackendKind& backend = FFT_BACKEND);
+
 	FFTWrapper(FFTWrapper const&) = delete; // Don't Implement
 	void operator=(FFTWrapper const&) = delete;   // Don't Implement
 	FFTWrapper() = delete;	// Don't Implement
 
 	~FFTWrapper();	
 
+	// Most cascades an instance can simulate
+	static const unsigned int kMaxCascades = 4;
+
+	// Output textures of one frame. The wrapper fills the set it holds, which
+	// can be exchanged for another set to keep a finished frame around.
+	struct TextureSet
+	{
+		float* image = nullptr;				// RGBA32F heightmap, always filled
+		float* normal = nullptr;			// RGBA32F normal map, always filled
+		uint16_t* imagePacked = nullptr;	// Upload copies in the smaller formats
+		uint16_t* normalPacked = nullptr;
+		uint8_t* foamPacked = nullptr;
+		float dispScale[kMaxCascades][3] = {};	// Displacement range of the packed heightmap
+	};
+
 // Variables and Constants
 private:
 	// Constants
 	const float kfPi = 3.1415926f;
 	const float kfTwoPi = 6.283185307f;
 	const float kfGravity = 9.81f;
-	const float kfWorldUnit = 200;	
+	const float kfOneOverRoot2 = 0.707106781f;
+	const float kfWorldUnit = 200;		// Patch size of the first cascade
 
 	const unsigned int m_width;
 	const unsigned int m_height;
+	const unsigned int m_specWidth;		// Columns of the IFFT input, m_width / 2 + 1 for c2r
+	const bool m_realOutput;			// Complex-to-real IFFTs
 	const unsigned int m_pngChannels = 4;
 
-	// Philips Spectrum presets
-	Vec2 m_windNormal = { 1, 0 };
-	float m_windSpeed = 26.0f;
-	float m_amplitude = 20.0f;
-
-	// Arrays used in initialisation
-	Vec2* m_kVectors;
-	float* m_kMag;
-
-	Vec2* m_h0tilde;
-	Vec2* m_h0tildeConj;
-
-	// FFT input and output arrays
-	fftwf_complex* m_FFTin[3];
-	fftwf_complex* m_FFTout[3];
-
-	// FFT plans
-	fftwf_plan m_plan[3];
-
-	// Sinusoids precalculation
-	int* m_cosLookup;
-	int* m_sinLookup;
-	std::vector<float>* m_cosPrecalc;
-	std::vector<float>* m_sinPrecalc;
+	// Cascades, from the largest patch to the smallest. Every cascade has
+	// its own band of wavenumbers and its own slice of every FFT field and
+	// output texture.
+	const float kfCascadeScale = 4.0f;		// Patch size ratio of neighbouring cascades
+	const float kfCascadeSplit = 0.5f;		// Band edges, as a fraction of the larger patch's Nyquist wavenumber
+	const unsigned int m_cascadeCount;
+	float m_patchSize[kMaxCascades];
+
+	// Sea state, and the spectrum it gives every cascade
+	SeaState m_seaState;
+	SpectrumShape m_spectrumShape[kMaxCascades];
+	uint32_t m_seed = 0;			// 0 is replaced by a seed from std::random_device
+
+	// Runtime sea state changes. The new h0 is built a few rows per frame
+	// next to the active one, then the spectrum kernels cross-fade from the
+	// active h0 to the new one, which finally takes its place.
+	enum RebuildStage
+	{
+		kRebuildIdle,
+		kRebuildSpectrum,		// Rows of h0tilde, and of h0tildeConj if it has its own random numbers
+		kRebuildConjugate,		// Rows of the Hermitian h0tildeConj, once every h0tilde row is there
+		kRebuildFade
+	};
+
+	const unsigned int kRebuildChunkBins = 64 * 1024;		// Bins rebuilt per frame
+	RebuildStage m_rebuildStage = kRebuildIdle;
+	SeaState m_targetState;
+	SpectrumShape m_targetShape[kMaxCascades];
+	Vec2* m_h0target = nullptr;
+	Vec2* m_h0targetConj = nullptr;
+	uint32_t m_rebuildRow = 0;
+	uint32_t m_fadeFrame = 0;
+	uint32_t m_fadeFrames = 0;
+	uint32_t m_spectrumVersion = 0;
+	std::atomic<float> m_rebuildProgress{ 1.0f };		// Read by the render thread when a worker simulates
+
+	// Arrays used in initialisation, allocated by Generate_Heightmap unless they
+	// point into the spectrum cache. So can the rebuild target, once a sea
+	// state change has swapped it with h0tilde.
+	Vec2* m_kVectors = nullptr;
+	float* m_kMag = nullptr;
+
+	Vec2* m_h0tilde = nullptr;
+	Vec2* m_h0tildeConj = nullptr;
+
+	// Mapped file the initialisation arrays of a fixed seed come from
+	bool m_spectrumCacheEnabled = OCEAN_SPECTRUM_CACHE;
+	std::unique_ptr<SpectrumCache> m_spectrumCache;
+
+	// FFT input and output arrays, indexed by FFTField. Every field
+	// lives in one allocation, in the order given by m_fields.
+	FFTField m_fields[kMaxFields];
+	unsigned int m_fieldCount;
+	fftwf_complex* m_FFTin[kMaxFields];
+	fftwf_complex* m_FFTout[kMaxFields];
+
+	// Real part of every IFFT output, read with m_outStride
+	float* m_FFTreal[kMaxFields];
+	unsigned int m_outStride;
+
+	// Per-texel output passes specialised for this grid size
+	GridKernels m_gridKernels;
+	OutputFields m_outputs;
+
+	// IFFT outputs of one cascade
+	inline OutputFields Cascade_Outputs(const uint32_t& cascade)
+	{
+		const uint32_t offset = cascade * m_width * m_height * m_outStride;
+		return { m_outputs.height + offset, m_outputs.dispX + offset, m_outputs.dispZ + offset,
+			m_outputs.slopeX + offset, m_outputs.slopeZ + offset };
+	}
 
-	// Textures in array form
-	float* pImageOut;
-	float* pNormalOut;
+	// Normals FFTs. The slopes get their own fields when they are batched
+	// with the other fields, otherwise they reuse the displacement fields
+	// after the displacements have been read. Separate c2r IFFTs overwrite
+	// their input, so htilde is kept for the normals FFTs.
+	const NormalsSource m_normals;
+	bool m_batchedSlopes;
+	bool m_saveHtilde;
+	fftwf_complex* m_htildeSaved = nullptr;
+
+	// FFT backend, which also allocates the IFFT buffers
+	FFTBackend* m_backend;
+
+	// FFT plans, one per field or a single batched plan. They may have been
+	// planned by another instance, so they are only run with Execute_Plan.
+	std::shared_ptr<FFTPlan> m_plan[kMaxFields];
+	int m_planThreads;				// Backend threads the plans were made with
+
+	// Planning
+	const PlannerPolicy m_plannerPolicy;
+	double m_planningTime = 0;		// Seconds spent creating the plans
+	double m_planFlops = 0;			// The backend's flop count for one frame of IFFTs
+
+	// Threading of the per-frame passes. Every thread gets one contiguous
+	// band of rows or bins, with band edges on cache line boundaries so
+	// no two threads write to the same line.
+	const unsigned int kCacheLineSize = 64;
+	int m_threadCount;
+
+	// Rolling window of FFT output rows for the fused output pass, two rows
+	// of height, X and Z displacement per thread
+	const unsigned int kWindowRows = 2;
+	float* m_rowWindow = nullptr;
+
+	// Per-frame spectrum data in IFFT input order, including the phase rotors
+	// exp(i * omegaK * t) and the per-frame step exp(i * omegaK * m_timeStep)
+	float m_timeStep = 0.05f;
+	float m_loopPeriod = 0;			// The waves repeat over this many seconds, 0 leaves the dispersion as it is
+	const unsigned int kRotorRenormFrames = 256;
+	unsigned int m_rotorFrame = 0;
+	double m_time = 0;				// Simulated time of the last frame
+	SpectrumSoA m_spectrum;
+
+	// IFFT inputs filled by the spectrum kernels every frame
+	SpectrumFields m_spectrumFields;
+	SimdLevel m_simdLevel;
+
+	// Energy pruning. The columns of the IFFT input whose waves together carry
+	// no more than m_pruneEnergy of a cascade's variance are left at zero. The
+	// spectrum kernels only walk the live spans of the rows, and the backends
+	// that can skip zero columns in their first pass are told which ones are.
+	struct BinSpan
+	{
+		uint32_t begin;
+		uint32_t end;
+		uint32_t offset;	// Bins in the spans before this one
+	};
+
+	float m_pruneEnergy = OCEAN_PRUNE_ENERGY;		// Negative keeps every column
+	std::vector<BinSpan> m_liveSpans;
+	std::vector<BinSpan> m_deadSpans;
+	uint32_t m_liveBins = 0;
+	uint32_t m_deadBins = 0;
+	std::vector<uint8_t> m_zeroColumns;		// One flag per input column of every transform, in plan order
+	bool m_clearDeadBins = false;			// The plans may write over the zero columns of their input
+	double m_deadTime = 0;					// Simulated since the rotors of the dead bins last turned
+	std::atomic<float> m_liveFraction{ 1.0f };		// Read by the render thread when a worker simulates
+
+	// Textures in array form, one slice per cascade
+	TextureSet m_textures;
+
+	// Upload copies of the textures in the smaller formats, RGBA16F or RGBA16
+	// UNORM for the heightmap, RGBA16F or RG16 SNORM for the normal map and R8
+	// UNORM for the foam. They are packed in chunks of rows right after the
+	// float texels, while those are still in cache, so the float textures
+	// don't have to be read back from memory.
+	const unsigned int kPackChunkBytes = 64 * 1024;
+	const float kfDispHeadroom = 1.25f;		// Quantisation range over the peak displacement of the last frame
+	TextureFormat m_textureFormat = kTextureRGBA32F;
+
+	// Quantisation range of every displacement channel of every cascade for
+	// the next frame, and the peaks of this one
+	float m_dispNext[kMaxCascades][3];
+	float m_dispPeak[kMaxCascades][3];
 
 // Getter Methods
 public:
-	inline const int& getWidth() { return m_width; }
-	inline const int& getHeight() { return m_height; }
+	inline const unsigned int& getWidth() { return m_width; }
+	inline const unsigned int& getHeight() { return m_height; }
+	inline const unsigned int& getSpectrumWidth() { return m_specWidth; }
 
 	inline float* getKMag() { return m_kMag; }
 	inline Vec2* getH0Tilde() { return m_h0tilde; }
 	inline Vec2* getH0TildeConj() { return m_h0tildeConj; }
-	inline float* getImageOut() { return pImageOut; }
-	inline float* getNormalOut() { return pNormalOut; }
+	inline float* getImageOut(const unsigned int& cascade = 0) { return m_textures.image + cascade * m_width * m_height * 4; }
+	inline float* getNormalOut(const unsigned int& cascade = 0) { return m_textures.normal + cascade * m_width * m_height * 4; }
+	inline unsigned int getCascadeCount() { return m_cascadeCount; }
+	inline float getPatchSize(const unsigned int& cascade) { return m_patchSize[cascade]; }
 	inline fftwf_complex* getFFTin(const int& index) { return m_FFTin[index]; }
+	inline double getPlanningTime() { return m_planningTime; }
+	inline double getPlanFlops() { return m_planFlops; }
+	inline SimdLevel getSimdLevel() { return m_simdLevel; }
+	inline int getThreadCount() { return m_threadCount; }
+	inline NormalsSource getNormalsSource() { return m_normals; }
+	inline float getTimeStep() { return m_timeStep; }
+	inline double getTime() { return m_time; }
+	inline FFTBackendKind getFFTBackend() { return m_backend->Kind(); }
+	inline TextureFormat getTextureFormat() { return m_textureFormat; }
+	inline float getLiveBinFraction() { return m_liveFraction.load(std::memory_order_relaxed); }
+	inline const TextureSet& getTextures() { return m_textures; }
+
+	// Texels to upload in the texture format, from the wrapper's own set or one exchanged
+	// out of it. The foam mask only exists in the packed format.
+	const void* getImageTexels(const TextureSet& set, const unsigned int& cascade = 0);
+	const void* getNormalTexels(const TextureSet& set, const unsigned int& cascade = 0);
+	const uint8_t* getFoamTexels(const TextureSet& set, const unsigned int& cascade = 0);
+	inline const void* getImageTexels(const unsigned int& cascade = 0) { return getImageTexels(m_textures, cascade); }
+	inline const void* getNormalTexels(const unsigned int& cascade = 0) { return getNormalTexels(m_textures, cascade); }
+	inline const uint8_t* getFoamTexels(const unsigned int& cascade = 0) { return getFoamTexels(m_textures, cascade); }
+	unsigned int getImageTexelBytes();
+	unsigned int getNormalTexelBytes();
+
+	// Displacement = texel * mul + add, per channel
+	void getDisplacementDecode(const TextureSet& set, float mul[3], float add[3], const unsigned int& cascade = 0);
+	inline void getDisplacementDecode(float mul[3], float add[3], const unsigned int& cascade = 0) { getDisplacementDecode(m_textures, mul, add, cascade); }
+
+	// Upload format of both textures, the float textures are always filled.
+	// Sets allocated before a change of format can't be exchanged any more.
+	void setTextureFormat(const TextureFormat& format);
+
+	// Sets in the current texture format. The wrapper keeps filling whichever
+	// set it was given last, and frees the one it holds.
+	void Allocate_Texture_Set(TextureSet& set);
+	static void Free_Texture_Set(TextureSet& set);
+	inline void Exchange_Textures(TextureSet& set) { std::swap(m_textures, set); }
+
+	// Only the per-frame passes follow this, the plans keep the thread count they were made with
+	void setThreadCount(const int& threads);
+
+	// Simulated time per frame, the timescale of the CPU paths
+	void setTimeStep(const float& timeStep);
+
+	// Turns every wave to where it is time seconds after the start, so the
+	// next frame is at time plus one time step. Instances with the same seed
+	// and sea state land on the same frame, whatever they simulated before.
+	void Set_Time(const double& time);
+
+	// Sea state and loop period, used by the next Generate_Heightmap. Patch sizes have to decrease with the cascade.
+	inline void setPatchSize(const unsigned int& cascade, const float& size) { m_patchSize[cascade] = size; }
+	inline void setSeed(const uint32_t& seed) { m_seed = seed; }
+	inline void setPruneEnergy(const float& fraction) { m_pruneEnergy = fraction; }
+	inline void setLoopPeriod(const float& period) { m_loopPeriod = period; }
+	inline float getLoopPeriod() { return m_loopPeriod; }
+	inline uint32_t getSeed() { return m_seed; }
+	inline void setSpectrumCache(const bool& enabled) { m_spectrumCacheEnabled = enabled; }
+	inline bool isSpectrumCached() { return m_spectrumCache != nullptr; }
+	inline void setAmplitude(const float& amplitude) { m_seaState.amplitude = amplitude; }
+	void setWind(const Vec2& direction, const float& speed);
+	void setSeaState(const SeaState& state);
+	inline const SeaState& getSeaState() { return m_seaState; }
+
+	// Starts changing to a new sea state without stalling a frame. Advance_Frame
+	// rebuilds the spectrum a chunk of rows at a time, then fades to it over
+	// fadeFrames frames. The seed stays, so the waves keep their phases and
+	// only change in height. A request during a fade starts from the current
+	// blend, and Generate_Heightmap cancels the change.
+	void Request_Sea_State(const SeaState& state, const uint32_t& fadeFrames);
+
+	// One frame of a sea state change, called by Advance_Frame
+	void Update_Spectrum();
+
+	// 1 once the last change is done
+	inline float getRebuildProgress() { return m_rebuildProgress.load(std::memory_order_relaxed); }
+
+	// Changes whenever a sea state change has replaced h0tilde and h0tildeConj
+	inline uint32_t getSpectrumVersion() { return m_spectrumVersion; }
+
+// FFT Planning
+private:
+	// IFFT output array of field p, real for c2r
+	inline void* IFFT_Output(const int& p) { return m_realOutput ? (void*)m_FFTreal[p] : (void*)m_FFTout[p]; }
+
+	void Report_Plans();
+	void Acquire_Plans();
+	void Release_Plans();
+	void Execute_Plan(const int& p);
+
+// Threading
+private:
+	void Band_Range(const int& band, const int& bandCount, const uint32_t& count, const uint32_t& align, uint32_t& begin, uint32_t& end);
+
+	// Calls kernel(begin, end) on the calling thread's band of the bins in spans
+	template <class Kernel> void For_Span_Band(const std::vector<BinSpan>& spans, const uint32_t& bins, Kernel kernel)
+	{
+		uint32_t begin, end;
+		Band_Range(omp_get_thread_num(), omp_get_num_threads(), bins, kCacheLineSize / sizeof(float), begin, end);
+
+		// First span that ends after begin
+		auto span = std::upper_bound(spans.begin(), spans.end(), begin,
+			[](const uint32_t& bin, const BinSpan& s) { return bin < s.offset + (s.end - s.begin); });
+
+		for (; span != spans.end() && span->offset < end; ++span)
+		{
+			const uint32_t first = std::max(begin, span->offset) - span->offset;
+			const uint32_t last = std::min(end, span->offset + (span->end - span->begin)) - span->offset;
+			kernel(span->begin + first, span->begin + last);
+		}
+	}
+
+// Energy pruning
+private:
+	// Live and dead spans from the column energies of h0tilde, and of the
+	// rebuild target as well while it fades in
+	void Prune_Spectrum(const bool& withTarget);
+
+	// Zeroes the dead bins of the non-null fields, when the plans may have
+	// written over them. Called by every thread of a parallel region.
+	void Clear_Dead_Bins(const SpectrumFields& fields);
+
+// Texture packing
+private:
+	// Rows of one texture that fit in a packing chunk, or every row when nothing is packed
+	uint32_t Pack_Chunk_Rows();
+
+	// Rows [rowBegin, rowEnd) of one cascade. The image merges its peak displacements into peak.
+	void Pack_Image_Rows(const uint32_t& cascade, const uint32_t& rowBegin, const uint32_t& rowEnd, float peak[3]);
+	void Pack_Normal_Rows(const uint32_t& cascade, const uint32_t& rowBegin, const uint32_t& rowEnd);
+
+	// Displacement ranges of the packed heightmap. Every thread merges its peaks,
+	// and the slices that clipped are packed again after the parallel pass.
+	void Begin_Image_Packing();
+	void Merge_Displacement_Peaks(const float peak[kMaxCascades][3]);
+	void Finish_Image_Packing();
+
+// Spectrum cache
+private:
+	SpectrumCacheKey Spectrum_Cache_Key();
+	void Spectrum_Array_Bytes(uint64_t bytes[SpectrumCache::kMaxArrays]);
+
+	// Points the initialisation arrays into cache, or at storage of their own
+	// when it is null. Any array of the previous cache is let go of.
+	void Attach_Spectrum_Arrays(std::unique_ptr<SpectrumCache> cache);
+
+	template <class T> void Free_Spectrum_Array(T*& array)
+	{
+		if (!m_spectrumCache || !m_spectrumCache->Contains(array))
+			delete[] array;
+		array = nullptr;
+	}
 
 // FFT Methods
 public:
-	// Initialisation
+	// Initialisation, from the spectrum cache when the seed is fixed and there
+	// is a cache for the sea state, which is written otherwise
 	void Generate_Heightmap();
 
 	// Model initialisation functions
-	float Philips_Spectrum(const Vec2& vK, float& kMag);
+	float Cascade_Weight(const uint32_t& cascade, const float& kMag);
 	void Fill_K_Vectors();
 	void Fill_h0tilde();
-	void Precalculate_Sinusoids();
+
+	// Spectrum of count bins of a cascade from bin n on, and of their
+	// opposite wavenumbers if opposite isn't null
+	void Evaluate_Spectrum(const SpectrumShape& shape, const uint32_t& cascade, const uint32_t& n, const uint32_t& count,
+		float* variance, float* opposite);
+
+	// Rows [rowBegin, rowEnd) of every cascade's rows, of h0tilde from the
+	// shapes, and of the Hermitian h0tildeConj from a complete h0tilde
+	void Fill_h0tilde_Rows(const SpectrumShape* shapes, Vec2* h0tilde, Vec2* h0tildeConj, const uint32_t& rowBegin, const uint32_t& rowEnd);
+	void Fill_h0tildeConj_Rows(const Vec2* h0tilde, Vec2* h0tildeConj, const uint32_t& rowBegin, const uint32_t& rowEnd);
+
+	// Writes (1 - weight) * active + weight * target h0 into the spectrum kernels' planes
+	void Blend_Spectrum(const float& weight);
+
+	// Initial amplitudes of bin n of a cascade, from the seed, the bin and the
+	// spectrum of k, or of -k for the conjugate
+	Vec2 H0tilde_Bin(const uint32_t& cascade, const uint32_t& n, const float& variance);
+	Vec2 H0tildeConj_Bin(const uint32_t& cascade, const uint32_t& n, const float& opposite);
+	void Fill_Spectrum_SoA();
+	void Precalculate_Rotors();
+	void Precalculate_Steps();
+
+	// omega(k) of the deep water dispersion. Looping waves round it to a
+	// whole number of turns per loop period, so the ocean repeats exactly.
+	double Angular_Frequency(const float& kMag);
+
+	// Index of the bin holding -k
+	inline uint32_t Negative_K_Index(const uint32_t& i, const uint32_t& j)
+	{
+		return ((m_height - j) % m_height) * m_width + (m_width - i) % m_width;
+	}
 
 	// Preparation for IFFT every frame
 	void Fill_htilde_and_Displacements();
@@ -114,6 +466,9 @@ public:
 	// Parallel IFFT execution
 	void IFFT_Thread();
 
+	// Whole CPU time step: htilde, IFFTs and both textures
+	void Advance_Frame(const float& choppy, const float& heightAdj, const float& foamInt);
+
 	// Fill heightmap Texture to feed to GPU
 	void Fill_Texture();
 
@@ -121,6 +476,9 @@ public:
 	void Fill_Normals_FFT(const float& choppy, const float& foamInt);
 	void Fill_Normals_Central_Diff(const float& choppy, const float &heightAdj, const float& foamInt);
 
+	// Fill both textures in a single sweep over the IFFT outputs
+	void Fill_Texture_and_Normals_Central_Diff(const float& choppy, const float &heightAdj, const float& foamInt);
+
 // Maths
 public:
 	inline float magnitude(const fftwf_complex& v)
@@ -169,11 +527,6 @@ public:
 		return{ a.x + b.x , a.y + b.y };
 	}
 
-	inline float randf1()
-	{
-		return (float)rand() / (float)RAND_MAX;
-	}
-
 	inline float clip(float v, float max)
 	{
 		return v < max ? v : max;
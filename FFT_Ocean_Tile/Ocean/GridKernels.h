@@ -0,0 +1,243 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+
+#include "Framework.h"
+
+//================================================================================
+// Per-texel output passes, specialised on the grid size.
+//
+// GridTraits<N> turns the size, the row index math and the wrap into compile
+// time constants for the power-of-two sizes the application ships with, while
+// GridTraits<0> keeps the size at runtime for every other grid. kStride is the
+// distance between real values in the IFFT outputs, 1 for c2r and 2 for c2c.
+//================================================================================
+
+constexpr uint32_t GridLog2(uint32_t n)
+{
+	return (n <= 1) ? 0 : 1 + GridLog2(n >> 1);
+}
+
+template <uint32_t N>
+struct GridTraits
+{
+	static_assert(N >= 16 && (N & (N - 1)) == 0, "Specialised grids have to be powers of two");
+
+	static constexpr uint32_t kShift = GridLog2(N);
+	static constexpr uint32_t kMask = N - 1;
+
+	explicit GridTraits(const uint32_t&) {}
+
+	static constexpr uint32_t Size() { return N; }
+	static constexpr uint32_t Index(const uint32_t& i, const uint32_t& j) { return (j << kShift) + i; }
+	static constexpr uint32_t Next(const uint32_t& i) { return (i + 1) & kMask; }
+};
+
+template <>
+struct GridTraits<0>
+{
+	const uint32_t size;
+
+	explicit GridTraits(const uint32_t& gridsize) : size(gridsize) {}
+
+	uint32_t Size() const { return size; }
+	uint32_t Index(const uint32_t& i, const uint32_t& j) const { return j * size + i; }
+	uint32_t Next(const uint32_t& i) const { return (i == size - 1) ? 0 : i + 1; }
+};
+
+// Real parts of the IFFT outputs the passes read
+struct OutputFields
+{
+	const float* height;
+	const float* dispX;
+	const float* dispZ;
+	const float* slopeX;
+	const float* slopeZ;
+};
+
+//--------------------------------------------------------------------------------------
+// Heightmap texture: X, Y and Z displacement per texel
+//--------------------------------------------------------------------------------------
+template <uint32_t N, uint32_t kStride>
+void FillTextureRows(uint32_t size, const OutputFields& out, float* image, uint32_t rowBegin, uint32_t rowEnd)
+{
+	const GridTraits<N> grid(size);
+	const float oneOverSize = 1.0f / grid.Size();
+
+	for (uint32_t n(grid.Index(0, rowBegin)); n < grid.Index(0, rowEnd); ++n)
+	{
+		image[4 * n + 0] = out.dispX[n * kStride] * oneOverSize;	//X
+		image[4 * n + 1] = out.height[n * kStride] * oneOverSize;	//Y
+		image[4 * n + 2] = out.dispZ[n * kStride] * oneOverSize;	//Z
+		image[4 * n + 3] = 1;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Foam flag from the Jacobian of the horizontal displacement
+//--------------------------------------------------------------------------------------
+template <uint32_t kStride>
+inline float FoamFlag(const OutputFields& out, const uint32_t& n, const uint32_t& nx, const uint32_t& nz, const float& choppy, const float& intensity)
+{
+	const float Jxx = 1 + choppy * (-out.dispX[nx * kStride] + out.dispX[n * kStride]) * intensity;
+	const float Jxy = choppy * (-out.dispZ[nx * kStride] + out.dispZ[n * kStride]) * intensity;
+	const float Jyy = 1 + choppy * (-out.dispZ[nz * kStride] + out.dispZ[n * kStride]) * intensity;
+	const float Jyx = choppy * (-out.dispX[nz * kStride] + out.dispX[n * kStride]) * intensity;
+
+	return ((Jxx * Jyy) - (Jxy * Jyx) < 0) ? 1.0f : 0.0f;
+}
+
+template <uint32_t N, uint32_t kStride>
+void FillFoamRows(uint32_t size, const OutputFields& out, float choppy, float intensity, float* normals, uint32_t rowBegin, uint32_t rowEnd)
+{
+	const GridTraits<N> grid(size);
+	const uint32_t last = grid.Size() - 1;
+
+	for (uint32_t j(rowBegin); j < rowEnd; ++j)
+	{
+		const uint32_t row = grid.Index(0, j);
+		const uint32_t rowNext = grid.Index(0, grid.Next(j));
+
+		// The +x wrap is peeled off the end of the row
+		for (uint32_t i(0); i < last; ++i)
+			normals[4 * (row + i) + 3] = FoamFlag<kStride>(out, row + i, row + i + 1, rowNext + i, choppy, intensity);
+
+		normals[4 * (row + last) + 3] = FoamFlag<kStride>(out, row + last, row, rowNext + last, choppy, intensity);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Normals from the slope IFFTs
+//--------------------------------------------------------------------------------------
+template <uint32_t N, uint32_t kStride>
+void FillSlopeNormalRows(uint32_t size, const OutputFields& out, float* normals, uint32_t rowBegin, uint32_t rowEnd)
+{
+	const GridTraits<N> grid(size);
+
+	for (uint32_t n(grid.Index(0, rowBegin)); n < grid.Index(0, rowEnd); ++n)
+	{
+		normals[4 * n + 0] = out.slopeX[n * kStride];	//X
+		normals[4 * n + 1] = 2500;						//Y
+		normals[4 * n + 2] = out.slopeZ[n * kStride];	//Z
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Heightmap, central difference normals and foam in one sweep. Every IFFT
+// output row is read once into a rolling window of two rows (height, X and Z
+// for the current and the +z row), which needs 6 * size floats.
+//--------------------------------------------------------------------------------------
+template <uint32_t N, uint32_t kStride>
+void FillOutputRowsCentralDiff(uint32_t size, const OutputFields& out, float choppy, float heightAdj, float intensity,
+	float* window, float* image, float* normals, uint32_t rowBegin, uint32_t rowEnd)
+{
+	const GridTraits<N> grid(size);
+	const uint32_t width = grid.Size();
+	const float oneOverSize = 1.0f / grid.Size();
+
+	float* height[2] = { window, window + 3 * width };
+	float* dispX[2] = { height[0] + width, height[1] + width };
+	float* dispZ[2] = { height[0] + 2 * width, height[1] + 2 * width };
+
+	// Gather one row of the IFFT outputs, with the height scaled like the texture
+	auto loadRow = [&](const uint32_t& row, const int& slot)
+	{
+		const uint32_t base = grid.Index(0, row);
+		for (uint32_t i(0); i < width; ++i)
+		{
+			height[slot][i] = out.height[(base + i) * kStride] * oneOverSize;
+			dispX[slot][i] = out.dispX[(base + i) * kStride];
+			dispZ[slot][i] = out.dispZ[(base + i) * kStride];
+		}
+	};
+
+	auto fillTexel = [&](const uint32_t& n, const uint32_t& i, const uint32_t& xNext)
+	{
+		float Jxx, Jyy, Jxy, Jyx, jacobian;
+		float s11, s21, s12;
+		v3 va, vb, normal;
+
+		image[4 * n + 0] = dispX[0][i] * oneOverSize;	//X
+		image[4 * n + 1] = height[0][i];				//Y
+		image[4 * n + 2] = dispZ[0][i] * oneOverSize;	//Z
+		image[4 * n + 3] = 1;
+
+		s11 = heightAdj * height[0][i];
+		s21 = heightAdj * height[0][xNext];
+		s12 = heightAdj * height[1][i];
+
+		Jxx = 1 + choppy * (-dispX[0][xNext] + dispX[0][i]) * intensity;
+		Jxy = choppy * (-dispZ[0][xNext] + dispZ[0][i]) * intensity;
+		Jyy = 1 + choppy * (-dispZ[1][i] + dispZ[0][i]) * intensity;
+		Jyx = choppy * (-dispX[1][i] + dispX[0][i]) * intensity;
+
+		va = v3(2.0f, 0.0f, s21 - s11);
+		va.Normalize();
+
+		vb = v3(0.0f, 2.0f, s12 - s11);
+		vb.Normalize();
+
+		normal = va.Cross(vb);
+		jacobian = (Jxx * Jyy) - (Jxy * Jyx);
+
+		normals[4 * n + 0] = normal.x;	//X
+		normals[4 * n + 1] = normal.z;	//Y (inverted axis)
+		normals[4 * n + 2] = normal.y;	//Z
+		normals[4 * n + 3] = (jacobian < 0) ? 1.0f : 0.0f;
+	};
+
+	if (rowBegin < rowEnd)
+		loadRow(rowBegin, 0);
+
+	for (uint32_t j(rowBegin); j < rowEnd; ++j)
+	{
+		loadRow(grid.Next(j), 1);
+
+		// The +x wrap is peeled off the end of the row
+		const uint32_t row = grid.Index(0, j);
+		for (uint32_t i(0); i < width - 1; ++i)
+			fillTexel(row + i, i, i + 1);
+		fillTexel(row + width - 1, width - 1, 0);
+
+		// The next row becomes the current one
+		std::swap(height[0], height[1]);
+		std::swap(dispX[0], dispX[1]);
+		std::swap(dispZ[0], dispZ[1]);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// One set of passes per grid size, picked once at start-up
+//--------------------------------------------------------------------------------------
+struct GridKernels
+{
+	uint32_t specialisedSize;	// 0 for the runtime-sized fallback
+
+	void(*fillTexture)(uint32_t size, const OutputFields& out, float* image, uint32_t rowBegin, uint32_t rowEnd);
+	void(*fillFoam)(uint32_t size, const OutputFields& out, float choppy, float intensity, float* normals, uint32_t rowBegin, uint32_t rowEnd);
+	void(*fillSlopeNormals)(uint32_t size, const OutputFields& out, float* normals, uint32_t rowBegin, uint32_t rowEnd);
+	void(*fillOutputsCentralDiff)(uint32_t size, const OutputFields& out, float choppy, float heightAdj, float intensity,
+		float* window, float* image, float* normals, uint32_t rowBegin, uint32_t rowEnd);
+};
+
+template <uint32_t N, uint32_t kStride>
+GridKernels MakeGridKernels()
+{
+	return { N,
+		&FillTextureRows<N, kStride>,
+		&FillFoamRows<N, kStride>,
+		&FillSlopeNormalRows<N, kStride>,
+		&FillOutputRowsCentralDiff<N, kStride> };
+}
+
+template <uint32_t kStride>
+GridKernels SelectGridKernels(const uint32_t& size)
+{
+	switch (size)
+	{
+	case 256:	return MakeGridKernels<256, kStride>();
+	case 512:	return MakeGridKernels<512, kStride>();
+	case 1024:	return MakeGridKernels<1024, kStride>();
+	default:	return MakeGridKernels<0, kStride>();
+	}
+}
@@ -0,0 +1,147 @@
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <random>
+
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _MSC_VER
+
+uint64_t Fnv1a(const void* data, const size_t& size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint64_t hash = 0xCBF29CE484222325ull;
+
+	for (size_t b(0); b < size; ++b)
+	{
+		hash ^= bytes[b];
+		hash *= 0x100000001B3ull;
+	}
+
+	return hash;
+}
+
+bool MappedFile::Open(const std::string& path, const bool& copyOnWrite)
+{
+	Close();
+	m_copyOnWrite = copyOnWrite;
+
+#ifdef _MSC_VER
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// The mapping keeps the file open
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		m_mapping = CreateFileMappingA(file, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+		m_fileBytes = m_mapping ? (uint64_t)size.QuadPart : 0;
+	}
+	CloseHandle(file);
+
+	return m_mapping != nullptr;
+#else
+	m_file = open(path.c_str(), O_RDONLY);
+	if (m_file < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(m_file, &status) != 0 || status.st_size <= 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_fileBytes = (uint64_t)status.st_size;
+	return true;
+#endif // _MSC_VER
+}
+
+void MappedFile::Close()
+{
+	Unmap_View();
+
+#ifdef _MSC_VER
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	m_mapping = nullptr;
+#else
+	if (m_file >= 0)
+		close(m_file);
+	m_file = -1;
+#endif // _MSC_VER
+
+	m_fileBytes = 0;
+}
+
+uint8_t* MappedFile::Map_View(const uint64_t& offset, const uint64_t& bytes)
+{
+	Unmap_View();
+
+	if (offset % kViewAlignment != 0 || bytes == 0 || offset + bytes > m_fileBytes || bytes != (size_t)bytes)
+		return nullptr;
+
+#ifdef _MSC_VER
+	if (!m_mapping)
+		return nullptr;
+
+	m_view = (uint8_t*)MapViewOfFile(m_mapping, m_copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ,
+		(DWORD)(offset >> 32), (DWORD)offset, (SIZE_T)bytes);
+#else
+	if (m_file < 0)
+		return nullptr;
+
+	void* view = mmap(nullptr, (size_t)bytes, m_copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, m_file, (off_t)offset);
+	m_view = (view != MAP_FAILED) ? (uint8_t*)view : nullptr;
+#endif // _MSC_VER
+
+	m_viewBytes = m_view ? bytes : 0;
+	return m_view;
+}
+
+void MappedFile::Unmap_View()
+{
+	if (!m_view)
+		return;
+
+#ifdef _MSC_VER
+	UnmapViewOfFile(m_view);
+#else
+	munmap(m_view, (size_t)m_viewBytes);
+#endif // _MSC_VER
+
+	m_view = nullptr;
+	m_viewBytes = 0;
+}
+
+std::string MappedFile::Temporary_Path(const std::string& path)
+{
+	return path + "." + std::to_string(std::random_device()()) + ".tmp";
+}
+
+bool MappedFile::Replace(const std::string& temporary, const std::string& path)
+{
+	// A stale file is replaced in one step, so there is always a whole file at
+	// path. Windows won't replace it while another process has it mapped, in
+	// which case that one is kept.
+#ifdef _MSC_VER
+	if (!MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+#endif // _MSC_VER
+	{
+		std::remove(temporary.c_str());
+		return false;
+	}
+
+	return true;
+}
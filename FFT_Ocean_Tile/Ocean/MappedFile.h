@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// FNV-1a hash of size bytes, for the checksums and names of the mapped files
+uint64_t Fnv1a(const void* data, const size_t& size);
+
+//================================================================================
+// A read-only file, with one view of it mapped into memory at a time. Views
+// of copy-on-write files can be written to, but the writes stay private to
+// the process and never reach the file.
+//
+// Files that don't fit into the address space of an x86 process are mapped
+// a window at a time, with every view replacing the last one.
+//================================================================================
+class MappedFile
+{
+public:
+	// Views start on multiples of this, the allocation granularity of Windows
+	static const uint64_t kViewAlignment = 64 * 1024;
+
+	MappedFile() {}
+	~MappedFile() { Close(); }
+
+	MappedFile(MappedFile const&) = delete; // Don't Implement
+	void operator=(MappedFile const&) = delete;   // Don't Implement
+
+	// False if the file doesn't exist or is empty
+	bool Open(const std::string& path, const bool& copyOnWrite);
+	void Close();
+
+	// bytes from offset on, null if they aren't in the file
+	uint8_t* Map_View(const uint64_t& offset, const uint64_t& bytes);
+	void Unmap_View();
+
+	inline uint64_t getSize() { return m_fileBytes; }
+	inline uint8_t* getView() { return m_view; }
+
+	// Whether p points into the current view
+	inline bool Contains(const void* p)
+	{
+		return (uintptr_t)p >= (uintptr_t)m_view && (uintptr_t)p < (uintptr_t)m_view + m_viewBytes;
+	}
+
+	// Another process can be writing the same file, so every writer gets a
+	// temporary file of its own, which Replace then moves over the file
+	static std::string Temporary_Path(const std::string& path);
+	static bool Replace(const std::string& temporary, const std::string& path);
+
+private:
+#ifdef _MSC_VER
+	void* m_mapping = nullptr;		// HANDLE of the file mapping, which keeps the file open
+#else
+	int m_file = -1;
+#endif // _MSC_VER
+	bool m_copyOnWrite = false;
+	uint64_t m_fileBytes = 0;
+
+	uint8_t* m_view = nullptr;
+	uint64_t m_viewBytes = 0;
+};
@@ -0,0 +1,74 @@
+#include "OceanScheduler.h"
+#include <algorithm>
+
+OceanScheduler::OceanScheduler(const double& budgetMs, const unsigned int& maxLag)
+	:m_budgetMs(budgetMs), m_maxLag(std::max(1u, maxLag))
+{
+}
+
+void OceanScheduler::Add(SimulationPipeline* pPipeline, FFTWrapper* pOcean, const PipelineFrame& frame)
+{
+	m_entries.push_back({ pPipeline, pOcean, frame, 0, 0 });
+}
+
+void OceanScheduler::Remove(FFTWrapper* pOcean)
+{
+	m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(),
+		[pOcean](const Entry& e) { return e.pOcean == pOcean; }), m_entries.end());
+}
+
+void OceanScheduler::setFrame(FFTWrapper* pOcean, const PipelineFrame& frame)
+{
+	for (Entry& e : m_entries)
+	{
+		if (e.pOcean == pOcean)
+			e.frame = frame;
+	}
+}
+
+void OceanScheduler::Update()
+{
+	m_advanced = 0;
+	m_frameMs = 0;
+
+	// Longest waiting first, which makes the order round robin under a tight budget
+	std::stable_sort(m_entries.begin(), m_entries.end(),
+		[](const Entry& a, const Entry& b) { return a.lag > b.lag; });
+
+	CStopWatch timer;
+
+	for (Entry& e : m_entries)
+	{
+		const bool overdue = e.lag + 1 >= m_maxLag;
+		const bool fits = m_frameMs + e.estimateMs <= m_budgetMs;
+
+		if (m_advanced > 0 && !overdue && !fits)
+		{
+			++e.lag;
+			continue;
+		}
+
+		// An ocean that waited is turned to the frame before this one, so the
+		// time step stays the same and its per-frame rotors are never rebuilt.
+		timer.startTimer();
+		if (e.lag > 0)
+			e.pOcean->Set_Time(e.pOcean->getTime() + e.lag * (double)e.frame.timescale);
+		e.pPipeline->Step(*e.pOcean, e.frame);
+		timer.stopTimer();
+
+		const double stepMs = timer.getElapsedTime() * 1000.0;
+		e.estimateMs = (e.estimateMs == 0) ? stepMs : e.estimateMs + kfEstimateBlend * (stepMs - e.estimateMs);
+		e.lag = 0;
+
+		m_frameMs += stepMs;
+		++m_advanced;
+	}
+}
+
+unsigned int OceanScheduler::getLongestWait()
+{
+	unsigned int lag = 0;
+	for (const Entry& e : m_entries)
+		lag = std::max(lag, e.lag);
+	return lag;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+
+#include "SimulationPipeline.h"
+
+//================================================================================
+// Advances several oceans within a per-frame time budget, each by its own
+// SimulationPipeline, so they take the same path as the application's ocean.
+//
+// Every Update advances the most out-of-date instances first and stops once
+// the next one would overrun the budget. At least one instance is advanced
+// per frame, and an instance that has waited m_maxLag frames is advanced
+// regardless of the budget, so no ocean falls more than m_maxLag frames
+// behind. An ocean that waited is turned to the time of the frames it missed
+// and then takes one step of its usual length, so every ocean keeps to the
+// same clock. The instances share FFTW plans and the OpenMP worker threads,
+// and are advanced one after the other, each using the whole pool. Only the CPU configurations run a whole step in Step.
+//================================================================================
+class OceanScheduler
+{
+public:
+	OceanScheduler(const double& budgetMs, const unsigned int& maxLag);
+
+	// The scheduler does not own the instances. Every ocean needs a pipeline
+	// of its own, which keeps track of its sea state.
+	void Add(SimulationPipeline* pPipeline, FFTWrapper* pOcean, const PipelineFrame& frame);
+	void Remove(FFTWrapper* pOcean);
+
+	// Inputs of the ocean's next steps, such as a new sea state
+	void setFrame(FFTWrapper* pOcean, const PipelineFrame& frame);
+
+	// Advance the instances due this frame
+	void Update();
+
+private:
+	struct Entry
+	{
+		SimulationPipeline* pPipeline;
+		FFTWrapper* pOcean;
+		PipelineFrame frame;
+		unsigned int lag;		// Frames since this instance was last advanced
+		double estimateMs;		// Running average of its time step
+	};
+
+	static constexpr double kfEstimateBlend = 0.2;
+
+	std::vector<Entry> m_entries;
+	double m_budgetMs;
+	unsigned int m_maxLag;
+
+	// Statistics of the last Update
+	unsigned int m_advanced = 0;
+	double m_frameMs = 0;
+
+public:
+	inline void setBudget(const double& budgetMs) { m_budgetMs = budgetMs; }
+	inline void setMaxLag(const unsigned int& maxLag) { m_maxLag = maxLag; }
+
+	inline unsigned int getAdvanced() { return m_advanced; }
+	inline double getFrameTime() { return m_frameMs; }
+	unsigned int getLongestWait();
+};
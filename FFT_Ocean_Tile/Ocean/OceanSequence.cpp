@@ -0,0 +1,274 @@
+#include "OceanSequence.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// Debug output of the framework
+void debugF(const char * format, ...);
+
+namespace
+{
+	// Bump whenever the frames are stored differently
+	const uint32_t kOceanSequenceVersion = 1;
+
+	const char kMagic[8] = { 'O', 'C', 'E', 'A', 'N', 'S', 'E', 'Q' };
+	const uint64_t kTexelAlignment = 64;
+
+	// Frames start after the header, on view boundaries
+	const uint64_t kFramesOffset = MappedFile::kViewAlignment;
+
+	// Frames mapped at a time, well within the address space of an x86 process
+	const uint64_t kWindowBytes = 64 * 1024 * 1024;
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t headerBytes;
+		uint32_t width;
+		uint32_t height;
+		uint32_t cascades;
+		uint32_t seed;
+		uint32_t frameCount;
+		float frameTime;
+
+		// Every frame starts with its displacement ranges, followed by the
+		// texels of every cascade
+		uint64_t imageOffset;
+		uint64_t imageBytes;
+		uint64_t normalOffset;
+		uint64_t normalBytes;
+		uint64_t foamOffset;
+		uint64_t foamBytes;
+		uint64_t frameBytes;
+
+		uint64_t fileBytes;
+		uint64_t checksum;		// Of every byte before it
+	};
+
+	typedef float DisplacementRanges[FFTWrapper::kMaxCascades][3];
+
+	inline uint64_t Header_Checksum(const Header& header)
+	{
+		return Fnv1a(&header, offsetof(Header, checksum));
+	}
+
+	inline uint64_t Align_Up(const uint64_t& offset, const uint64_t& alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// Layout of frameCount frames of the packed textures, 8 bytes per heightmap
+	// texel, 4 per normal and 1 per foam flag
+	void Frame_Layout(const uint32_t& width, const uint32_t& height, const uint32_t& cascades, const uint32_t& frameCount, Header& header)
+	{
+		const uint64_t texels = (uint64_t)width * height * cascades;
+
+		header.width = width;
+		header.height = height;
+		header.cascades = cascades;
+		header.frameCount = frameCount;
+
+		header.imageOffset = Align_Up(sizeof(DisplacementRanges), kTexelAlignment);
+		header.imageBytes = texels * 8;
+		header.normalOffset = Align_Up(header.imageOffset + header.imageBytes, kTexelAlignment);
+		header.normalBytes = texels * 4;
+		header.foamOffset = Align_Up(header.normalOffset + header.normalBytes, kTexelAlignment);
+		header.foamBytes = texels;
+		header.frameBytes = Align_Up(header.foamOffset + header.foamBytes, MappedFile::kViewAlignment);
+
+		header.fileBytes = kFramesOffset + frameCount * header.frameBytes;
+	}
+
+	// Pads file with zeroes from position to offset, then writes bytes of data there
+	void Write_At(std::ofstream& file, uint64_t& position, const uint64_t& offset, const void* data, const uint64_t& bytes)
+	{
+		static const char padding[MappedFile::kViewAlignment] = {};
+
+		while (position < offset)
+		{
+			const uint64_t count = std::min(offset - position, (uint64_t)sizeof(padding));
+			file.write(padding, (std::streamsize)count);
+			position += count;
+		}
+
+		file.write((const char*)data, (std::streamsize)bytes);
+		position += bytes;
+	}
+}
+
+std::unique_ptr<OceanSequence> OceanSequence::Open(const std::string& path, const uint32_t& width, const uint32_t& cascades)
+{
+	std::unique_ptr<OceanSequence> sequence(new OceanSequence());
+
+	// Only ever read, playback never writes to the frames
+	MappedFile& file = sequence->m_file;
+	if (!file.Open(path, false) || !file.Map_View(0, std::min(file.getSize(), kFramesOffset)))
+	{
+		debugF("OceanSequence: could not open %s\n", path.c_str());
+		return nullptr;
+	}
+
+	// The layout has to be the one a bake of this size would write
+	Header header;
+	memset(&header, 0, sizeof(header));
+	if (file.getSize() >= sizeof(Header))
+		memcpy(&header, file.getView(), sizeof(Header));
+
+	Header expected = header;
+	Frame_Layout(width, width, cascades, header.frameCount, expected);
+
+	const bool valid = file.getSize() >= sizeof(Header)
+		&& memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+		&& header.version == kOceanSequenceVersion
+		&& header.headerBytes == sizeof(Header)
+		&& header.checksum == Header_Checksum(header)
+		&& header.fileBytes == file.getSize()
+		&& header.frameCount > 0
+		&& header.frameTime > 0;
+
+	if (!valid)
+	{
+		debugF("OceanSequence: %s is damaged, or from another version.\n", path.c_str());
+		return nullptr;
+	}
+
+	if (memcmp(&header, &expected, sizeof(Header)) != 0)
+	{
+		debugF("OceanSequence: %s holds %ux%u frames of %u cascades, not %ux%u of %u.\n", path.c_str(),
+			header.width, header.height, header.cascades, width, width, cascades);
+		return nullptr;
+	}
+
+	sequence->m_frameCount = header.frameCount;
+	sequence->m_frameTime = header.frameTime;
+	sequence->m_seed = header.seed;
+	sequence->m_imageOffset = header.imageOffset;
+	sequence->m_normalOffset = header.normalOffset;
+	sequence->m_foamOffset = header.foamOffset;
+	sequence->m_frameBytes = header.frameBytes;
+	sequence->m_windowCapacity = (uint32_t)std::max<uint64_t>(1, kWindowBytes / header.frameBytes);
+
+	// The header's view is replaced by the first window of frames
+	file.Unmap_View();
+
+	return sequence;
+}
+
+bool OceanSequence::Bake(SimulationPipeline& pipeline, FFTWrapper& wrapper, PipelineFrame frame, const float& period, const std::string& path)
+{
+	if (period <= 0 || frame.timescale <= 0)
+	{
+		debugF("OceanSequence: can't bake %.2f s at a timescale of %.3f.\n", period, frame.timescale);
+		return false;
+	}
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	// A whole number of frames per period, each of them a whole step
+	const uint32_t frameCount = std::max(1u, (uint32_t)(period / frame.timescale + 0.5f));
+	frame.timescale = period / frameCount;
+
+	wrapper.setTextureFormat(kTexturePacked);
+	wrapper.setLoopPeriod(period);
+	wrapper.Generate_Heightmap();
+
+	// Padding is zeroed, it is part of the checksum
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kOceanSequenceVersion;
+	header.headerBytes = sizeof(Header);
+	header.seed = wrapper.getSeed();
+	header.frameTime = frame.timescale;
+	Frame_Layout(wrapper.getWidth(), wrapper.getHeight(), wrapper.getCascadeCount(), frameCount, header);
+	header.checksum = Header_Checksum(header);
+
+	// Frames are written as they are simulated, under a temporary name
+	// so no other process ever maps half a sequence
+	const std::string temporary = MappedFile::Temporary_Path(path);
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		uint64_t position = 0;
+		Write_At(file, position, 0, &header, sizeof(header));
+
+		for (uint32_t f(0); f < frameCount && file.good(); ++f)
+		{
+			pipeline.Step(wrapper, frame);
+
+			const FFTWrapper::TextureSet& set = wrapper.getTextures();
+			const uint64_t frameOffset = kFramesOffset + f * header.frameBytes;
+
+			Write_At(file, position, frameOffset, set.dispScale, sizeof(DisplacementRanges));
+			Write_At(file, position, frameOffset + header.imageOffset, wrapper.getImageTexels(set), header.imageBytes);
+			Write_At(file, position, frameOffset + header.normalOffset, wrapper.getNormalTexels(set), header.normalBytes);
+			Write_At(file, position, frameOffset + header.foamOffset, wrapper.getFoamTexels(set), header.foamBytes);
+		}
+
+		// The last frame is padded to a whole view as well
+		Write_At(file, position, header.fileBytes, nullptr, 0);
+
+		if (!file.good())
+		{
+			file.close();
+			std::remove(temporary.c_str());
+			debugF("OceanSequence: could not write %s\n", temporary.c_str());
+			return false;
+		}
+	}
+
+	if (!MappedFile::Replace(temporary, path))
+	{
+		debugF("OceanSequence: could not replace %s\n", path.c_str());
+		return false;
+	}
+
+	const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	debugF("OceanSequence: baked %u frames of %.3f s into %s, %.1f MB in %.2f s.\n", frameCount, frame.timescale,
+		path.c_str(), header.fileBytes / (1024.0 * 1024.0), elapsed.count());
+
+	return true;
+}
+
+uint32_t OceanSequence::Frame_At(const float& time)
+{
+	const float frame = std::max(0.0f, time / m_frameTime);
+	return std::min((uint32_t)frame, m_frameCount - 1);
+}
+
+FFTWrapper::TextureSet OceanSequence::getFrame(const uint32_t& frame)
+{
+	FFTWrapper::TextureSet set;
+	if (frame >= m_frameCount)
+		return set;
+
+	// Windows of frames start on multiples of their capacity, so playback
+	// moves from one window to the next, and back to the first on a loop
+	if (frame < m_windowFirst || frame >= m_windowFirst + m_windowFrames)
+	{
+		m_windowFirst = frame - frame % m_windowCapacity;
+		m_windowFrames = std::min(m_windowCapacity, m_frameCount - m_windowFirst);
+
+		if (!m_file.Map_View(kFramesOffset + m_windowFirst * m_frameBytes, m_windowFrames * m_frameBytes))
+		{
+			debugF("OceanSequence: could not map frames %u to %u.\n", m_windowFirst, m_windowFirst + m_windowFrames - 1);
+			m_windowFrames = 0;
+			return set;
+		}
+	}
+
+	uint8_t* texels = m_file.getView() + (frame - m_windowFirst) * m_frameBytes;
+	memcpy(set.dispScale, texels, sizeof(DisplacementRanges));
+
+	// The set is only ever read from, so it can point into the read-only view
+	set.imagePacked = (uint16_t*)(texels + m_imageOffset);
+	set.normalPacked = (uint16_t*)(texels + m_normalOffset);
+	set.foamPacked = texels + m_foamOffset;
+
+	return set;
+}
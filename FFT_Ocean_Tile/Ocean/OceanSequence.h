@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "FFTWrapper.h"
+#include "MappedFile.h"
+#include "SimulationPipeline.h"
+
+//================================================================================
+// Frames of an ocean that repeats itself, baked from the CPU simulation over
+// one loop period and played back in place of it. Baking rounds the wave
+// frequencies to whole turns per period and splits the period into a whole
+// number of frames, so the last frame leads on to the first one.
+//
+// The frames are stored in the packed texture format, which is what the
+// simulation would upload, with the displacement range of every frame. Every
+// frame starts on a view boundary, and playback maps a window of frames at a
+// time and hands out textures that point into it, so a frame costs a read
+// from the page cache instead of a time step.
+//================================================================================
+class OceanSequence
+{
+public:
+	OceanSequence(OceanSequence const&) = delete; // Don't Implement
+	void operator=(OceanSequence const&) = delete;   // Don't Implement
+
+	// Maps the sequence at path, null if there is none or its frames aren't
+	// width x width with the given number of cascades
+	static std::unique_ptr<OceanSequence> Open(const std::string& path, const uint32_t& width, const uint32_t& cascades);
+
+	// Simulates one period of frames with the pipeline and writes them to path.
+	// The frame count is the period over the frame's timescale, rounded. The
+	// wrapper is initialised again and is left looping, in the packed format.
+	static bool Bake(SimulationPipeline& pipeline, FFTWrapper& wrapper, PipelineFrame frame, const float& period, const std::string& path);
+
+	inline uint32_t getFrameCount() { return m_frameCount; }
+	inline float getFrameTime() { return m_frameTime; }
+	inline float getPeriod() { return m_frameCount * m_frameTime; }
+	inline uint32_t getSeed() { return m_seed; }
+
+	// Frame on screen at time seconds into the period
+	uint32_t Frame_At(const float& time);
+
+	// Textures of a frame in the packed format, empty if it can't be mapped.
+	// They point into the file, are only to be read, and stay valid until
+	// the next call.
+	FFTWrapper::TextureSet getFrame(const uint32_t& frame);
+
+private:
+	OceanSequence() {}
+
+	MappedFile m_file;
+
+	uint32_t m_frameCount = 0;
+	float m_frameTime = 0;
+	uint32_t m_seed = 0;
+
+	// Layout of a frame, from its first byte
+	uint64_t m_imageOffset = 0;
+	uint64_t m_normalOffset = 0;
+	uint64_t m_foamOffset = 0;
+	uint64_t m_frameBytes = 0;
+
+	// Frames in the current view
+	uint32_t m_windowFirst = 0;
+	uint32_t m_windowFrames = 0;
+	uint32_t m_windowCapacity = 1;
+};
@@ -0,0 +1,527 @@
+#include "OceanSurface.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define KERNEL_TARGET_AVX2
+#else
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif // _MSC_VER
+
+namespace
+{
+	// Everything a query reads
+	struct SurfaceView
+	{
+		const float* current;
+		const float* previous;		// Null without a frame before
+		int32_t mask;				// Width - 1, the grids are powers of two
+		int32_t width;
+		uint32_t cascadeCount;
+		uint32_t iterations;
+		float toleranceSq;			// Squared distance of a converged query from its point
+		float texelsPerMetre[FFTWrapper::kMaxCascades];
+		int32_t offset[FFTWrapper::kMaxCascades];	// First float of every cascade
+		float choppy;				// Both scale the displacement to world units
+		float heightAdj;
+		float oneOverTimeStep;
+	};
+
+	// The four texels around a point, as the first float of each, and where the point is between them
+	struct Cell
+	{
+		int32_t i00, i10, i01, i11;
+		float fu, fv;
+	};
+
+	inline Cell Locate(const SurfaceView& view, const uint32_t& cascade, const float& x, const float& z)
+	{
+		const float u = x * view.texelsPerMetre[cascade];
+		const float v = z * view.texelsPerMetre[cascade];
+		const float u0 = floor(u);
+		const float v0 = floor(v);
+
+		// Negative texels wrap as well, in two's complement
+		const int32_t iu = (int32_t)u0 & view.mask;
+		const int32_t iv = (int32_t)v0 & view.mask;
+		const int32_t row0 = view.offset[cascade] + iv * view.width * 4;
+		const int32_t row1 = view.offset[cascade] + ((iv + 1) & view.mask) * view.width * 4;
+		const int32_t col0 = iu * 4;
+		const int32_t col1 = ((iu + 1) & view.mask) * 4;
+
+		return { row0 + col0, row0 + col1, row1 + col0, row1 + col1, u - u0, v - v0 };
+	}
+
+	inline float Bilerp(const float* texels, const Cell& cell, const int& channel)
+	{
+		const float s0 = texels[cell.i00 + channel] + cell.fu * (texels[cell.i10 + channel] - texels[cell.i00 + channel]);
+		const float s1 = texels[cell.i01 + channel] + cell.fu * (texels[cell.i11 + channel] - texels[cell.i01 + channel]);
+		return s0 + cell.fv * (s1 - s0);
+	}
+
+	// Bilerp, with its derivatives along u and v
+	inline float Bilerp(const float* texels, const Cell& cell, const int& channel, float& du, float& dv)
+	{
+		const float d0 = texels[cell.i10 + channel] - texels[cell.i00 + channel];
+		const float d1 = texels[cell.i11 + channel] - texels[cell.i01 + channel];
+		const float s0 = texels[cell.i00 + channel] + cell.fu * d0;
+		const float s1 = texels[cell.i01 + channel] + cell.fu * d1;
+
+		du = d0 + cell.fv * (d1 - d0);
+		dv = s1 - s0;
+		return s0 + cell.fv * dv;
+	}
+
+	inline void Store(float* array, const uint32_t& q, const float& value)
+	{
+		if (array)
+			array[q] = value;
+	}
+
+	inline void Store(uint8_t* array, const uint32_t& q, const bool& value)
+	{
+		if (array)
+			array[q] = value ? 1 : 0;
+	}
+
+	// Below this the Jacobian of the displaced position is taken as folded
+	const float kfMinJacobian = 1e-3f;
+
+	// The step towards the texel p whose displaced position p - choppy * D(p)
+	// is the query's point, given the residual r of p and the derivatives of
+	// D. A Newton step where the surface doesn't fold, and the fixed-point
+	// step p = x + choppy * D(p) where it does.
+	inline void Newton_Step(const float& choppy, const float& rx, const float& rz,
+		const float& dxX, const float& dzX, const float& dxZ, const float& dzZ, float& stepX, float& stepZ)
+	{
+		const float jxx = 1 - choppy * dxX;
+		const float jxz = -choppy * dzX;
+		const float jzx = -choppy * dxZ;
+		const float jzz = 1 - choppy * dzZ;
+		const float det = jxx * jzz - jxz * jzx;
+
+		if (det > kfMinJacobian)
+		{
+			const float oneOverDet = 1.0f / det;
+			stepX = (jzz * rx - jxz * rz) * oneOverDet;
+			stepZ = (jxx * rz - jzx * rx) * oneOverDet;
+		}
+		else
+		{
+			stepX = rx;
+			stepZ = rz;
+		}
+	}
+
+	void Query_Scalar(const SurfaceView& view, const float* x, const float* z, const uint32_t& begin, const uint32_t& end, const SurfaceBatch& out)
+	{
+		for (uint32_t q(begin); q < end; ++q)
+		{
+			// The texel whose displaced position is (x, z): the surface moves
+			// by -choppy times the displacement, so solve for it by Newton
+			// steps until it lands within the tolerance
+			float px = x[q], pz = z[q];
+			for (uint32_t it(0); it < view.iterations; ++it)
+			{
+				float dispX = 0, dispZ = 0, dxX = 0, dzX = 0, dxZ = 0, dzZ = 0;
+				for (uint32_t c(0); c < view.cascadeCount; ++c)
+				{
+					const Cell cell = Locate(view, c, px, pz);
+					float du, dv;
+
+					dispX += Bilerp(view.current, cell, 0, du, dv);
+					dxX += du * view.texelsPerMetre[c];
+					dzX += dv * view.texelsPerMetre[c];
+
+					dispZ += Bilerp(view.current, cell, 2, du, dv);
+					dxZ += du * view.texelsPerMetre[c];
+					dzZ += dv * view.texelsPerMetre[c];
+				}
+
+				const float rx = px - view.choppy * dispX - x[q];
+				const float rz = pz - view.choppy * dispZ - z[q];
+				if (rx * rx + rz * rz <= view.toleranceSq)
+					break;
+
+				float stepX, stepZ;
+				Newton_Step(view.choppy, rx, rz, dxX, dzX, dxZ, dzZ, stepX, stepZ);
+				px -= stepX;
+				pz -= stepZ;
+			}
+
+			// Displacement of that texel, per metre along X and Z, and its change since the frame before
+			float disp[3] = {}, dx[3] = {}, dz[3] = {}, change[3] = {};
+			for (uint32_t c(0); c < view.cascadeCount; ++c)
+			{
+				const Cell cell = Locate(view, c, px, pz);
+				for (int ch(0); ch < 3; ++ch)
+				{
+					float du, dv;
+					const float value = Bilerp(view.current, cell, ch, du, dv);
+					disp[ch] += value;
+					dx[ch] += du * view.texelsPerMetre[c];
+					dz[ch] += dv * view.texelsPerMetre[c];
+
+					if (view.previous)
+						change[ch] += value - Bilerp(view.previous, cell, ch);
+				}
+			}
+
+			// Tangents of the displaced surface along X and Z, Y up
+			const float tx[3] = { 1 - view.choppy * dx[0], view.heightAdj * dx[1], -view.choppy * dx[2] };
+			const float tz[3] = { -view.choppy * dz[0], view.heightAdj * dz[1], 1 - view.choppy * dz[2] };
+
+			const float nx = tz[1] * tx[2] - tz[2] * tx[1];
+			const float ny = tz[2] * tx[0] - tz[0] * tx[2];
+			const float nz = tz[0] * tx[1] - tz[1] * tx[0];
+			const float oneOverLength = 1.0f / sqrt(nx * nx + ny * ny + nz * nz);
+
+			// Only a texel that lands on the point and doesn't fold gives its surface
+			const float rx = px - view.choppy * disp[0] - x[q];
+			const float rz = pz - view.choppy * disp[2] - z[q];
+			const float jacobian = tx[0] * tz[2] - tz[0] * tx[2];
+			Store(out.converged, q, rx * rx + rz * rz <= view.toleranceSq && jacobian > 0);
+			Store(out.sourceX, q, px);
+			Store(out.sourceZ, q, pz);
+
+			Store(out.height, q, view.heightAdj * disp[1]);
+			Store(out.normalX, q, nx * oneOverLength);
+			Store(out.normalY, q, ny * oneOverLength);
+			Store(out.normalZ, q, nz * oneOverLength);
+			Store(out.velocityX, q, -view.choppy * change[0] * view.oneOverTimeStep);
+			Store(out.velocityY, q, view.heightAdj * change[1] * view.oneOverTimeStep);
+			Store(out.velocityZ, q, -view.choppy * change[2] * view.oneOverTimeStep);
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// AVX2, eight queries at a time. The texels of every corner are gathered,
+	// and the arithmetic is the scalar one, lane by lane.
+	//--------------------------------------------------------------------------------------
+	struct Cell8
+	{
+		__m256i i00, i10, i01, i11;
+		__m256 fu, fv;
+	};
+
+	KERNEL_TARGET_AVX2 static inline Cell8 Locate8(const SurfaceView& view, const uint32_t& cascade, const __m256& x, const __m256& z)
+	{
+		const __m256 scale = _mm256_set1_ps(view.texelsPerMetre[cascade]);
+		const __m256 u = _mm256_mul_ps(x, scale);
+		const __m256 v = _mm256_mul_ps(z, scale);
+		const __m256 u0 = _mm256_floor_ps(u);
+		const __m256 v0 = _mm256_floor_ps(v);
+
+		const __m256i mask = _mm256_set1_epi32(view.mask);
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256i offset = _mm256_set1_epi32(view.offset[cascade]);
+
+		const __m256i iu = _mm256_and_si256(_mm256_cvttps_epi32(u0), mask);
+		const __m256i iv = _mm256_and_si256(_mm256_cvttps_epi32(v0), mask);
+		const __m256i rowFloats = _mm256_set1_epi32(view.width * 4);
+
+		const __m256i row0 = _mm256_add_epi32(offset, _mm256_mullo_epi32(iv, rowFloats));
+		const __m256i row1 = _mm256_add_epi32(offset, _mm256_mullo_epi32(_mm256_and_si256(_mm256_add_epi32(iv, one), mask), rowFloats));
+		const __m256i col0 = _mm256_slli_epi32(iu, 2);
+		const __m256i col1 = _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(iu, one), mask), 2);
+
+		return { _mm256_add_epi32(row0, col0), _mm256_add_epi32(row0, col1), _mm256_add_epi32(row1, col0), _mm256_add_epi32(row1, col1),
+			_mm256_sub_ps(u, u0), _mm256_sub_ps(v, v0) };
+	}
+
+	KERNEL_TARGET_AVX2 static inline __m256 Gather8(const float* texels, const __m256i& index)
+	{
+		return _mm256_i32gather_ps(texels, index, 4);
+	}
+
+	KERNEL_TARGET_AVX2 static inline __m256 Lerp8(const __m256& a, const __m256& b, const __m256& f)
+	{
+		return _mm256_add_ps(a, _mm256_mul_ps(f, _mm256_sub_ps(b, a)));
+	}
+
+	KERNEL_TARGET_AVX2 static inline __m256 Bilerp8(const float* texels, const Cell8& cell)
+	{
+		const __m256 s0 = Lerp8(Gather8(texels, cell.i00), Gather8(texels, cell.i10), cell.fu);
+		const __m256 s1 = Lerp8(Gather8(texels, cell.i01), Gather8(texels, cell.i11), cell.fu);
+		return Lerp8(s0, s1, cell.fv);
+	}
+
+	KERNEL_TARGET_AVX2 static inline __m256 Bilerp8(const float* texels, const Cell8& cell, __m256& du, __m256& dv)
+	{
+		const __m256 f00 = Gather8(texels, cell.i00);
+		const __m256 f01 = Gather8(texels, cell.i01);
+		const __m256 d0 = _mm256_sub_ps(Gather8(texels, cell.i10), f00);
+		const __m256 d1 = _mm256_sub_ps(Gather8(texels, cell.i11), f01);
+		const __m256 s0 = _mm256_add_ps(f00, _mm256_mul_ps(cell.fu, d0));
+		const __m256 s1 = _mm256_add_ps(f01, _mm256_mul_ps(cell.fu, d1));
+
+		du = _mm256_add_ps(d0, _mm256_mul_ps(cell.fv, _mm256_sub_ps(d1, d0)));
+		dv = _mm256_sub_ps(s1, s0);
+		return _mm256_add_ps(s0, _mm256_mul_ps(cell.fv, dv));
+	}
+
+	KERNEL_TARGET_AVX2 static inline void Store8(float* array, const uint32_t& q, const __m256& value)
+	{
+		if (array)
+			_mm256_storeu_ps(array + q, value);
+	}
+
+	KERNEL_TARGET_AVX2 static void Query_AVX2(const SurfaceView& view, const float* x, const float* z, uint32_t& q, const uint32_t& end, const SurfaceBatch& out)
+	{
+		const __m256 choppy = _mm256_set1_ps(view.choppy);
+		const __m256 heightAdj = _mm256_set1_ps(view.heightAdj);
+		const __m256 negChoppy = _mm256_set1_ps(-view.choppy);
+		const __m256 oneOverTimeStep = _mm256_set1_ps(view.oneOverTimeStep);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 toleranceSq = _mm256_set1_ps(view.toleranceSq);
+		const __m256 minJacobian = _mm256_set1_ps(kfMinJacobian);
+
+		for (; q + 8 <= end; q += 8)
+		{
+			const __m256 qx = _mm256_loadu_ps(x + q);
+			const __m256 qz = _mm256_loadu_ps(z + q);
+
+			// Lanes stop stepping once they are within the tolerance
+			__m256 px = qx, pz = qz;
+			__m256 active = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (uint32_t it(0); it < view.iterations; ++it)
+			{
+				__m256 dispX = zero, dispZ = zero, dxX = zero, dzX = zero, dxZ = zero, dzZ = zero;
+				for (uint32_t c(0); c < view.cascadeCount; ++c)
+				{
+					const Cell8 cell = Locate8(view, c, px, pz);
+					const __m256 scale = _mm256_set1_ps(view.texelsPerMetre[c]);
+					__m256 du, dv;
+
+					dispX = _mm256_add_ps(dispX, Bilerp8(view.current, cell, du, dv));
+					dxX = _mm256_add_ps(dxX, _mm256_mul_ps(du, scale));
+					dzX = _mm256_add_ps(dzX, _mm256_mul_ps(dv, scale));
+
+					dispZ = _mm256_add_ps(dispZ, Bilerp8(view.current + 2, cell, du, dv));
+					dxZ = _mm256_add_ps(dxZ, _mm256_mul_ps(du, scale));
+					dzZ = _mm256_add_ps(dzZ, _mm256_mul_ps(dv, scale));
+				}
+
+				const __m256 rx = _mm256_sub_ps(_mm256_sub_ps(px, _mm256_mul_ps(choppy, dispX)), qx);
+				const __m256 rz = _mm256_sub_ps(_mm256_sub_ps(pz, _mm256_mul_ps(choppy, dispZ)), qz);
+				const __m256 distanceSq = _mm256_add_ps(_mm256_mul_ps(rx, rx), _mm256_mul_ps(rz, rz));
+				active = _mm256_and_ps(active, _mm256_cmp_ps(distanceSq, toleranceSq, _CMP_GT_OQ));
+				if (_mm256_movemask_ps(active) == 0)
+					break;
+
+				// Newton_Step, lane by lane
+				const __m256 jxx = _mm256_sub_ps(one, _mm256_mul_ps(choppy, dxX));
+				const __m256 jxz = _mm256_mul_ps(negChoppy, dzX);
+				const __m256 jzx = _mm256_mul_ps(negChoppy, dxZ);
+				const __m256 jzz = _mm256_sub_ps(one, _mm256_mul_ps(choppy, dzZ));
+				const __m256 det = _mm256_sub_ps(_mm256_mul_ps(jxx, jzz), _mm256_mul_ps(jxz, jzx));
+				const __m256 unfolded = _mm256_cmp_ps(det, minJacobian, _CMP_GT_OQ);
+
+				const __m256 oneOverDet = _mm256_div_ps(one, _mm256_blendv_ps(one, det, unfolded));
+				const __m256 newtonX = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(jzz, rx), _mm256_mul_ps(jxz, rz)), oneOverDet);
+				const __m256 newtonZ = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(jxx, rz), _mm256_mul_ps(jzx, rx)), oneOverDet);
+				const __m256 stepX = _mm256_and_ps(active, _mm256_blendv_ps(rx, newtonX, unfolded));
+				const __m256 stepZ = _mm256_and_ps(active, _mm256_blendv_ps(rz, newtonZ, unfolded));
+
+				px = _mm256_sub_ps(px, stepX);
+				pz = _mm256_sub_ps(pz, stepZ);
+			}
+
+			__m256 disp[3], dx[3], dz[3], change[3];
+			for (int ch(0); ch < 3; ++ch)
+				disp[ch] = dx[ch] = dz[ch] = change[ch] = zero;
+
+			for (uint32_t c(0); c < view.cascadeCount; ++c)
+			{
+				const Cell8 cell = Locate8(view, c, px, pz);
+				const __m256 scale = _mm256_set1_ps(view.texelsPerMetre[c]);
+
+				for (int ch(0); ch < 3; ++ch)
+				{
+					__m256 du, dv;
+					const __m256 value = Bilerp8(view.current + ch, cell, du, dv);
+					disp[ch] = _mm256_add_ps(disp[ch], value);
+					dx[ch] = _mm256_add_ps(dx[ch], _mm256_mul_ps(du, scale));
+					dz[ch] = _mm256_add_ps(dz[ch], _mm256_mul_ps(dv, scale));
+
+					if (view.previous)
+						change[ch] = _mm256_add_ps(change[ch], _mm256_sub_ps(value, Bilerp8(view.previous + ch, cell)));
+				}
+			}
+
+			const __m256 tx0 = _mm256_sub_ps(one, _mm256_mul_ps(choppy, dx[0]));
+			const __m256 tx1 = _mm256_mul_ps(heightAdj, dx[1]);
+			const __m256 tx2 = _mm256_mul_ps(negChoppy, dx[2]);
+			const __m256 tz0 = _mm256_mul_ps(negChoppy, dz[0]);
+			const __m256 tz1 = _mm256_mul_ps(heightAdj, dz[1]);
+			const __m256 tz2 = _mm256_sub_ps(one, _mm256_mul_ps(choppy, dz[2]));
+
+			const __m256 nx = _mm256_sub_ps(_mm256_mul_ps(tz1, tx2), _mm256_mul_ps(tz2, tx1));
+			const __m256 ny = _mm256_sub_ps(_mm256_mul_ps(tz2, tx0), _mm256_mul_ps(tz0, tx2));
+			const __m256 nz = _mm256_sub_ps(_mm256_mul_ps(tz0, tx1), _mm256_mul_ps(tz1, tx0));
+			const __m256 oneOverLength = _mm256_div_ps(one, _mm256_sqrt_ps(
+				_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz))));
+
+			if (out.converged)
+			{
+				const __m256 rx = _mm256_sub_ps(_mm256_sub_ps(px, _mm256_mul_ps(choppy, disp[0])), qx);
+				const __m256 rz = _mm256_sub_ps(_mm256_sub_ps(pz, _mm256_mul_ps(choppy, disp[2])), qz);
+				const __m256 distanceSq = _mm256_add_ps(_mm256_mul_ps(rx, rx), _mm256_mul_ps(rz, rz));
+				const __m256 jacobian = _mm256_sub_ps(_mm256_mul_ps(tx0, tz2), _mm256_mul_ps(tz0, tx2));
+				const int converged = _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(distanceSq, toleranceSq, _CMP_LE_OQ),
+					_mm256_cmp_ps(jacobian, zero, _CMP_GT_OQ)));
+
+				for (int lane(0); lane < 8; ++lane)
+					out.converged[q + lane] = (converged >> lane) & 1;
+			}
+
+			Store8(out.sourceX, q, px);
+			Store8(out.sourceZ, q, pz);
+			Store8(out.height, q, _mm256_mul_ps(heightAdj, disp[1]));
+			Store8(out.normalX, q, _mm256_mul_ps(nx, oneOverLength));
+			Store8(out.normalY, q, _mm256_mul_ps(ny, oneOverLength));
+			Store8(out.normalZ, q, _mm256_mul_ps(nz, oneOverLength));
+			Store8(out.velocityX, q, _mm256_mul_ps(_mm256_mul_ps(negChoppy, change[0]), oneOverTimeStep));
+			Store8(out.velocityY, q, _mm256_mul_ps(_mm256_mul_ps(heightAdj, change[1]), oneOverTimeStep));
+			Store8(out.velocityZ, q, _mm256_mul_ps(_mm256_mul_ps(negChoppy, change[2]), oneOverTimeStep));
+		}
+
+		// Avoid the AVX to SSE transition penalty in the scalar tail
+		_mm256_zeroupper();
+	}
+}
+
+void OceanSurface::Update(FFTWrapper& wrapper, const FFTWrapper::TextureSet& set, const float& choppy, const float& heightAdj, const float& timeStep)
+{
+	const uint32_t width = wrapper.getWidth();
+	const uint32_t cascades = wrapper.getCascadeCount();
+	const size_t sliceFloats = (size_t)width * width * 4;
+
+	// A new grid has nothing to take the velocity from
+	if (width != m_width || cascades != m_cascadeCount)
+		Reset();
+
+	m_width = width;
+	m_cascadeCount = cascades;
+	for (uint32_t c(0); c < cascades; ++c)
+		m_patchSize[c] = wrapper.getPatchSize(c);
+
+	m_choppy = choppy;
+	m_heightAdj = heightAdj;
+	m_oneOverTimeStep = (timeStep > 0) ? 1.0f / timeStep : 0.0f;
+
+	// The frame before becomes the older one
+	m_hasPrevious = !m_frames[m_current].empty();
+	m_current ^= 1;
+
+	std::vector<float>& frame = m_frames[m_current];
+	frame.resize(sliceFloats * cascades);
+
+	for (uint32_t c(0); c < cascades; ++c)
+	{
+		float* texels = frame.data() + c * sliceFloats;
+
+		// The float heightmap is filled in every format, but sets played
+		// back from a sequence only hold the packed one
+		if (set.image)
+		{
+			memcpy(texels, set.image + c * sliceFloats, sliceFloats * sizeof(float));
+			continue;
+		}
+
+		const uint16_t* packed = (const uint16_t*)wrapper.getImageTexels(set, c);
+		float mul[3], add[3];
+		wrapper.getDisplacementDecode(set, mul, add, c);
+
+		for (size_t n(0); n < sliceFloats; n += 4)
+		{
+			for (int ch(0); ch < 3; ++ch)
+				texels[n + ch] = packed[n + ch] * (mul[ch] / 65535.0f) + add[ch];
+			texels[n + 3] = 1;
+		}
+	}
+}
+
+void OceanSurface::Reset()
+{
+	m_width = 0;
+	m_cascadeCount = 0;
+	m_hasPrevious = false;
+	m_frames[0].clear();
+	m_frames[1].clear();
+}
+
+SurfaceSample OceanSurface::Query(const float& x, const float& z)
+{
+	SurfaceSample sample;
+	SurfaceBatch out;
+	out.height = &sample.height;
+	out.normalX = &sample.normal[0];
+	out.normalY = &sample.normal[1];
+	out.normalZ = &sample.normal[2];
+	out.velocityX = &sample.velocity[0];
+	out.velocityY = &sample.velocity[1];
+	out.velocityZ = &sample.velocity[2];
+
+	uint8_t converged;
+	out.converged = &converged;
+
+	Query_Batch(&x, &z, 1, out);
+	sample.converged = converged != 0;
+	return sample;
+}
+
+void OceanSurface::Query_Batch(const float* x, const float* z, const uint32_t& count, const SurfaceBatch& out)
+{
+	const bool velocity = out.velocityX || out.velocityY || out.velocityZ;
+
+	// Flat water until the first frame
+	if (!isReady())
+	{
+		for (uint32_t q(0); q < count; ++q)
+		{
+			Store(out.height, q, 0);
+			Store(out.normalX, q, 0);
+			Store(out.normalY, q, 1);
+			Store(out.normalZ, q, 0);
+			Store(out.velocityX, q, 0);
+			Store(out.velocityY, q, 0);
+			Store(out.velocityZ, q, 0);
+			Store(out.converged, q, true);
+			Store(out.sourceX, q, x[q]);
+			Store(out.sourceZ, q, z[q]);
+		}
+		return;
+	}
+
+	SurfaceView view;
+	view.current = m_frames[m_current].data();
+	view.previous = (velocity && m_hasPrevious) ? m_frames[m_current ^ 1].data() : nullptr;
+	view.mask = (int32_t)m_width - 1;
+	view.width = (int32_t)m_width;
+	view.cascadeCount = m_cascadeCount;
+	view.iterations = m_iterations;
+	view.toleranceSq = m_tolerance * m_tolerance;
+	view.oneOverTimeStep = m_oneOverTimeStep;
+
+	// A larger tile scales the waves up with it, so the displacement, and the
+	// height and velocity that come from it, are in world units like the
+	// points. Every cascade keeps its size relative to the first.
+	const float worldScale = getTileSize() / m_patchSize[0];
+	view.choppy = m_choppy * worldScale;
+	view.heightAdj = m_heightAdj * worldScale;
+	for (uint32_t c(0); c < m_cascadeCount; ++c)
+	{
+		view.texelsPerMetre[c] = m_width / (m_patchSize[c] * worldScale);
+		view.offset[c] = (int32_t)(c * m_width * m_width * 4);
+	}
+
+	uint32_t q = 0;
+	if (m_simdLevel == kSimdAVX2)
+		Query_AVX2(view, x, z, q, count, out);
+
+	Query_Scalar(view, x, z, q, count, out);
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "FFTWrapper.h"
+#include "SpectrumKernels.h"
+
+// The surface over one point
+struct SurfaceSample
+{
+	float height;			// m
+	float normal[3];		// Unit length, Y up
+	float velocity[3];		// m/s, of the water at the surface
+	bool converged;			// False where the surface folds or the query ran out of iterations
+};
+
+// Outputs of a batch of queries, one array per component. Null arrays aren't filled.
+struct SurfaceBatch
+{
+	float* height = nullptr;
+	float* normalX = nullptr;
+	float* normalY = nullptr;
+	float* normalZ = nullptr;
+	float* velocityX = nullptr;
+	float* velocityY = nullptr;
+	float* velocityZ = nullptr;
+	uint8_t* converged = nullptr;	// 1 where the query found the texel displaced onto its point
+	float* sourceX = nullptr;		// Where that texel is, before the displacement
+	float* sourceZ = nullptr;
+};
+
+//================================================================================
+// The displaced ocean surface of the latest frame, for gameplay and physics.
+// Every cascade repeats with its patch size, so the first cascade's patch is
+// the tile, scaled to the tile size when the world isn't in simulation metres.
+//
+// Choppy waves move the surface sideways, so the surface over a point comes
+// from a texel somewhere else. Queries find that texel by Newton's method on
+// the displaced position, starting from the point, with the Jacobian of the
+// displacement from the derivatives of the bilinear samples of every cascade.
+// They stop once the texel lands within the tolerance of the point. Where the
+// surface folds over itself the Jacobian is not positive, the step falls back
+// to stepping back by the displacement, and the query is reported as not
+// converged. The normal comes from the derivatives of the same samples, and
+// the velocity from the frame before.
+//
+// Update copies the heightmap, so the wrapper can exchange or refill its
+// textures at once. Queries only read the copies, so any number of threads
+// can run them at the same time between two Updates.
+//================================================================================
+class OceanSurface
+{
+public:
+	// Most Newton steps of the inverse displacement, and how close to the point
+	// in world units the displaced texel has to land
+	static const uint32_t kDefaultIterations = 16;
+	static constexpr float kfDefaultTolerance = 0.001f;
+
+	OceanSurface() :m_simdLevel(DetectSimdLevel()) {}
+
+	OceanSurface(OceanSurface const&) = delete; // Don't Implement
+	void operator=(OceanSurface const&) = delete;   // Don't Implement
+
+	// Takes the heightmap of a frame the wrapper filled, its own set or one
+	// exchanged out of it, in any texture format. choppy and heightAdj scale it
+	// like the ocean shader does, and the frame before it was timeStep earlier.
+	void Update(FFTWrapper& wrapper, const FFTWrapper::TextureSet& set, const float& choppy, const float& heightAdj, const float& timeStep);
+
+	// Forgets the frames, the next Update has no velocity
+	void Reset();
+
+	// The surface over (x, z)
+	SurfaceSample Query(const float& x, const float& z);
+
+	// The surfaces over count points at once, eight at a time with AVX2
+	void Query_Batch(const float* x, const float* z, const uint32_t& count, const SurfaceBatch& out);
+
+	// World units the first cascade's patch spans, 0 for the metres of the
+	// simulation. Rendered tiles can be larger than the patch they sample,
+	// and the waves are scaled with them: heights and velocities come back
+	// in world units.
+	inline void setTileSize(const float& size) { m_tileSize = size; }
+	inline float getTileSize() { return m_tileSize > 0 ? m_tileSize : m_patchSize[0]; }
+
+	inline void setIterations(const uint32_t& iterations) { m_iterations = iterations; }
+	inline uint32_t getIterations() { return m_iterations; }
+	inline void setTolerance(const float& tolerance) { m_tolerance = tolerance; }
+	inline float getTolerance() { return m_tolerance; }
+	inline bool isReady() { return m_width > 0; }
+	inline uint32_t getWidth() { return m_width; }
+
+private:
+	const SimdLevel m_simdLevel;
+	uint32_t m_iterations = kDefaultIterations;
+	float m_tolerance = kfDefaultTolerance;
+	float m_tileSize = 0;
+
+	uint32_t m_width = 0;
+	uint32_t m_cascadeCount = 0;
+	float m_patchSize[FFTWrapper::kMaxCascades] = {};
+
+	// RGBA heightmaps of every cascade, X, Y and Z displacement per texel
+	std::vector<float> m_frames[2];
+	uint32_t m_current = 0;
+	bool m_hasPrevious = false;
+
+	float m_choppy = 0;
+	float m_heightAdj = 0;
+	float m_oneOverTimeStep = 0;
+};
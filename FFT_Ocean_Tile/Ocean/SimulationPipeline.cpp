@@ -0,0 +1,402 @@
+#include "SimulationPipeline.h"
+#include "Framework.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+
+namespace
+{
+	const char* kPipelineNames[kMaxPipelines] = { "gpgpu_norm_cd", "cpu_norm_fft", "cpu_norm_cd" };
+	const char* kPlannerNames[] = { "estimate", "measure", "patient", "exhaustive" };
+
+	std::string Trim(const std::string& text)
+	{
+		const size_t first = text.find_first_not_of(" \t\r\n");
+		if (first == std::string::npos)
+			return std::string();
+
+		return text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+	}
+
+	// False unless the whole text is a number
+	bool Parse_Int(const std::string& text, int& value)
+	{
+		char* end = nullptr;
+		const long parsed = strtol(text.c_str(), &end, 10);
+		if (text.empty() || *end != '\0' || parsed < INT_MIN || parsed > INT_MAX)
+			return false;
+
+		value = (int)parsed;
+		return true;
+	}
+
+	bool Parse_Uint(const std::string& text, uint32_t& value)
+	{
+		// strtoull would take a minus sign and wrap around
+		if (text.empty() || text[0] == '-')
+			return false;
+
+		char* end = nullptr;
+		const unsigned long long parsed = strtoull(text.c_str(), &end, 10);
+		if (*end != '\0' || parsed > UINT32_MAX)
+			return false;
+
+		value = (uint32_t)parsed;
+		return true;
+	}
+
+	bool Parse_Float(const std::string& text, float& value)
+	{
+		char* end = nullptr;
+		const float parsed = strtof(text.c_str(), &end);
+		if (text.empty() || *end != '\0' || !std::isfinite(parsed))
+			return false;
+
+		value = parsed;
+		return true;
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Usage of GPGPU. The compute shaders advance htilde and calculate the normals,
+	// the CPU transforms the htilde of the previous frame into the heightmap.
+	//--------------------------------------------------------------------------------------
+	class GpgpuPipeline : public SimulationPipeline
+	{
+	public:
+		PipelineMode Mode() override { return kPipelineGpgpuNormCD; }
+		bool Uses_GPGPU() override { return true; }
+
+		std::unique_ptr<FFTWrapper> Create_Wrapper(const PipelineSettings& settings) override
+		{
+			// The compute shaders only simulate a single cascade, and only the
+			// heightmap is uploaded, the normal map stays on the GPU. They
+			// fill htilde for every bin, so no column can be pruned.
+			std::unique_ptr<FFTWrapper> wrapper(new FFTWrapper(settings.gridSize, settings.plannerPolicy,
+				settings.threads, 1, kNormalsCentralDiff, settings.backend));
+			wrapper->setTextureFormat(settings.textureFormat);
+			wrapper->setSeed(settings.seed);
+			wrapper->setSpectrumCache(settings.spectrumCache);
+			wrapper->setPruneEnergy(-1.0f);
+			wrapper->setSeaState(settings.seaState);
+			return wrapper;
+		}
+
+		void Step(FFTWrapper& wrapper, const PipelineFrame& frame) override
+		{
+			// The compute shaders read h0 from buffers, which are uploaded
+			// again once a new spectrum has replaced the old one
+			Apply_Sea_State(wrapper, frame, 0);
+			wrapper.Update_Spectrum();
+
+			// Time is advanced by the htilde compute shader
+			wrapper.Fill_Horizontal_Displacement();
+			wrapper.IFFT_Thread();
+			wrapper.Fill_Texture();
+		}
+	};
+
+	//--------------------------------------------------------------------------------------
+	// No usage of GPGPU. The whole time step runs on the CPU, with normals from
+	// either the slope FFTs or central difference.
+	//--------------------------------------------------------------------------------------
+	class CpuPipeline : public SimulationPipeline
+	{
+	public:
+		CpuPipeline(const PipelineMode& mode, const NormalsSource& normals)
+			:m_mode(mode), m_normals(normals) {}
+
+		PipelineMode Mode() override { return m_mode; }
+		bool Uses_GPGPU() override { return false; }
+
+		std::unique_ptr<FFTWrapper> Create_Wrapper(const PipelineSettings& settings) override
+		{
+			std::unique_ptr<FFTWrapper> wrapper(new FFTWrapper(settings.gridSize, settings.plannerPolicy,
+				settings.threads, settings.cascades, m_normals, settings.backend));
+			wrapper->setTextureFormat(settings.textureFormat);
+			wrapper->setSeed(settings.seed);
+			wrapper->setSpectrumCache(settings.spectrumCache);
+			wrapper->setPruneEnergy(settings.pruneEnergy);
+			wrapper->setSeaState(settings.seaState);
+			return wrapper;
+		}
+
+		void Step(FFTWrapper& wrapper, const PipelineFrame& frame) override
+		{
+			Apply_Sea_State(wrapper, frame, SEA_STATE_FADE_FRAMES);
+			wrapper.setTimeStep(frame.timescale);
+			wrapper.Advance_Frame(frame.choppy, frame.heightAdj, frame.foamInt);
+		}
+
+	private:
+		const PipelineMode m_mode;
+		const NormalsSource m_normals;
+	};
+}
+
+void SimulationPipeline::Apply_Sea_State(FFTWrapper& wrapper, const PipelineFrame& frame, const uint32_t& fadeFrames)
+{
+	if (frame.seaStateVersion == m_seaStateVersion)
+		return;
+
+	m_seaStateVersion = frame.seaStateVersion;
+	wrapper.Request_Sea_State(frame.seaState, fadeFrames);
+}
+
+const char* PipelineModeName(const PipelineMode& mode)
+{
+	return (mode >= 0 && mode < kMaxPipelines) ? kPipelineNames[mode] : "unknown";
+}
+
+bool ApplyPipelineSetting(PipelineSettings& settings, const std::string& key, const std::string& value)
+{
+	if (key == "pipeline")
+	{
+		for (int m(0); m < kMaxPipelines; ++m)
+		{
+			if (value == kPipelineNames[m])
+			{
+				settings.mode = (PipelineMode)m;
+				return true;
+			}
+		}
+	}
+	else if (key == "grid")
+	{
+		// The GPGPU path dispatches 4x4 thread groups, and the Hermitian modes need even sizes
+		int size;
+		if (Parse_Int(value, size) && size >= 16 && size <= 4096 && (size & (size - 1)) == 0)
+		{
+			settings.gridSize = size;
+			return true;
+		}
+	}
+	else if (key == "backend")
+	{
+		for (int b(0); b < kMaxBackends; ++b)
+		{
+			if (value == FFTBackendName((FFTBackendKind)b))
+			{
+				settings.backend = (FFTBackendKind)b;
+				return true;
+			}
+		}
+	}
+	else if (key == "planner")
+	{
+		for (int p(0); p <= kPlanExhaustive; ++p)
+		{
+			if (value == kPlannerNames[p])
+			{
+				settings.plannerPolicy = (PlannerPolicy)p;
+				return true;
+			}
+		}
+	}
+	else if (key == "threads")
+	{
+		// 0 uses every hardware thread
+		int threads;
+		if (Parse_Int(value, threads) && threads >= 0)
+		{
+			settings.threads = threads;
+			return true;
+		}
+	}
+	else if (key == "cascades")
+	{
+		int cascades;
+		if (Parse_Int(value, cascades) && cascades >= 1 && cascades <= (int)FFTWrapper::kMaxCascades)
+		{
+			settings.cascades = cascades;
+			return true;
+		}
+	}
+	else if (key == "timescale")
+	{
+		// s per frame
+		float timescale;
+		if (Parse_Float(value, timescale) && timescale > 0)
+		{
+			settings.timescale = timescale;
+			return true;
+		}
+	}
+	else if (key == "async")
+	{
+		if (value == "on" || value == "off")
+		{
+			settings.async = (value == "on");
+			return true;
+		}
+	}
+	else if (key == "seed")
+	{
+		// 0 picks a new seed every launch
+		uint32_t seed;
+		if (Parse_Uint(value, seed))
+		{
+			settings.seed = seed;
+			return true;
+		}
+	}
+	else if (key == "spectrum_cache")
+	{
+		if (value == "on" || value == "off")
+		{
+			settings.spectrumCache = (value == "on");
+			return true;
+		}
+	}
+	else if (key == "spectrum")
+	{
+		for (int m(0); m < kMaxSpectrumModels; ++m)
+		{
+			if (value == SpectrumModelName((SpectrumModel)m))
+			{
+				settings.seaState.model = (SpectrumModel)m;
+				return true;
+			}
+		}
+	}
+	else if (key == "spreading")
+	{
+		for (int s(0); s < kMaxSpreadingFunctions; ++s)
+		{
+			if (value == SpreadingFunctionName((SpreadingFunction)s))
+			{
+				settings.seaState.spreading = (SpreadingFunction)s;
+				return true;
+			}
+		}
+	}
+	else if (key == "wind")
+	{
+		// m/s
+		float wind;
+		if (Parse_Float(value, wind) && wind >= 0.1f)
+		{
+			settings.seaState.windSpeed = wind;
+			return true;
+		}
+	}
+	else if (key == "fetch")
+	{
+		// m
+		float fetch;
+		if (Parse_Float(value, fetch) && fetch >= 1.0f)
+		{
+			settings.seaState.fetch = fetch;
+			return true;
+		}
+	}
+	else if (key == "depth")
+	{
+		// m
+		float depth;
+		if (Parse_Float(value, depth) && depth >= 0.1f)
+		{
+			settings.seaState.depth = depth;
+			return true;
+		}
+	}
+	else if (key == "prune")
+	{
+		// Fraction of the variance, up to a tenth of it
+		float prune;
+		if (value == "off")
+		{
+			settings.pruneEnergy = -1.0f;
+			return true;
+		}
+		else if (Parse_Float(value, prune) && prune >= 0 && prune <= 0.1f)
+		{
+			settings.pruneEnergy = prune;
+			return true;
+		}
+	}
+	else if (key == "sequence")
+	{
+		settings.sequence = value;
+		return true;
+	}
+	else if (key == "bake")
+	{
+		// s
+		float bake;
+		if (Parse_Float(value, bake) && bake >= 0)
+		{
+			settings.bakePeriod = bake;
+			return true;
+		}
+	}
+	else if (key == "textures")
+	{
+		for (int t(0); t < kMaxTextureFormats; ++t)
+		{
+			if (value == TextureFormatName((TextureFormat)t))
+			{
+				settings.textureFormat = (TextureFormat)t;
+				return true;
+			}
+		}
+	}
+
+	debugF("SimulationPipeline: ignoring %s = %s\n", key.c_str(), value.c_str());
+	return false;
+}
+
+bool LoadPipelineSettings(PipelineSettings& settings, const char* path)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		line = line.substr(0, line.find('#'));
+
+		const size_t split = line.find('=');
+		if (split == std::string::npos)
+			continue;
+
+		ApplyPipelineSetting(settings, Trim(line.substr(0, split)), Trim(line.substr(split + 1)));
+	}
+
+	return true;
+}
+
+void ParsePipelineArgs(PipelineSettings& settings, const int& argc, char** argv)
+{
+	for (int a(1); a + 1 < argc; ++a)
+	{
+		if (argv[a][0] != '-')
+			continue;
+
+		const std::string key = argv[a] + (argv[a][1] == '-' ? 2 : 1);
+		const char* value = argv[++a];
+
+		if (key == "config")
+		{
+			if (!LoadPipelineSettings(settings, value))
+				debugF("SimulationPipeline: could not open %s\n", value);
+		}
+		else
+		{
+			ApplyPipelineSetting(settings, key, value);
+		}
+	}
+}
+
+std::unique_ptr<SimulationPipeline> CreatePipeline(const PipelineMode& mode)
+{
+	switch (mode)
+	{
+	case kPipelineCpuNormFFT:	return std::unique_ptr<SimulationPipeline>(new CpuPipeline(mode, kNormalsFFT));
+	case kPipelineCpuNormCD:	return std::unique_ptr<SimulationPipeline>(new CpuPipeline(mode, kNormalsCentralDiff));
+	default:					return std::unique_ptr<SimulationPipeline>(new GpgpuPipeline());
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "Configurations.h"
+#include "FFTWrapper.h"
+
+// Execution configurations, all of them available in the same build
+enum PipelineMode
+{
+	kPipelineGpgpuNormCD,	// Usage of GPGPU, Normals calculated with central difference
+	kPipelineCpuNormFFT,	// No usage of GPGPU, Normals calculated with additional FFTs
+	kPipelineCpuNormCD,		// No usage of GPGPU, Normals calculated with central difference
+	kMaxPipelines
+};
+
+//================================================================================
+// Start-up configuration of the simulation. The defaults come from
+// Configurations.h, then Ocean.cfg and the command line override them:
+//
+//   AppOcean.exe -pipeline cpu_norm_cd -grid 256 -threads 4
+//   AppOcean.exe -config Benchmark.cfg
+//
+// Settings files hold one "key = value" per line, with the command line keys
+// and # comments. Keys: pipeline (gpgpu_norm_cd, cpu_norm_fft, cpu_norm_cd),
+// grid, backend (fftw, stockham), planner (estimate, measure, patient,
+// exhaustive), threads, cascades, timescale, textures (rgba32f, rgba16f,
+// packed), async (on, off), seed, spectrum_cache (on, off), spectrum
+// (phillips, pierson_moskowitz, jonswap, tma), spreading (cos2, cos2s, none),
+// wind, fetch, depth, prune (off, or a fraction of the variance), sequence
+// (a path), bake (seconds).
+//================================================================================
+struct PipelineSettings
+{
+	PipelineMode mode = OCEAN_PIPELINE;
+	int gridSize = SIZE_OF_GRID;
+	FFTBackendKind backend = FFT_BACKEND;
+	PlannerPolicy plannerPolicy = FFT_PLANNER_POLICY;
+	int threads = CPU_THREADS;
+	int cascades = OCEAN_CASCADES;
+	float timescale = OCEAN_TIMESCALE;
+	TextureFormat textureFormat = OCEAN_TEXTURES;
+	bool async = OCEAN_ASYNC;
+	uint32_t seed = OCEAN_SEED;
+	bool spectrumCache = OCEAN_SPECTRUM_CACHE;
+	float pruneEnergy = OCEAN_PRUNE_ENERGY;
+	std::string sequence = OCEAN_SEQUENCE;
+	float bakePeriod = OCEAN_BAKE_PERIOD;
+	SeaState seaState;
+};
+
+// Returns false for unknown keys and invalid values, which leave the settings as they were
+bool ApplyPipelineSetting(PipelineSettings& settings, const std::string& key, const std::string& value);
+
+// Returns false if the file can't be opened
+bool LoadPipelineSettings(PipelineSettings& settings, const char* path);
+
+// "-key value" pairs, where "-config path" loads a settings file in place
+void ParsePipelineArgs(PipelineSettings& settings, const int& argc, char** argv);
+
+const char* PipelineModeName(const PipelineMode& mode);
+
+// Per-frame inputs of the simulation
+struct PipelineFrame
+{
+	float choppy;
+	float heightAdj;
+	float foamInt;
+	float timescale;
+
+	// The wrapper changes to seaState whenever seaStateVersion changes,
+	// version 0 being the sea state the wrapper was created with
+	SeaState seaState;
+	uint32_t seaStateVersion;
+};
+
+//================================================================================
+// CPU side of one execution configuration. The application owns the GPU
+// resources, and runs the compute shaders of the configurations for which
+// Uses_GPGPU is true. Otherwise it only uploads both textures.
+//================================================================================
+class SimulationPipeline
+{
+public:
+	virtual ~SimulationPipeline() {}
+
+	virtual PipelineMode Mode() = 0;
+
+	// htilde and the normal map come from compute shaders
+	virtual bool Uses_GPGPU() = 0;
+
+	// The simulation this configuration needs
+	virtual std::unique_ptr<FFTWrapper> Create_Wrapper(const PipelineSettings& settings) = 0;
+
+	// Leaves a new heightmap, and the normal map on the CPU paths, in the wrapper's textures
+	virtual void Step(FFTWrapper& wrapper, const PipelineFrame& frame) = 0;
+
+protected:
+	// Starts the change to the frame's sea state if it is a new one
+	void Apply_Sea_State(FFTWrapper& wrapper, const PipelineFrame& frame, const uint32_t& fadeFrames);
+
+private:
+	uint32_t m_seaStateVersion = 0;
+};
+
+std::unique_ptr<SimulationPipeline> CreatePipeline(const PipelineMode& mode);
@@ -0,0 +1,139 @@
+#include "SpectrumCache.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+// Debug output of the framework
+void debugF(const char * format, ...);
+
+namespace
+{
+	// Bump whenever the arrays are generated differently
+	const uint32_t kSpectrumCacheVersion = 2;
+
+	const char kMagic[8] = { 'O', 'C', 'E', 'A', 'N', 'S', 'P', 'C' };
+	const uint64_t kArrayAlignment = 64;
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t headerBytes;
+		SpectrumCacheKey key;
+		uint32_t padding;		// Aligns the offsets, so the header has no implicit padding
+		uint64_t offsets[SpectrumCache::kMaxArrays];
+		uint64_t bytes[SpectrumCache::kMaxArrays];
+		uint64_t fileBytes;
+		uint64_t checksum;		// Of every byte before it
+	};
+
+	inline uint64_t Header_Checksum(const Header& header)
+	{
+		return Fnv1a(&header, offsetof(Header, checksum));
+	}
+
+	inline uint64_t Align_Up(const uint64_t& offset)
+	{
+		return (offset + kArrayAlignment - 1) & ~(kArrayAlignment - 1);
+	}
+}
+
+std::string SpectrumCache::Path(const SpectrumCacheKey& key)
+{
+	char hash[17];
+	snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)Fnv1a(&key, sizeof(key)));
+
+	return "ocean_spectrum_v" + std::to_string(kSpectrumCacheVersion)
+		+ "_" + std::to_string(key.width)
+		+ "_" + hash + ".bin";
+}
+
+std::unique_ptr<SpectrumCache> SpectrumCache::Open(const SpectrumCacheKey& key, const uint64_t bytes[kMaxArrays])
+{
+	const std::string path = Path(key);
+
+	std::unique_ptr<SpectrumCache> cache(new SpectrumCache());
+
+	// Copy-on-write views, the file is only ever read
+	MappedFile& file = cache->m_file;
+	if (!file.Open(path, true) || !file.Map_View(0, file.getSize()))
+	{
+		debugF("SpectrumCache: no spectrum cache found, building the spectrum.\n");
+		return nullptr;
+	}
+
+	// Nothing is parsed, the header only has to describe the arrays expected
+	const Header& header = *(const Header*)file.getView();
+	bool valid = file.getSize() >= sizeof(Header)
+		&& memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+		&& header.version == kSpectrumCacheVersion
+		&& header.headerBytes == sizeof(Header)
+		&& header.checksum == Header_Checksum(header)
+		&& header.fileBytes == file.getSize()
+		&& memcmp(&header.key, &key, sizeof(key)) == 0;
+
+	for (int a(0); valid && a < kMaxArrays; ++a)
+	{
+		valid = header.bytes[a] == bytes[a]
+			&& header.offsets[a] % kArrayAlignment == 0
+			&& header.offsets[a] >= sizeof(Header)
+			&& header.offsets[a] + header.bytes[a] <= header.fileBytes;
+
+		cache->m_offsets[a] = header.offsets[a];
+	}
+
+	if (!valid)
+	{
+		debugF("SpectrumCache: %s is stale or damaged, building the spectrum.\n", path.c_str());
+		return nullptr;
+	}
+
+	return cache;
+}
+
+bool SpectrumCache::Write(const SpectrumCacheKey& key, const void* const arrays[kMaxArrays], const uint64_t bytes[kMaxArrays])
+{
+	// The padding is a member of its own and is cleared, it is part of the checksum
+	Header header = {};
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kSpectrumCacheVersion;
+	header.headerBytes = sizeof(Header);
+	header.key = key;
+
+	uint64_t offset = Align_Up(sizeof(Header));
+	for (int a(0); a < kMaxArrays; ++a)
+	{
+		header.offsets[a] = offset;
+		header.bytes[a] = bytes[a];
+		header.fileBytes = offset + bytes[a];
+		offset = Align_Up(header.fileBytes);
+	}
+	header.checksum = Header_Checksum(header);
+
+	const std::string path = Path(key);
+	const std::string temporary = MappedFile::Temporary_Path(path);
+	{
+		const char padding[kArrayAlignment] = {};
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+
+		file.write((const char*)&header, sizeof(header));
+		uint64_t position = sizeof(header);
+		for (int a(0); a < kMaxArrays; ++a)
+		{
+			file.write(padding, (std::streamsize)(header.offsets[a] - position));
+			file.write((const char*)arrays[a], (std::streamsize)bytes[a]);
+			position = header.offsets[a] + bytes[a];
+		}
+
+		if (!file.good())
+		{
+			file.close();
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+
+	return MappedFile::Replace(temporary, path);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "MappedFile.h"
+#include "SpectrumModels.h"
+
+//--------------------------------------------------------------------------------------
+// Everything the initial spectrum depends on. Compared byte for byte with the
+// key in the cache file, so it is value-initialised before being filled, and
+// every member is 4 bytes, leaving no padding.
+//--------------------------------------------------------------------------------------
+struct SpectrumCacheKey
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t cascades;
+	uint32_t hermitian;		// h0tildeConj is conj(h0tilde(-k)) instead of having its own random numbers
+	uint32_t seed;
+	float patchSize[4];
+	SeaState seaState;
+};
+
+//================================================================================
+// The arrays FFTWrapper initialises before its first frame, in a binary file
+// that is mapped into memory instead of being read. The arrays start on 64
+// byte boundaries and are used where they are mapped, so processes with the
+// same key share one copy in the page cache. The mapping is copy-on-write,
+// writes stay private to the process and never reach the file.
+//
+// The file name comes from a hash of the key, and the header holds the key
+// itself, the layout and a checksum of the header. Any mismatch counts as
+// a miss, and the file is written again.
+//================================================================================
+class SpectrumCache
+{
+public:
+	enum Array
+	{
+		kArrayKVectors,
+		kArrayKMag,
+		kArrayH0tilde,
+		kArrayH0tildeConj,
+		kMaxArrays
+	};
+
+	SpectrumCache(SpectrumCache const&) = delete; // Don't Implement
+	void operator=(SpectrumCache const&) = delete;   // Don't Implement
+
+	// Maps the file for key, null if there is none or its header doesn't
+	// match the key and the array sizes
+	static std::unique_ptr<SpectrumCache> Open(const SpectrumCacheKey& key, const uint64_t bytes[kMaxArrays]);
+
+	// Replaces the file for key. Written under a temporary name first, so
+	// other processes never map half a file.
+	static bool Write(const SpectrumCacheKey& key, const void* const arrays[kMaxArrays], const uint64_t bytes[kMaxArrays]);
+
+	inline void* getArray(const Array& a) { return m_file.getView() + m_offsets[a]; }
+
+	// Whether p points into the mapped file
+	inline bool Contains(const void* p) { return m_file.Contains(p); }
+
+private:
+	SpectrumCache() {}
+
+	static std::string Path(const SpectrumCacheKey& key);
+
+	MappedFile m_file;
+	uint64_t m_offsets[kMaxArrays];
+};
@@ -0,0 +1,418 @@
+#include "SpectrumKernels.h"
+#include <cmath>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define KERNEL_TARGET_SSE
+#define KERNEL_TARGET_AVX2
+#else
+#define KERNEL_TARGET_SSE __attribute__((target("sse4.1")))
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif // _MSC_VER
+
+//--------------------------------------------------------------------------------------
+// Detect the widest instruction set both the CPU and the OS support
+//--------------------------------------------------------------------------------------
+SimdLevel DetectSimdLevel()
+{
+#ifdef _MSC_VER
+	int cpuInfo[4] = { 0 };
+	__cpuid(cpuInfo, 0);
+	const int maxLeaf = cpuInfo[0];
+
+	__cpuid(cpuInfo, 1);
+	const bool sse41 = (cpuInfo[2] & (1 << 19)) != 0;
+	const bool osxsave = (cpuInfo[2] & (1 << 27)) != 0;
+	const bool avx = (cpuInfo[2] & (1 << 28)) != 0;
+
+	// The OS has to save the YMM registers on context switches
+	bool ymmSaved = false;
+	if (osxsave && avx)
+		ymmSaved = (_xgetbv(0) & 0x6) == 0x6;
+
+	bool avx2 = false;
+	if (maxLeaf >= 7)
+	{
+		__cpuidex(cpuInfo, 7, 0);
+		avx2 = (cpuInfo[1] & (1 << 5)) != 0;
+	}
+
+	if (avx2 && ymmSaved)
+		return kSimdAVX2;
+	if (sse41)
+		return kSimdSSE;
+	return kSimdScalar;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return kSimdAVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return kSimdSSE;
+	return kSimdScalar;
+#endif // _MSC_VER
+}
+
+const char* SimdLevelName(const SimdLevel& level)
+{
+	switch (level)
+	{
+	case kSimdAVX2:	return "AVX2";
+	case kSimdSSE:	return "SSE4.1";
+	default:		return "Scalar";
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Spectrum allocation, aligned for the vector loads
+//--------------------------------------------------------------------------------------
+void AllocateSpectrum(SpectrumSoA& spectrum, const uint32_t& bins)
+{
+	float** planes[] = { &spectrum.h0Re, &spectrum.h0Im, &spectrum.h0ConjRe, &spectrum.h0ConjIm,
+		&spectrum.kx, &spectrum.kz, &spectrum.kxOverK, &spectrum.kzOverK,
+		&spectrum.rotorCos, &spectrum.rotorSin, &spectrum.stepCos, &spectrum.stepSin };
+
+	for (float** plane : planes)
+		*plane = (float*)_mm_malloc(sizeof(float) * bins, 64);
+}
+
+void FreeSpectrum(SpectrumSoA& spectrum)
+{
+	float** planes[] = { &spectrum.h0Re, &spectrum.h0Im, &spectrum.h0ConjRe, &spectrum.h0ConjIm,
+		&spectrum.kx, &spectrum.kz, &spectrum.kxOverK, &spectrum.kzOverK,
+		&spectrum.rotorCos, &spectrum.rotorSin, &spectrum.stepCos, &spectrum.stepSin };
+
+	for (float** plane : planes)
+	{
+		_mm_free(*plane);
+		*plane = nullptr;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Scalar kernels, also used for the tails of the vector loops
+//--------------------------------------------------------------------------------------
+static inline void DeriveBin(const SpectrumSoA& sp, const SpectrumFields& f, uint32_t s, float hr, float hi)
+{
+	// -i * k / |k| * htilde for the displacements, i * k * htilde for the slopes
+	if (f.dispX)
+	{
+		if (f.packed)
+		{
+			f.dispX[s][0] = sp.kxOverK[s] * hi + sp.kzOverK[s] * hr;
+			f.dispX[s][1] = sp.kzOverK[s] * hi - sp.kxOverK[s] * hr;
+		}
+		else
+		{
+			f.dispX[s][0] = sp.kxOverK[s] * hi;
+			f.dispX[s][1] = -sp.kxOverK[s] * hr;
+			f.dispZ[s][0] = sp.kzOverK[s] * hi;
+			f.dispZ[s][1] = -sp.kzOverK[s] * hr;
+		}
+	}
+
+	if (f.slopeX)
+	{
+		if (f.packed)
+		{
+			f.slopeX[s][0] = -sp.kx[s] * hi - sp.kz[s] * hr;
+			f.slopeX[s][1] = sp.kx[s] * hr - sp.kz[s] * hi;
+		}
+		else
+		{
+			f.slopeX[s][0] = -sp.kx[s] * hi;
+			f.slopeX[s][1] = sp.kx[s] * hr;
+			f.slopeZ[s][0] = -sp.kz[s] * hi;
+			f.slopeZ[s][1] = sp.kz[s] * hr;
+		}
+	}
+}
+
+static inline void AdvanceBin(const SpectrumSoA& sp, const SpectrumFields& f, uint32_t s, bool renormalise)
+{
+	float c = sp.rotorCos[s] * sp.stepCos[s] - sp.rotorSin[s] * sp.stepSin[s];
+	float sn = sp.rotorCos[s] * sp.stepSin[s] + sp.rotorSin[s] * sp.stepCos[s];
+
+	if (renormalise)
+	{
+		const float norm = 1.0f / sqrt(c * c + sn * sn);
+		c *= norm;
+		sn *= norm;
+	}
+
+	sp.rotorCos[s] = c;
+	sp.rotorSin[s] = sn;
+
+	// h0 * exp(i * omegaK * t) + h0Conj * exp(-i * omegaK * t)
+	const float hr = c * (sp.h0Re[s] + sp.h0ConjRe[s]) + sn * (sp.h0ConjIm[s] - sp.h0Im[s]);
+	const float hi = c * (sp.h0Im[s] + sp.h0ConjIm[s]) + sn * (sp.h0Re[s] - sp.h0ConjRe[s]);
+
+	f.htilde[s][0] = hr;
+	f.htilde[s][1] = hi;
+
+	if (f.htildeCopy)
+	{
+		f.htildeCopy[s][0] = hr;
+		f.htildeCopy[s][1] = hi;
+	}
+
+	DeriveBin(sp, f, s, hr, hi);
+}
+
+//--------------------------------------------------------------------------------------
+// SSE kernels, 4 bins per iteration
+//--------------------------------------------------------------------------------------
+KERNEL_TARGET_SSE static inline void LoadComplex4(const fftwf_complex* src, __m128& re, __m128& im)
+{
+	const __m128 a = _mm_loadu_ps(src[0]);
+	const __m128 b = _mm_loadu_ps(src[2]);
+	re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+	im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+KERNEL_TARGET_SSE static inline void StoreComplex4(fftwf_complex* dst, const __m128& re, const __m128& im)
+{
+	_mm_storeu_ps(dst[0], _mm_unpacklo_ps(re, im));
+	_mm_storeu_ps(dst[2], _mm_unpackhi_ps(re, im));
+}
+
+KERNEL_TARGET_SSE static inline void Derive4(const SpectrumSoA& sp, const SpectrumFields& f, uint32_t s, const __m128& hr, const __m128& hi)
+{
+	if (f.dispX)
+	{
+		const __m128 kx = _mm_loadu_ps(sp.kxOverK + s);
+		const __m128 kz = _mm_loadu_ps(sp.kzOverK + s);
+
+		if (f.packed)
+		{
+			StoreComplex4(f.dispX + s,
+				_mm_add_ps(_mm_mul_ps(kx, hi), _mm_mul_ps(kz, hr)),
+				_mm_sub_ps(_mm_mul_ps(kz, hi), _mm_mul_ps(kx, hr)));
+		}
+		else
+		{
+			const __m128 zero = _mm_setzero_ps();
+			StoreComplex4(f.dispX + s, _mm_mul_ps(kx, hi), _mm_sub_ps(zero, _mm_mul_ps(kx, hr)));
+			StoreComplex4(f.dispZ + s, _mm_mul_ps(kz, hi), _mm_sub_ps(zero, _mm_mul_ps(kz, hr)));
+		}
+	}
+
+	if (f.slopeX)
+	{
+		const __m128 kx = _mm_loadu_ps(sp.kx + s);
+		const __m128 kz = _mm_loadu_ps(sp.kz + s);
+		const __m128 zero = _mm_setzero_ps();
+
+		if (f.packed)
+		{
+			StoreComplex4(f.slopeX + s,
+				_mm_sub_ps(_mm_sub_ps(zero, _mm_mul_ps(kx, hi)), _mm_mul_ps(kz, hr)),
+				_mm_sub_ps(_mm_mul_ps(kx, hr), _mm_mul_ps(kz, hi)));
+		}
+		else
+		{
+			StoreComplex4(f.slopeX + s, _mm_sub_ps(zero, _mm_mul_ps(kx, hi)), _mm_mul_ps(kx, hr));
+			StoreComplex4(f.slopeZ + s, _mm_sub_ps(zero, _mm_mul_ps(kz, hi)), _mm_mul_ps(kz, hr));
+		}
+	}
+}
+
+KERNEL_TARGET_SSE static void AdvanceSpectrumSSE(const SpectrumSoA& sp, const SpectrumFields& f, uint32_t& s, uint32_t end, bool renormalise)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	for (; s + 4 <= end; s += 4)
+	{
+		const __m128 rc = _mm_loadu_ps(sp.rotorCos + s);
+		const __m128 rs = _mm_loadu_ps(sp.rotorSin + s);
+		const __m128 sc = _mm_loadu_ps(sp.stepCos + s);
+		const __m128 ss = _mm_loadu_ps(sp.stepSin + s);
+
+		__m128 c = _mm_sub_ps(_mm_mul_ps(rc, sc), _mm_mul_ps(rs, ss));
+		__m128 sn = _mm_add_ps(_mm_mul_ps(rc, ss), _mm_mul_ps(rs, sc));
+
+		if (renormalise)
+		{
+			const __m128 norm = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(c, c), _mm_mul_ps(sn, sn))));
+			c = _mm_mul_ps(c, norm);
+			sn = _mm_mul_ps(sn, norm);
+		}
+
+		_mm_storeu_ps(sp.rotorCos + s, c);
+		_mm_storeu_ps(sp.rotorSin + s, sn);
+
+		const __m128 h0r = _mm_loadu_ps(sp.h0Re + s);
+		const __m128 h0i = _mm_loadu_ps(sp.h0Im + s);
+		const __m128 h0cr = _mm_loadu_ps(sp.h0ConjRe + s);
+		const __m128 h0ci = _mm_loadu_ps(sp.h0ConjIm + s);
+
+		const __m128 hr = _mm_add_ps(_mm_mul_ps(c, _mm_add_ps(h0r, h0cr)), _mm_mul_ps(sn, _mm_sub_ps(h0ci, h0i)));
+		const __m128 hi = _mm_add_ps(_mm_mul_ps(c, _mm_add_ps(h0i, h0ci)), _mm_mul_ps(sn, _mm_sub_ps(h0r, h0cr)));
+
+		StoreComplex4(f.htilde + s, hr, hi);
+		if (f.htildeCopy)
+			StoreComplex4(f.htildeCopy + s, hr, hi);
+
+		Derive4(sp, f, s, hr, hi);
+	}
+}
+
+KERNEL_TARGET_SSE static void FillDerivedFieldsSSE(const SpectrumSoA& sp, const SpectrumFields& f, uint32_t& s, uint32_t end)
+{
+	__m128 hr, hi;
+
+	for (; s + 4 <= end; s += 4)
+	{
+		LoadComplex4(f.htilde + s, hr, hi);
+		Derive4(sp, f, s, hr, hi);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// AVX2 kernels, 8 bins per iteration
+//--------------------------------------------------------------------------------------
+KERNEL_TARGET_AVX2 static inline void LoadComplex8(const fftwf_complex* src, __m256& re, __m256& im)
+{
+	const __m256 a = _mm256_loadu_ps(src[0]);
+	const __m256 b = _mm256_loadu_ps(src[4]);
+
+	// Gather bins 0-1, 4-5 and 2-3, 6-7 per lane, then split re and im
+	const __m256 lo = _mm256_permute2f128_ps(a, b, 0x20);
+	const __m256 hi = _mm256_permute2f128_ps(a, b, 0x31);
+	re = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+	im = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+KERNEL_TARGET_AVX2 static inline void StoreComplex8(fftwf_complex* dst, const __m256& re, const __m256& im)
+{
+	const __m256 lo = _mm256_unpacklo_ps(re, im);
+	const __m256 hi = _mm256_unpackhi_ps(re, im);
+	_mm256_storeu_ps(dst[0], _mm256_permute2f128_ps(lo, hi, 0x20));
+	_mm256_storeu_ps(dst[4], _mm256_permute2f128_ps(lo, hi, 0x31));
+}
+
+KERNEL_TARGET_AVX2 static inline void Derive8(const SpectrumSoA& sp, const SpectrumFields& f, uint32_t s, const __m256& hr, const __m256& hi)
+{
+	if (f.dispX)
+	{
+		const __m256 kx = _mm256_loadu_ps(sp.kxOverK + s);
+		const __m256 kz = _mm256_loadu_ps(sp.kzOverK + s);
+
+		if (f.packed)
+		{
+			StoreComplex8(f.dispX + s,
+				_mm256_add_ps(_mm256_mul_ps(kx, hi), _mm256_mul_ps(kz, hr)),
+				_mm256_sub_ps(_mm256_mul_ps(kz, hi), _mm256_mul_ps(kx, hr)));
+		}
+		else
+		{
+			const __m256 zero = _mm256_setzero_ps();
+			StoreComplex8(f.dispX + s, _mm256_mul_ps(kx, hi), _mm256_sub_ps(zero, _mm256_mul_ps(kx, hr)));
+			StoreComplex8(f.dispZ + s, _mm256_mul_ps(kz, hi), _mm256_sub_ps(zero, _mm256_mul_ps(kz, hr)));
+		}
+	}
+
+	if (f.slopeX)
+	{
+		const __m256 kx = _mm256_loadu_ps(sp.kx + s);
+		const __m256 kz = _mm256_loadu_ps(sp.kz + s);
+		const __m256 zero = _mm256_setzero_ps();
+
+		if (f.packed)
+		{
+			StoreComplex8(f.slopeX + s,
+				_mm256_sub_ps(_mm256_sub_ps(zero, _mm256_mul_ps(kx, hi)), _mm256_mul_ps(kz, hr)),
+				_mm256_sub_ps(_mm256_mul_ps(kx, hr), _mm256_mul_ps(kz, hi)));
+		}
+		else
+		{
+			StoreComplex8(f.slopeX + s, _mm256_sub_ps(zero, _mm256_mul_ps(kx, hi)), _mm256_mul_ps(kx, hr));
+			StoreComplex8(f.slopeZ + s, _mm256_sub_ps(zero, _mm256_mul_ps(kz, hi)), _mm256_mul_ps(kz, hr));
+		}
+	}
+}
+
+KERNEL_TARGET_AVX2 static void AdvanceSpectrumAVX2(const SpectrumSoA& sp, const SpectrumFields& f, uint32_t& s, uint32_t end, bool renormalise)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	for (; s + 8 <= end; s += 8)
+	{
+		const __m256 rc = _mm256_loadu_ps(sp.rotorCos + s);
+		const __m256 rs = _mm256_loadu_ps(sp.rotorSin + s);
+		const __m256 sc = _mm256_loadu_ps(sp.stepCos + s);
+		const __m256 ss = _mm256_loadu_ps(sp.stepSin + s);
+
+		__m256 c = _mm256_sub_ps(_mm256_mul_ps(rc, sc), _mm256_mul_ps(rs, ss));
+		__m256 sn = _mm256_add_ps(_mm256_mul_ps(rc, ss), _mm256_mul_ps(rs, sc));
+
+		if (renormalise)
+		{
+			const __m256 norm = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(c, c), _mm256_mul_ps(sn, sn))));
+			c = _mm256_mul_ps(c, norm);
+			sn = _mm256_mul_ps(sn, norm);
+		}
+
+		_mm256_storeu_ps(sp.rotorCos + s, c);
+		_mm256_storeu_ps(sp.rotorSin + s, sn);
+
+		const __m256 h0r = _mm256_loadu_ps(sp.h0Re + s);
+		const __m256 h0i = _mm256_loadu_ps(sp.h0Im + s);
+		const __m256 h0cr = _mm256_loadu_ps(sp.h0ConjRe + s);
+		const __m256 h0ci = _mm256_loadu_ps(sp.h0ConjIm + s);
+
+		const __m256 hr = _mm256_add_ps(_mm256_mul_ps(c, _mm256_add_ps(h0r, h0cr)), _mm256_mul_ps(sn, _mm256_sub_ps(h0ci, h0i)));
+		const __m256 hi = _mm256_add_ps(_mm256_mul_ps(c, _mm256_add_ps(h0i, h0ci)), _mm256_mul_ps(sn, _mm256_sub_ps(h0r, h0cr)));
+
+		StoreComplex8(f.htilde + s, hr, hi);
+		if (f.htildeCopy)
+			StoreComplex8(f.htildeCopy + s, hr, hi);
+
+		Derive8(sp, f, s, hr, hi);
+	}
+
+	// Avoid the AVX to SSE transition penalty in the scalar tail
+	_mm256_zeroupper();
+}
+
+KERNEL_TARGET_AVX2 static void FillDerivedFieldsAVX2(const SpectrumSoA& sp, const SpectrumFields& f, uint32_t& s, uint32_t end)
+{
+	__m256 hr, hi;
+
+	for (; s + 8 <= end; s += 8)
+	{
+		LoadComplex8(f.htilde + s, hr, hi);
+		Derive8(sp, f, s, hr, hi);
+	}
+
+	_mm256_zeroupper();
+}
+
+//--------------------------------------------------------------------------------------
+// Dispatch
+//--------------------------------------------------------------------------------------
+void AdvanceSpectrum(const SpectrumSoA& spectrum, const SpectrumFields& fields, uint32_t begin, uint32_t end, bool renormalise, SimdLevel level)
+{
+	uint32_t s = begin;
+
+	if (level == kSimdAVX2)
+		AdvanceSpectrumAVX2(spectrum, fields, s, end, renormalise);
+	else if (level == kSimdSSE)
+		AdvanceSpectrumSSE(spectrum, fields, s, end, renormalise);
+
+	for (; s < end; ++s)
+		AdvanceBin(spectrum, fields, s, renormalise);
+}
+
+void FillDerivedFields(const SpectrumSoA& spectrum, const SpectrumFields& fields, uint32_t begin, uint32_t end, SimdLevel level)
+{
+	uint32_t s = begin;
+
+	if (level == kSimdAVX2)
+		FillDerivedFieldsAVX2(spectrum, fields, s, end);
+	else if (level == kSimdSSE)
+		FillDerivedFieldsSSE(spectrum, fields, s, end);
+
+	for (; s < end; ++s)
+		DeriveBin(spectrum, fields, s, fields.htilde[s][0], fields.htilde[s][1]);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+
+#include "fftw3.h"
+
+//--------------------------------------------------------------------------------------
+// Instruction sets the spectrum kernels can run with
+//--------------------------------------------------------------------------------------
+enum SimdLevel
+{
+	kSimdScalar,
+	kSimdSSE,
+	kSimdAVX2
+};
+
+SimdLevel DetectSimdLevel();
+const char* SimdLevelName(const SimdLevel& level);
+
+//--------------------------------------------------------------------------------------
+// Per-bin spectrum data in structure-of-arrays form, in IFFT input order
+//--------------------------------------------------------------------------------------
+struct SpectrumSoA
+{
+	float* h0Re;
+	float* h0Im;
+	float* h0ConjRe;
+	float* h0ConjIm;
+
+	float* kx;
+	float* kz;
+	float* kxOverK;		// kx / |k|, precalculated for the displacements
+	float* kzOverK;		// kz / |k|
+
+	// Phase rotors exp(i * omegaK * t) and their per-frame step
+	float* rotorCos;
+	float* rotorSin;
+	float* stepCos;
+	float* stepSin;
+};
+
+void AllocateSpectrum(SpectrumSoA& spectrum, const uint32_t& bins);
+void FreeSpectrum(SpectrumSoA& spectrum);
+
+//--------------------------------------------------------------------------------------
+// IFFT inputs used by the kernels. Null outputs are skipped, and packed
+// mode writes dispX + i * dispZ and slopeX + i * slopeZ into the X fields.
+//--------------------------------------------------------------------------------------
+struct SpectrumFields
+{
+	fftwf_complex* htilde;
+	fftwf_complex* htildeCopy;
+	fftwf_complex* dispX;
+	fftwf_complex* dispZ;
+	fftwf_complex* slopeX;
+	fftwf_complex* slopeZ;
+	bool packed;
+};
+
+//--------------------------------------------------------------------------------------
+// Advance the rotors of bins [begin, end) by one step, then fill htilde
+// and every non-null field derived from it.
+//--------------------------------------------------------------------------------------
+void AdvanceSpectrum(const SpectrumSoA& spectrum, const SpectrumFields& fields, uint32_t begin, uint32_t end, bool renormalise, SimdLevel level);
+
+//--------------------------------------------------------------------------------------
+// Fill the non-null displacement and slope fields of bins [begin, end)
+// from an htilde that is already in place.
+//--------------------------------------------------------------------------------------
+void FillDerivedFields(const SpectrumSoA& spectrum, const SpectrumFields& fields, uint32_t begin, uint32_t end, SimdLevel level);
@@ -0,0 +1,503 @@
+#include "SpectrumModels.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define KERNEL_TARGET_SSE
+#define KERNEL_TARGET_AVX2
+#else
+#define KERNEL_TARGET_SSE __attribute__((target("sse4.1")))
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif // _MSC_VER
+
+namespace
+{
+	const char* kSpectrumModelNames[kMaxSpectrumModels] = { "phillips", "pierson_moskowitz", "jonswap", "tma" };
+	const char* kSpreadingFunctionNames[kMaxSpreadingFunctions] = { "cos2", "cos2s", "none" };
+
+	const float kfPi = 3.1415926f;
+	const float kfGravity = 9.81f;
+
+	// Spectrum constants
+	const float kfPhillipsAlpha = 0.0081f;				// Pierson-Moskowitz energy scale
+	const float kfPiersonMoskowitzPeak = 0.877f;		// Peak omega * U10 / g of a fully developed sea
+	const float kfFullyDevelopedFetch = 22000.0f;		// g * F / U10^2 beyond which JONSWAP stops growing
+	const float kfSigmaBelowPeak = 0.07f;				// JONSWAP peak widths
+	const float kfSigmaAbovePeak = 0.09f;
+
+	// Range of the exp and log approximations
+	const float kfExpMax = 88.0f;
+	const float kfExpMin = -87.33654f;		// Below this exp flushes to 0
+	const float kfPowMin = 1.0e-30f;		// Bases below this raise to 0
+
+	// Cephes polynomial coefficients for expf and logf
+	const float kfLog2e = 1.44269504088896341f;
+	const float kfLn2Hi = 0.693359375f;
+	const float kfLn2Lo = -2.12194440e-4f;
+	const float kfSqrtHalf = 0.707106781186547524f;
+
+	const float kfExpP[6] = { 1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f };
+	const float kfLogP[9] = { 7.0376836292e-2f, -1.1514610310e-1f, 1.1676998740e-1f, -1.2420140846e-1f, 1.4249322787e-1f,
+		-1.6668057665e-1f, 2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f };
+}
+
+const char* SpectrumModelName(const SpectrumModel& model)
+{
+	return (model >= 0 && model < kMaxSpectrumModels) ? kSpectrumModelNames[model] : "unknown";
+}
+
+const char* SpreadingFunctionName(const SpreadingFunction& spreading)
+{
+	return (spreading >= 0 && spreading < kMaxSpreadingFunctions) ? kSpreadingFunctionNames[spreading] : "unknown";
+}
+
+//--------------------------------------------------------------------------------------
+// Model parameters
+//--------------------------------------------------------------------------------------
+SpectrumShape MakeSpectrumShape(const SeaState& state, const float& binArea, const float& firstBinArea, const uint32_t& gridSize)
+{
+	SpectrumShape shape;
+	const float windSpeed = std::max(state.windSpeed, 0.1f);
+
+	shape.gamma = 1.0f;
+	shape.omegaPeak = 0.0f;
+	shape.depth = 0.0f;
+
+	if (state.model == kSpectrumPhillips)
+	{
+		// A * exp(-1 / (k L)^2) / k^4, with the pi that normalising cos^2 takes away.
+		// Smaller bins hold less energy, so the first cascade keeps the
+		// amplitude of a single band ocean and the others fall off with it.
+		const float L = (windSpeed * windSpeed) / kfGravity;
+		shape.scale = state.amplitude * kfPi * binArea / firstBinArea;
+		shape.cutoff = 1.0f / (L * L);
+	}
+	else
+	{
+		float alpha = kfPhillipsAlpha;
+		shape.omegaPeak = kfPiersonMoskowitzPeak * kfGravity / windSpeed;
+
+		if (state.model != kSpectrumPiersonMoskowitz)
+		{
+			// Hasselmann et al. fetch laws, up to a fully developed sea
+			const float fetch = std::min(kfGravity * std::max(state.fetch, 1.0f) / (windSpeed * windSpeed), kfFullyDevelopedFetch);
+			alpha = 0.076f * powf(fetch, -0.22f);
+			shape.omegaPeak = 22.0f * kfGravity / windSpeed * powf(fetch, -1.0f / 3.0f);
+			shape.gamma = std::max(state.gamma, 1.0f);
+
+			if (state.model == kSpectrumTMA)
+				shape.depth = std::max(state.depth, 0.1f);
+		}
+
+		// alpha g^2 omega^-5 exp(-5/4 (omegaPeak / omega)^4) in wavenumbers, with
+		// d omega / dk / k = 1 / (2 k^2) and half of the variance in each of k and -k.
+		// The heightmap divides the IFFT by the grid size, so the variance is
+		// multiplied by its square to leave the heightmap in metres.
+		const float kPeak = shape.omegaPeak * shape.omegaPeak / kfGravity;
+		shape.scale = alpha * binArea * 0.25f * (float)gridSize * gridSize;
+		shape.cutoff = 1.25f * kPeak * kPeak;
+	}
+
+	shape.spreading = state.spreading;
+	shape.spread = std::max(state.spread, 0.0f);
+	shape.windX = state.windX;
+	shape.windZ = state.windZ;
+
+	switch (shape.spreading)
+	{
+	case kSpreadingCos2:
+		shape.spreadNorm = 1.0f / kfPi;
+		break;
+	case kSpreadingCos2s:
+		// Gamma(s + 1) / (2 sqrt(pi) Gamma(s + 1/2))
+		shape.spreadNorm = expf(lgammaf(shape.spread + 1.0f) - lgammaf(shape.spread + 0.5f)) / (2.0f * sqrtf(kfPi));
+		break;
+	default:
+		shape.spreadNorm = 1.0f / (2.0f * kfPi);
+		break;
+	}
+
+	return shape;
+}
+
+//--------------------------------------------------------------------------------------
+// Scalar kernels, the same approximations as the vector ones for the tails
+//--------------------------------------------------------------------------------------
+static inline float ExpApprox(float x)
+{
+	if (x < kfExpMin)
+		return 0.0f;
+	x = std::min(x, kfExpMax);
+
+	const float fx = floorf(x * kfLog2e + 0.5f);
+	x -= fx * kfLn2Hi;
+	x -= fx * kfLn2Lo;
+
+	float y = kfExpP[0];
+	for (int p(1); p < 6; ++p)
+		y = y * x + kfExpP[p];
+	y = y * (x * x) + x + 1.0f;
+
+	const int32_t bits = ((int32_t)fx + 127) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	return y * scale;
+}
+
+static inline float LogApprox(float x)
+{
+	int32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+
+	// x = m * 2^e with m in [0.5, 1)
+	float e = (float)((bits >> 23) - 126);
+	bits = (bits & 0x807fffff) | 0x3f000000;
+	float m;
+	memcpy(&m, &bits, sizeof(m));
+
+	if (m < kfSqrtHalf)
+	{
+		e -= 1.0f;
+		x = m + m - 1.0f;
+	}
+	else
+	{
+		x = m - 1.0f;
+	}
+
+	const float z = x * x;
+	float y = kfLogP[0];
+	for (int p(1); p < 9; ++p)
+		y = y * x + kfLogP[p];
+	y *= x * z;
+
+	y += e * kfLn2Lo;
+	y -= 0.5f * z;
+	return x + y + e * kfLn2Hi;
+}
+
+static inline float RadialScalar(const SpectrumShape& sh, const float& k)
+{
+	const float invK2 = 1.0f / (k * k);
+	float radial = sh.scale * (invK2 * invK2) * ExpApprox(-sh.cutoff * invK2);
+
+	if (sh.gamma != 1.0f || sh.depth > 0.0f)
+	{
+		const float omega = sqrtf(kfGravity * k);
+
+		if (sh.gamma != 1.0f)
+		{
+			const float sigma = (omega <= sh.omegaPeak) ? kfSigmaBelowPeak : kfSigmaAbovePeak;
+			const float d = (omega - sh.omegaPeak) / (sigma * sh.omegaPeak);
+			radial *= ExpApprox(ExpApprox(-0.5f * d * d) * LogApprox(sh.gamma));
+		}
+
+		if (sh.depth > 0.0f)
+		{
+			// Kitaigorodskii depth attenuation
+			const float omegaH = omega * sqrtf(sh.depth / kfGravity);
+			const float t = 2.0f - omegaH;
+			radial *= (omegaH <= 1.0f) ? 0.5f * omegaH * omegaH : (omegaH < 2.0f) ? 1.0f - 0.5f * t * t : 1.0f;
+		}
+	}
+
+	return radial;
+}
+
+static inline float SpreadingScalar(const SpectrumShape& sh, const float& cosTheta)
+{
+	switch (sh.spreading)
+	{
+	case kSpreadingCos2:
+		return sh.spreadNorm * cosTheta * cosTheta;
+	case kSpreadingCos2s:
+	{
+		// cos^2s(theta / 2) = ((1 + cos theta) / 2)^s
+		const float base = 0.5f + 0.5f * cosTheta;
+		return (base > kfPowMin) ? sh.spreadNorm * ExpApprox(sh.spread * LogApprox(base)) : 0.0f;
+	}
+	default:
+		return sh.spreadNorm;
+	}
+}
+
+static void EvaluateScalar(const SpectrumShape& sh, const float* kVectors, const float* kMag,
+	float* out, float* opposite, uint32_t begin, uint32_t end)
+{
+	for (uint32_t n(begin); n < end; ++n)
+	{
+		const float radial = RadialScalar(sh, kMag[n]);
+		const float cosTheta = (kVectors[2 * n] * sh.windX + kVectors[2 * n + 1] * sh.windZ) / kMag[n];
+
+		out[n] = radial * SpreadingScalar(sh, cosTheta);
+		if (opposite)
+			opposite[n] = radial * SpreadingScalar(sh, -cosTheta);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// SSE kernels, 4 bins per iteration
+//--------------------------------------------------------------------------------------
+KERNEL_TARGET_SSE static inline __m128 Exp4(__m128 x)
+{
+	const __m128 underflow = _mm_cmplt_ps(x, _mm_set1_ps(kfExpMin));
+	x = _mm_min_ps(x, _mm_set1_ps(kfExpMax));
+
+	const __m128 fx = _mm_floor_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(kfLog2e)), _mm_set1_ps(0.5f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(kfLn2Hi)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(kfLn2Lo)));
+
+	__m128 y = _mm_set1_ps(kfExpP[0]);
+	for (int p(1); p < 6; ++p)
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(kfExpP[p]));
+	y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x), _mm_set1_ps(1.0f));
+
+	const __m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(127)), 23);
+	return _mm_andnot_ps(underflow, _mm_mul_ps(y, _mm_castsi128_ps(bits)));
+}
+
+KERNEL_TARGET_SSE static inline __m128 Log4(__m128 x)
+{
+	__m128i bits = _mm_castps_si128(x);
+	__m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+	bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x807fffff)), _mm_set1_epi32(0x3f000000));
+	const __m128 m = _mm_castsi128_ps(bits);
+
+	const __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(kfSqrtHalf));
+	e = _mm_sub_ps(e, _mm_and_ps(small, _mm_set1_ps(1.0f)));
+	x = _mm_sub_ps(_mm_add_ps(m, _mm_and_ps(small, m)), _mm_set1_ps(1.0f));
+
+	const __m128 z = _mm_mul_ps(x, x);
+	__m128 y = _mm_set1_ps(kfLogP[0]);
+	for (int p(1); p < 9; ++p)
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(kfLogP[p]));
+	y = _mm_mul_ps(y, _mm_mul_ps(x, z));
+
+	y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(kfLn2Lo)));
+	y = _mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+	return _mm_add_ps(_mm_add_ps(x, y), _mm_mul_ps(e, _mm_set1_ps(kfLn2Hi)));
+}
+
+KERNEL_TARGET_SSE static inline __m128 Radial4(const SpectrumShape& sh, const __m128& k)
+{
+	const __m128 invK2 = _mm_div_ps(_mm_set1_ps(1.0f), _mm_mul_ps(k, k));
+	__m128 radial = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(sh.scale), _mm_mul_ps(invK2, invK2)),
+		Exp4(_mm_mul_ps(_mm_set1_ps(-sh.cutoff), invK2)));
+
+	if (sh.gamma != 1.0f || sh.depth > 0.0f)
+	{
+		const __m128 omega = _mm_sqrt_ps(_mm_mul_ps(_mm_set1_ps(kfGravity), k));
+
+		if (sh.gamma != 1.0f)
+		{
+			const __m128 peak = _mm_set1_ps(sh.omegaPeak);
+			const __m128 sigma = _mm_blendv_ps(_mm_set1_ps(kfSigmaAbovePeak), _mm_set1_ps(kfSigmaBelowPeak), _mm_cmple_ps(omega, peak));
+			const __m128 d = _mm_div_ps(_mm_sub_ps(omega, peak), _mm_mul_ps(sigma, peak));
+			const __m128 r = Exp4(_mm_mul_ps(_mm_set1_ps(-0.5f), _mm_mul_ps(d, d)));
+			radial = _mm_mul_ps(radial, Exp4(_mm_mul_ps(r, _mm_set1_ps(LogApprox(sh.gamma)))));
+		}
+
+		if (sh.depth > 0.0f)
+		{
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 half = _mm_set1_ps(0.5f);
+			const __m128 omegaH = _mm_mul_ps(omega, _mm_set1_ps(sqrtf(sh.depth / kfGravity)));
+			const __m128 t = _mm_sub_ps(_mm_set1_ps(2.0f), omegaH);
+
+			__m128 phi = _mm_blendv_ps(one, _mm_sub_ps(one, _mm_mul_ps(half, _mm_mul_ps(t, t))), _mm_cmplt_ps(omegaH, _mm_set1_ps(2.0f)));
+			phi = _mm_blendv_ps(phi, _mm_mul_ps(half, _mm_mul_ps(omegaH, omegaH)), _mm_cmple_ps(omegaH, one));
+			radial = _mm_mul_ps(radial, phi);
+		}
+	}
+
+	return radial;
+}
+
+KERNEL_TARGET_SSE static inline __m128 Spreading4(const SpectrumShape& sh, const __m128& cosTheta)
+{
+	const __m128 norm = _mm_set1_ps(sh.spreadNorm);
+
+	switch (sh.spreading)
+	{
+	case kSpreadingCos2:
+		return _mm_mul_ps(norm, _mm_mul_ps(cosTheta, cosTheta));
+	case kSpreadingCos2s:
+	{
+		const __m128 base = _mm_add_ps(_mm_set1_ps(0.5f), _mm_mul_ps(_mm_set1_ps(0.5f), cosTheta));
+		const __m128 valid = _mm_cmpgt_ps(base, _mm_set1_ps(kfPowMin));
+		const __m128 power = Exp4(_mm_mul_ps(_mm_set1_ps(sh.spread), Log4(_mm_max_ps(base, _mm_set1_ps(kfPowMin)))));
+		return _mm_and_ps(valid, _mm_mul_ps(norm, power));
+	}
+	default:
+		return norm;
+	}
+}
+
+KERNEL_TARGET_SSE static void EvaluateSSE(const SpectrumShape& sh, const float* kVectors, const float* kMag,
+	float* out, float* opposite, uint32_t begin, uint32_t end)
+{
+	const __m128 windX = _mm_set1_ps(sh.windX);
+	const __m128 windZ = _mm_set1_ps(sh.windZ);
+
+	uint32_t n(begin);
+	for (; n + 4 <= end; n += 4)
+	{
+		const __m128 a = _mm_loadu_ps(kVectors + 2 * n);
+		const __m128 b = _mm_loadu_ps(kVectors + 2 * n + 4);
+		const __m128 kx = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 kz = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		const __m128 k = _mm_loadu_ps(kMag + n);
+
+		const __m128 radial = Radial4(sh, k);
+		const __m128 cosTheta = _mm_div_ps(_mm_add_ps(_mm_mul_ps(kx, windX), _mm_mul_ps(kz, windZ)), k);
+
+		_mm_storeu_ps(out + n, _mm_mul_ps(radial, Spreading4(sh, cosTheta)));
+		if (opposite)
+			_mm_storeu_ps(opposite + n, _mm_mul_ps(radial, Spreading4(sh, _mm_sub_ps(_mm_setzero_ps(), cosTheta))));
+	}
+
+	EvaluateScalar(sh, kVectors, kMag, out, opposite, n, end);
+}
+
+//--------------------------------------------------------------------------------------
+// AVX2 kernels, 8 bins per iteration
+//--------------------------------------------------------------------------------------
+KERNEL_TARGET_AVX2 static inline __m256 Exp8(__m256 x)
+{
+	const __m256 underflow = _mm256_cmp_ps(x, _mm256_set1_ps(kfExpMin), _CMP_LT_OQ);
+	x = _mm256_min_ps(x, _mm256_set1_ps(kfExpMax));
+
+	const __m256 fx = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(kfLog2e)), _mm256_set1_ps(0.5f)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(kfLn2Hi)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(kfLn2Lo)));
+
+	__m256 y = _mm256_set1_ps(kfExpP[0]);
+	for (int p(1); p < 6; ++p)
+		y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(kfExpP[p]));
+	y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(y, _mm256_mul_ps(x, x)), x), _mm256_set1_ps(1.0f));
+
+	const __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127)), 23);
+	return _mm256_andnot_ps(underflow, _mm256_mul_ps(y, _mm256_castsi256_ps(bits)));
+}
+
+KERNEL_TARGET_AVX2 static inline __m256 Log8(__m256 x)
+{
+	__m256i bits = _mm256_castps_si256(x);
+	__m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+	bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x807fffff)), _mm256_set1_epi32(0x3f000000));
+	const __m256 m = _mm256_castsi256_ps(bits);
+
+	const __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(kfSqrtHalf), _CMP_LT_OQ);
+	e = _mm256_sub_ps(e, _mm256_and_ps(small, _mm256_set1_ps(1.0f)));
+	x = _mm256_sub_ps(_mm256_add_ps(m, _mm256_and_ps(small, m)), _mm256_set1_ps(1.0f));
+
+	const __m256 z = _mm256_mul_ps(x, x);
+	__m256 y = _mm256_set1_ps(kfLogP[0]);
+	for (int p(1); p < 9; ++p)
+		y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(kfLogP[p]));
+	y = _mm256_mul_ps(y, _mm256_mul_ps(x, z));
+
+	y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(kfLn2Lo)));
+	y = _mm256_sub_ps(y, _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+	return _mm256_add_ps(_mm256_add_ps(x, y), _mm256_mul_ps(e, _mm256_set1_ps(kfLn2Hi)));
+}
+
+KERNEL_TARGET_AVX2 static inline __m256 Radial8(const SpectrumShape& sh, const __m256& k)
+{
+	const __m256 invK2 = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(k, k));
+	__m256 radial = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(sh.scale), _mm256_mul_ps(invK2, invK2)),
+		Exp8(_mm256_mul_ps(_mm256_set1_ps(-sh.cutoff), invK2)));
+
+	if (sh.gamma != 1.0f || sh.depth > 0.0f)
+	{
+		const __m256 omega = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(kfGravity), k));
+
+		if (sh.gamma != 1.0f)
+		{
+			const __m256 peak = _mm256_set1_ps(sh.omegaPeak);
+			const __m256 sigma = _mm256_blendv_ps(_mm256_set1_ps(kfSigmaAbovePeak), _mm256_set1_ps(kfSigmaBelowPeak),
+				_mm256_cmp_ps(omega, peak, _CMP_LE_OQ));
+			const __m256 d = _mm256_div_ps(_mm256_sub_ps(omega, peak), _mm256_mul_ps(sigma, peak));
+			const __m256 r = Exp8(_mm256_mul_ps(_mm256_set1_ps(-0.5f), _mm256_mul_ps(d, d)));
+			radial = _mm256_mul_ps(radial, Exp8(_mm256_mul_ps(r, _mm256_set1_ps(LogApprox(sh.gamma)))));
+		}
+
+		if (sh.depth > 0.0f)
+		{
+			const __m256 one = _mm256_set1_ps(1.0f);
+			const __m256 half = _mm256_set1_ps(0.5f);
+			const __m256 omegaH = _mm256_mul_ps(omega, _mm256_set1_ps(sqrtf(sh.depth / kfGravity)));
+			const __m256 t = _mm256_sub_ps(_mm256_set1_ps(2.0f), omegaH);
+
+			__m256 phi = _mm256_blendv_ps(one, _mm256_sub_ps(one, _mm256_mul_ps(half, _mm256_mul_ps(t, t))),
+				_mm256_cmp_ps(omegaH, _mm256_set1_ps(2.0f), _CMP_LT_OQ));
+			phi = _mm256_blendv_ps(phi, _mm256_mul_ps(half, _mm256_mul_ps(omegaH, omegaH)), _mm256_cmp_ps(omegaH, one, _CMP_LE_OQ));
+			radial = _mm256_mul_ps(radial, phi);
+		}
+	}
+
+	return radial;
+}
+
+KERNEL_TARGET_AVX2 static inline __m256 Spreading8(const SpectrumShape& sh, const __m256& cosTheta)
+{
+	const __m256 norm = _mm256_set1_ps(sh.spreadNorm);
+
+	switch (sh.spreading)
+	{
+	case kSpreadingCos2:
+		return _mm256_mul_ps(norm, _mm256_mul_ps(cosTheta, cosTheta));
+	case kSpreadingCos2s:
+	{
+		const __m256 base = _mm256_add_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(_mm256_set1_ps(0.5f), cosTheta));
+		const __m256 valid = _mm256_cmp_ps(base, _mm256_set1_ps(kfPowMin), _CMP_GT_OQ);
+		const __m256 power = Exp8(_mm256_mul_ps(_mm256_set1_ps(sh.spread), Log8(_mm256_max_ps(base, _mm256_set1_ps(kfPowMin)))));
+		return _mm256_and_ps(valid, _mm256_mul_ps(norm, power));
+	}
+	default:
+		return norm;
+	}
+}
+
+KERNEL_TARGET_AVX2 static void EvaluateAVX2(const SpectrumShape& sh, const float* kVectors, const float* kMag,
+	float* out, float* opposite, uint32_t begin, uint32_t end)
+{
+	const __m256 windX = _mm256_set1_ps(sh.windX);
+	const __m256 windZ = _mm256_set1_ps(sh.windZ);
+
+	uint32_t n(begin);
+	for (; n + 8 <= end; n += 8)
+	{
+		// The in-lane shuffles leave the bins in 0 1 4 5 2 3 6 7 order
+		const __m256 a = _mm256_loadu_ps(kVectors + 2 * n);
+		const __m256 b = _mm256_loadu_ps(kVectors + 2 * n + 8);
+		const __m256 kx = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+		const __m256 kz = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+		const __m256 k = _mm256_loadu_ps(kMag + n);
+
+		const __m256 radial = Radial8(sh, k);
+		const __m256 cosTheta = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(kx, windX), _mm256_mul_ps(kz, windZ)), k);
+
+		_mm256_storeu_ps(out + n, _mm256_mul_ps(radial, Spreading8(sh, cosTheta)));
+		if (opposite)
+			_mm256_storeu_ps(opposite + n, _mm256_mul_ps(radial, Spreading8(sh, _mm256_sub_ps(_mm256_setzero_ps(), cosTheta))));
+	}
+
+	EvaluateScalar(sh, kVectors, kMag, out, opposite, n, end);
+}
+
+//--------------------------------------------------------------------------------------
+// Dispatch
+//--------------------------------------------------------------------------------------
+void EvaluateSpectrum(const SpectrumShape& shape, const float* kVectors, const float* kMag,
+	float* out, float* opposite, const uint32_t& count, const SimdLevel& level)
+{
+	if (level == kSimdAVX2)
+		EvaluateAVX2(shape, kVectors, kMag, out, opposite, 0, count);
+	else if (level == kSimdSSE)
+		EvaluateSSE(shape, kVectors, kMag, out, opposite, 0, count);
+	else
+		EvaluateScalar(shape, kVectors, kMag, out, opposite, 0, count);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+
+#include "Configurations.h"
+#include "SpectrumKernels.h"
+
+//--------------------------------------------------------------------------------------
+// Wave spectra the initial amplitudes can be drawn from
+//--------------------------------------------------------------------------------------
+enum SpectrumModel
+{
+	kSpectrumPhillips,				// Tessendorf's Phillips spectrum, scaled by the amplitude
+	kSpectrumPiersonMoskowitz,		// Fully developed sea
+	kSpectrumJONSWAP,				// Fetch limited sea, with a sharper peak
+	kSpectrumTMA,					// JONSWAP in finite depth
+	kMaxSpectrumModels
+};
+
+// How the energy of a wavenumber spreads around the wind direction
+enum SpreadingFunction
+{
+	kSpreadingCos2,		// cos^2 of the angle to the wind, waves run both with and against it
+	kSpreadingCos2s,	// Longuet-Higgins cos^2s of the half angle, waves run with the wind
+	kSpreadingNone,		// The same in every direction
+	kMaxSpreadingFunctions
+};
+
+const char* SpectrumModelName(const SpectrumModel& model);
+const char* SpreadingFunctionName(const SpreadingFunction& spreading);
+
+//--------------------------------------------------------------------------------------
+// Everything the spectra are built from. Only the models that use a value read it.
+//--------------------------------------------------------------------------------------
+struct SeaState
+{
+	SpectrumModel model = OCEAN_SPECTRUM;
+	SpreadingFunction spreading = OCEAN_SPREADING;
+
+	float windX = 1.0f;			// Unit wind direction
+	float windZ = 0.0f;
+	float windSpeed = 26.0f;	// m/s, 10 m above the surface
+	float amplitude = 20.0f;	// Phillips
+	float fetch = 100000.0f;	// m, JONSWAP and TMA
+	float depth = 30.0f;		// m, TMA
+	float gamma = 3.3f;			// Peak enhancement, JONSWAP and TMA
+	float spread = 8.0f;		// Exponent s of cos^2s
+};
+
+//--------------------------------------------------------------------------------------
+// Every model in the form
+//
+//   P(k) = scale * k^-4 * exp(-cutoff / k^2) * gamma^r(omega) * depth(omega) * D(theta)
+//
+// with the deep water dispersion omega^2 = g * k of the simulation. P(k) is
+// the variance of the initial amplitude h0 of a bin, so the variance of the
+// height field is the sum of P(k) + P(-k) over the grid. Every model scales
+// with the bin area, binArea rad^2 / m^2, so smaller cascades get less
+// energy. The Phillips scale keeps the amplitude of the original spectrum
+// for bins of firstBinArea, the other models leave the heightmap of a
+// gridSize grid in metres.
+//--------------------------------------------------------------------------------------
+struct SpectrumShape
+{
+	float scale;
+	float cutoff;
+
+	// Peak enhancement, skipped when gamma is 1
+	float gamma;
+	float omegaPeak;
+
+	// TMA attenuation, skipped when depth is 0
+	float depth;
+
+	SpreadingFunction spreading;
+	float spreadNorm;		// Normalisation of the spreading function
+	float spread;
+	float windX;
+	float windZ;
+};
+
+SpectrumShape MakeSpectrumShape(const SeaState& state, const float& binArea, const float& firstBinArea, const uint32_t& gridSize);
+
+//--------------------------------------------------------------------------------------
+// P(k) of count bins, with the wavenumbers interleaved as kx, kz pairs and
+// their magnitudes in kMag. Non-null opposite also gets P(-k), which only
+// costs another spreading function.
+//--------------------------------------------------------------------------------------
+void EvaluateSpectrum(const SpectrumShape& shape, const float* kVectors, const float* kMag,
+	float* out, float* opposite, const uint32_t& count, const SimdLevel& level);
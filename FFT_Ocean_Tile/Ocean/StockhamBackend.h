@@ -0,0 +1,50 @@
+#pragma once
+#include <immintrin.h>
+
+#include "FFTBackend.h"
+#include "StockhamFFT.h"
+
+//================================================================================
+// Header-only backend over the in-tree Stockham FFT. It needs no external
+// library, so it is always built. Plans own their per-thread scratch, so
+// every Create_Plan returns a new one.
+//================================================================================
+class StockhamPlan : public FFTPlan
+{
+public:
+	StockhamPlan(const FFTBatch& batch, const int& threads, const SimdLevel& level)
+		:m_fft(batch.size, batch.howmany, batch.realOutput, level), m_threads(threads) {}
+
+	void Execute(fftwf_complex* in, void* out) override { m_fft.Execute(in, out, m_threads); }
+	void Execute_Sparse(fftwf_complex* in, void* out, const uint8_t* zeroColumns) override { m_fft.Execute(in, out, m_threads, zeroColumns); }
+	bool Skips_Zero_Columns() override { return true; }
+	double Flops() override { return m_fft.getFlops(); }
+
+private:
+	StockhamFFT m_fft;
+	const int m_threads;
+};
+
+class StockhamBackend : public FFTBackend
+{
+public:
+	StockhamBackend() :m_simdLevel(DetectSimdLevel()) {}
+
+	FFTBackendKind Kind() override { return kBackendStockham; }
+	bool Supports(const FFTBatch& batch) override { return StockhamFFT::Supports(batch.size); }
+
+	void* Allocate(const size_t& bytes) override { return _mm_malloc(bytes, 64); }
+	void Free(void* buffer) override { _mm_free(buffer); }
+
+	std::shared_ptr<FFTPlan> Create_Plan(const FFTBatch& batch, fftwf_complex*, void*,
+		const int& threads, const PlannerPolicy&) override
+	{
+		if (!Supports(batch))
+			return nullptr;
+
+		return std::make_shared<StockhamPlan>(batch, threads, m_simdLevel);
+	}
+
+private:
+	const SimdLevel m_simdLevel;
+};
@@ -0,0 +1,495 @@
+#include "StockhamFFT.h"
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+#include <omp.h>
+
+#ifdef _MSC_VER
+#define KERNEL_TARGET_SSE
+#define KERNEL_TARGET_AVX2
+#else
+#define KERNEL_TARGET_SSE __attribute__((target("sse4.1")))
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif // _MSC_VER
+
+// Floats in one element of a block, kBlock interleaved complex values
+static const uint32_t kRowFloats = 2 * StockhamFFT::kBlock;
+
+//--------------------------------------------------------------------------------------
+// Scalar stages. Element e of lane b lives at x[e * kRowFloats + 2 * b].
+//--------------------------------------------------------------------------------------
+static void Radix4StageScalar(const float* x, float* y, uint32_t m, uint32_t s, const float* tw)
+{
+	const uint32_t quarter = s * m * kRowFloats;
+
+	for (uint32_t p(0); p < m; ++p)
+	{
+		const float* w = tw + 6 * p;
+
+		for (uint32_t q(0); q < s; ++q)
+		{
+			const float* a = x + (q + s * p) * kRowFloats;
+			float* y0 = y + (q + s * 4 * p) * kRowFloats;
+
+			for (uint32_t v(0); v < kRowFloats; v += 2)
+			{
+				const float ar = a[v], ai = a[v + 1];
+				const float br = a[quarter + v], bi = a[quarter + v + 1];
+				const float cr = a[2 * quarter + v], ci = a[2 * quarter + v + 1];
+				const float dr = a[3 * quarter + v], di = a[3 * quarter + v + 1];
+
+				// Inverse butterfly, i * (b - d) instead of -i * (b - d)
+				const float apcR = ar + cr, apcI = ai + ci;
+				const float amcR = ar - cr, amcI = ai - ci;
+				const float bpdR = br + dr, bpdI = bi + di;
+				const float ibmdR = di - bi, ibmdI = br - dr;
+
+				const float t1r = amcR + ibmdR, t1i = amcI + ibmdI;
+				const float t2r = apcR - bpdR, t2i = apcI - bpdI;
+				const float t3r = amcR - ibmdR, t3i = amcI - ibmdI;
+
+				y0[v] = apcR + bpdR;
+				y0[v + 1] = apcI + bpdI;
+				y0[s * kRowFloats + v] = t1r * w[0] - t1i * w[1];
+				y0[s * kRowFloats + v + 1] = t1r * w[1] + t1i * w[0];
+				y0[2 * s * kRowFloats + v] = t2r * w[2] - t2i * w[3];
+				y0[2 * s * kRowFloats + v + 1] = t2r * w[3] + t2i * w[2];
+				y0[3 * s * kRowFloats + v] = t3r * w[4] - t3i * w[5];
+				y0[3 * s * kRowFloats + v + 1] = t3r * w[5] + t3i * w[4];
+			}
+		}
+	}
+}
+
+static void Radix2StageScalar(const float* x, float* y, uint32_t s)
+{
+	// Only used as the last stage, where every twiddle is 1
+	for (uint32_t q(0); q < s; ++q)
+	{
+		const float* a = x + q * kRowFloats;
+		const float* b = a + s * kRowFloats;
+		float* y0 = y + q * kRowFloats;
+		float* y1 = y0 + s * kRowFloats;
+
+		for (uint32_t v(0); v < kRowFloats; ++v)
+		{
+			y0[v] = a[v] + b[v];
+			y1[v] = a[v] - b[v];
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// SSE stages, 2 lanes per vector
+//--------------------------------------------------------------------------------------
+KERNEL_TARGET_SSE static inline __m128 MulTwiddleSSE(const __m128& v, const __m128& wr, const __m128& wi)
+{
+	// (vr * wr - vi * wi, vi * wr + vr * wi)
+	const __m128 swapped = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_addsub_ps(_mm_mul_ps(v, wr), _mm_mul_ps(swapped, wi));
+}
+
+KERNEL_TARGET_SSE static void Radix4StageSSE(const float* x, float* y, uint32_t m, uint32_t s, const float* tw)
+{
+	const uint32_t quarter = s * m * kRowFloats;
+	const __m128 negateRe = _mm_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+
+	for (uint32_t p(0); p < m; ++p)
+	{
+		const float* w = tw + 6 * p;
+		const __m128 w1r = _mm_set1_ps(w[0]), w1i = _mm_set1_ps(w[1]);
+		const __m128 w2r = _mm_set1_ps(w[2]), w2i = _mm_set1_ps(w[3]);
+		const __m128 w3r = _mm_set1_ps(w[4]), w3i = _mm_set1_ps(w[5]);
+
+		for (uint32_t q(0); q < s; ++q)
+		{
+			const float* a = x + (q + s * p) * kRowFloats;
+			float* y0 = y + (q + s * 4 * p) * kRowFloats;
+
+			for (uint32_t v(0); v < kRowFloats; v += 4)
+			{
+				const __m128 va = _mm_load_ps(a + v);
+				const __m128 vb = _mm_load_ps(a + quarter + v);
+				const __m128 vc = _mm_load_ps(a + 2 * quarter + v);
+				const __m128 vd = _mm_load_ps(a + 3 * quarter + v);
+
+				const __m128 apc = _mm_add_ps(va, vc);
+				const __m128 amc = _mm_sub_ps(va, vc);
+				const __m128 bpd = _mm_add_ps(vb, vd);
+				const __m128 bmd = _mm_sub_ps(vb, vd);
+				const __m128 ibmd = _mm_xor_ps(_mm_shuffle_ps(bmd, bmd, _MM_SHUFFLE(2, 3, 0, 1)), negateRe);
+
+				_mm_store_ps(y0 + v, _mm_add_ps(apc, bpd));
+				_mm_store_ps(y0 + s * kRowFloats + v, MulTwiddleSSE(_mm_add_ps(amc, ibmd), w1r, w1i));
+				_mm_store_ps(y0 + 2 * s * kRowFloats + v, MulTwiddleSSE(_mm_sub_ps(apc, bpd), w2r, w2i));
+				_mm_store_ps(y0 + 3 * s * kRowFloats + v, MulTwiddleSSE(_mm_sub_ps(amc, ibmd), w3r, w3i));
+			}
+		}
+	}
+}
+
+KERNEL_TARGET_SSE static void Radix2StageSSE(const float* x, float* y, uint32_t s)
+{
+	for (uint32_t q(0); q < s; ++q)
+	{
+		const float* a = x + q * kRowFloats;
+		const float* b = a + s * kRowFloats;
+		float* y0 = y + q * kRowFloats;
+		float* y1 = y0 + s * kRowFloats;
+
+		for (uint32_t v(0); v < kRowFloats; v += 4)
+		{
+			const __m128 va = _mm_load_ps(a + v);
+			const __m128 vb = _mm_load_ps(b + v);
+			_mm_store_ps(y0 + v, _mm_add_ps(va, vb));
+			_mm_store_ps(y1 + v, _mm_sub_ps(va, vb));
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// AVX2 stages, 4 lanes per vector
+//--------------------------------------------------------------------------------------
+KERNEL_TARGET_AVX2 static inline __m256 MulTwiddleAVX2(const __m256& v, const __m256& wr, const __m256& wi)
+{
+	const __m256 swapped = _mm256_permute_ps(v, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm256_addsub_ps(_mm256_mul_ps(v, wr), _mm256_mul_ps(swapped, wi));
+}
+
+KERNEL_TARGET_AVX2 static void Radix4StageAVX2(const float* x, float* y, uint32_t m, uint32_t s, const float* tw)
+{
+	const uint32_t quarter = s * m * kRowFloats;
+	const __m256 negateRe = _mm256_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f);
+
+	for (uint32_t p(0); p < m; ++p)
+	{
+		const float* w = tw + 6 * p;
+		const __m256 w1r = _mm256_set1_ps(w[0]), w1i = _mm256_set1_ps(w[1]);
+		const __m256 w2r = _mm256_set1_ps(w[2]), w2i = _mm256_set1_ps(w[3]);
+		const __m256 w3r = _mm256_set1_ps(w[4]), w3i = _mm256_set1_ps(w[5]);
+
+		for (uint32_t q(0); q < s; ++q)
+		{
+			const float* a = x + (q + s * p) * kRowFloats;
+			float* y0 = y + (q + s * 4 * p) * kRowFloats;
+
+			for (uint32_t v(0); v < kRowFloats; v += 8)
+			{
+				const __m256 va = _mm256_load_ps(a + v);
+				const __m256 vb = _mm256_load_ps(a + quarter + v);
+				const __m256 vc = _mm256_load_ps(a + 2 * quarter + v);
+				const __m256 vd = _mm256_load_ps(a + 3 * quarter + v);
+
+				const __m256 apc = _mm256_add_ps(va, vc);
+				const __m256 amc = _mm256_sub_ps(va, vc);
+				const __m256 bpd = _mm256_add_ps(vb, vd);
+				const __m256 bmd = _mm256_sub_ps(vb, vd);
+				const __m256 ibmd = _mm256_xor_ps(_mm256_permute_ps(bmd, _MM_SHUFFLE(2, 3, 0, 1)), negateRe);
+
+				_mm256_store_ps(y0 + v, _mm256_add_ps(apc, bpd));
+				_mm256_store_ps(y0 + s * kRowFloats + v, MulTwiddleAVX2(_mm256_add_ps(amc, ibmd), w1r, w1i));
+				_mm256_store_ps(y0 + 2 * s * kRowFloats + v, MulTwiddleAVX2(_mm256_sub_ps(apc, bpd), w2r, w2i));
+				_mm256_store_ps(y0 + 3 * s * kRowFloats + v, MulTwiddleAVX2(_mm256_sub_ps(amc, ibmd), w3r, w3i));
+			}
+		}
+	}
+}
+
+KERNEL_TARGET_AVX2 static void Radix2StageAVX2(const float* x, float* y, uint32_t s)
+{
+	for (uint32_t q(0); q < s; ++q)
+	{
+		const float* a = x + q * kRowFloats;
+		const float* b = a + s * kRowFloats;
+		float* y0 = y + q * kRowFloats;
+		float* y1 = y0 + s * kRowFloats;
+
+		for (uint32_t v(0); v < kRowFloats; v += 8)
+		{
+			const __m256 va = _mm256_load_ps(a + v);
+			const __m256 vb = _mm256_load_ps(b + v);
+			_mm256_store_ps(y0 + v, _mm256_add_ps(va, vb));
+			_mm256_store_ps(y1 + v, _mm256_sub_ps(va, vb));
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Engine
+//--------------------------------------------------------------------------------------
+StockhamFFT::StockhamFFT(const uint32_t& size, const uint32_t& howmany, const bool& realOutput, const SimdLevel& level)
+	:m_size(size), m_howmany(howmany), m_realOutput(realOutput),
+	m_specWidth(realOutput ? size / 2 + 1 : size), m_simdLevel(level)
+{
+	Build_Stages(m_size, m_columnStages);
+
+	if (m_realOutput)
+	{
+		// Row c2r as a half-length complex FFT of z[n] = x[2n] + i * x[2n + 1]
+		Build_Stages(m_size / 2, m_rowStages);
+
+		const double twoPi = 6.283185307179586;
+		for (uint32_t k(0); k < m_size / 2; ++k)
+		{
+			m_realTwiddles.push_back((float)cos(twoPi * k / m_size));
+			m_realTwiddles.push_back((float)sin(twoPi * k / m_size));
+		}
+	}
+	else
+	{
+		Build_Stages(m_size, m_rowStages);
+	}
+
+	// Column and row passes, plus the c2r split of every row (4 adds, 1 complex
+	// multiplication and 2 adds per bin)
+	m_flops = m_howmany * (m_specWidth * m_columnStages.flops + m_size * m_rowStages.flops);
+	if (m_realOutput)
+		m_flops += m_howmany * (double)m_size * (m_size / 2) * 14;
+}
+
+StockhamFFT::~StockhamFFT()
+{
+	_mm_free(m_scratch);
+}
+
+void StockhamFFT::Build_Stages(const uint32_t& length, Stages1D& out)
+{
+	const double twoPi = 6.283185307179586;
+
+	out.length = length;
+	out.stages.clear();
+	out.flops = 0;
+
+	uint32_t n = length;
+	uint32_t s = 1;
+
+	// Radix-4 stages with (w1, w2, w3) = exp(i * 2pi * p / n * (1, 2, 3))
+	for (; n >= 4; n /= 4, s *= 4)
+	{
+		out.stages.push_back({ 4, n, s, (uint32_t)m_twiddles.size() });
+
+		for (uint32_t p(0); p < n / 4; ++p)
+		{
+			const double angle = twoPi * p / n;
+			for (int r(1); r <= 3; ++r)
+			{
+				m_twiddles.push_back((float)cos(r * angle));
+				m_twiddles.push_back((float)sin(r * angle));
+			}
+		}
+
+		// 8 complex adds and 3 complex multiplications per butterfly
+		out.flops += (length / 4) * 34.0;
+	}
+
+	// Odd powers of two end with one radix-2 stage
+	if (n == 2)
+	{
+		out.stages.push_back({ 2, n, s, 0 });
+		out.flops += (length / 2) * 4.0;
+	}
+}
+
+float* StockhamFFT::Run_Stages(const Stages1D& plan, float* x, float* y)
+{
+	for (const Stage& stage : plan.stages)
+	{
+		const float* tw = m_twiddles.data() + stage.twiddles;
+		const uint32_t m = stage.n / stage.radix;
+
+		switch (m_simdLevel)
+		{
+		case kSimdAVX2:
+			if (stage.radix == 4)
+				Radix4StageAVX2(x, y, m, stage.stride, tw);
+			else
+				Radix2StageAVX2(x, y, stage.stride);
+			break;
+		case kSimdSSE:
+			if (stage.radix == 4)
+				Radix4StageSSE(x, y, m, stage.stride, tw);
+			else
+				Radix2StageSSE(x, y, stage.stride);
+			break;
+		default:
+			if (stage.radix == 4)
+				Radix4StageScalar(x, y, m, stage.stride, tw);
+			else
+				Radix2StageScalar(x, y, stage.stride);
+			break;
+		}
+
+		std::swap(x, y);
+	}
+
+	return x;
+}
+
+void StockhamFFT::Column_Block(const fftwf_complex* in, fftwf_complex* out, const uint32_t& c0, float* scratch)
+{
+	// The last c2r block only has the Nyquist column
+	const uint32_t width = std::min(kBlock, m_specWidth - c0);
+	float* x = scratch;
+	float* y = scratch + m_size * kRowFloats;
+
+	for (uint32_t k(0); k < m_size; ++k)
+	{
+		const fftwf_complex* src = in + k * m_specWidth + c0;
+		float* dst = x + k * kRowFloats;
+
+		for (uint32_t b(0); b < kBlock; ++b)
+		{
+			dst[2 * b] = (b < width) ? src[b][0] : 0.0f;
+			dst[2 * b + 1] = (b < width) ? src[b][1] : 0.0f;
+		}
+	}
+
+	const float* result = Run_Stages(m_columnStages, x, y);
+
+	for (uint32_t k(0); k < m_size; ++k)
+	{
+		const float* src = result + k * kRowFloats;
+		fftwf_complex* dst = out + k * m_specWidth + c0;
+
+		for (uint32_t b(0); b < width; ++b)
+		{
+			dst[b][0] = src[2 * b];
+			dst[b][1] = src[2 * b + 1];
+		}
+	}
+}
+
+void StockhamFFT::Row_Block_Complex(fftwf_complex* data, const uint32_t& r0, float* scratch)
+{
+	float* x = scratch;
+	float* y = scratch + m_size * kRowFloats;
+
+	// Transpose kBlock rows into the lanes
+	for (uint32_t b(0); b < kBlock; ++b)
+	{
+		const fftwf_complex* row = data + (r0 + b) * m_size;
+		for (uint32_t k(0); k < m_size; ++k)
+		{
+			x[k * kRowFloats + 2 * b] = row[k][0];
+			x[k * kRowFloats + 2 * b + 1] = row[k][1];
+		}
+	}
+
+	const float* result = Run_Stages(m_rowStages, x, y);
+
+	for (uint32_t b(0); b < kBlock; ++b)
+	{
+		fftwf_complex* row = data + (r0 + b) * m_size;
+		for (uint32_t k(0); k < m_size; ++k)
+		{
+			row[k][0] = result[k * kRowFloats + 2 * b];
+			row[k][1] = result[k * kRowFloats + 2 * b + 1];
+		}
+	}
+}
+
+void StockhamFFT::Row_Block_Real(const fftwf_complex* in, float* out, const uint32_t& r0, float* scratch)
+{
+	const uint32_t half = m_size / 2;
+	float* x = scratch;
+	float* y = scratch + m_size * kRowFloats;
+
+	// Z[k] = (X[k] + X[k + N/2]) + i * w^k * (X[k] - X[k + N/2]), where
+	// X[k + N/2] = conj(X[N/2 - k]) is read from the stored half spectrum.
+	// The DC and Nyquist bins are taken as real, like FFTW does.
+	for (uint32_t b(0); b < kBlock; ++b)
+	{
+		const fftwf_complex* row = in + (r0 + b) * m_specWidth;
+		for (uint32_t k(0); k < half; ++k)
+		{
+			const float xr = row[k][0], xi = k ? row[k][1] : 0.0f;
+			const float cr = row[half - k][0], ci = k ? -row[half - k][1] : 0.0f;
+			const float wr = m_realTwiddles[2 * k], wi = m_realTwiddles[2 * k + 1];
+
+			const float dr = xr - cr, di = xi - ci;
+			const float wdr = wr * dr - wi * di, wdi = wr * di + wi * dr;
+
+			x[k * kRowFloats + 2 * b] = xr + cr - wdi;
+			x[k * kRowFloats + 2 * b + 1] = xi + ci + wdr;
+		}
+	}
+
+	const float* result = Run_Stages(m_rowStages, x, y);
+
+	// z[n] holds x[2n] and x[2n + 1] back to back
+	for (uint32_t b(0); b < kBlock; ++b)
+	{
+		float* row = out + (r0 + b) * m_size;
+		for (uint32_t n(0); n < half; ++n)
+		{
+			row[2 * n] = result[n * kRowFloats + 2 * b];
+			row[2 * n + 1] = result[n * kRowFloats + 2 * b + 1];
+		}
+	}
+}
+
+void StockhamFFT::Zero_Column_Block(fftwf_complex* out, const uint32_t& c0)
+{
+	// The transform of zero columns, for the complex row pass to read
+	const uint32_t width = std::min(kBlock, m_specWidth - c0);
+
+	for (uint32_t k(0); k < m_size; ++k)
+		memset(out + k * m_specWidth + c0, 0, width * sizeof(fftwf_complex));
+}
+
+void StockhamFFT::Execute(fftwf_complex* in, void* out, const int& threads, const uint8_t* zeroColumns)
+{
+	// Ping-pong scratch of kBlock transforms per thread
+	const uint32_t scratchFloats = 2 * m_size * kRowFloats;
+	if (threads > m_scratchThreads)
+	{
+		_mm_free(m_scratch);
+		m_scratch = (float*)_mm_malloc(sizeof(float) * scratchFloats * threads, 64);
+		m_scratchThreads = threads;
+	}
+
+	const uint32_t specSize = m_size * m_specWidth;
+	const uint32_t gridSize = m_size * m_size;
+	const int columnBlocks = (m_specWidth + kBlock - 1) / kBlock;
+	const int rowBlocks = m_size / kBlock;
+
+#pragma omp parallel num_threads(threads)
+	{
+		float* scratch = m_scratch + omp_get_thread_num() * scratchFloats;
+
+		// Columns of every transform first. The c2r columns are transformed in place.
+#pragma omp for schedule(static)
+		for (int block = 0; block < (int)m_howmany * columnBlocks; ++block)
+		{
+			const uint32_t t = block / columnBlocks;
+			const uint32_t c0 = (block % columnBlocks) * kBlock;
+			fftwf_complex* src = in + t * specSize;
+			fftwf_complex* dst = m_realOutput ? src : (fftwf_complex*)out + t * gridSize;
+
+			// Zero columns stay zero, in place there is nothing to write
+			bool zero = (zeroColumns != nullptr);
+			for (uint32_t col(c0); zero && col < std::min(c0 + kBlock, m_specWidth); ++col)
+				zero = zeroColumns[t * m_specWidth + col] != 0;
+
+			if (!zero)
+				Column_Block(src, dst, c0, scratch);
+			else if (!m_realOutput)
+				Zero_Column_Block(dst, c0);
+		}
+
+		// Then the rows, once every column is done
+#pragma omp for schedule(static)
+		for (int block = 0; block < (int)m_howmany * rowBlocks; ++block)
+		{
+			const uint32_t t = block / rowBlocks;
+			const uint32_t r0 = (block % rowBlocks) * kBlock;
+
+			if (m_realOutput)
+				Row_Block_Real(in + t * specSize, (float*)out + t * gridSize, r0, scratch);
+			else
+				Row_Block_Complex((fftwf_complex*)out + t * gridSize, r0, scratch);
+		}
+	}
+}
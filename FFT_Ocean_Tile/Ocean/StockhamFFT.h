@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "SpectrumKernels.h"
+
+//================================================================================
+// In-tree inverse 2D FFT for power-of-two square grids, without FFTW's
+// planner or library. Same layout and scaling as the FFTW plans it replaces:
+// howmany unnormalised backward transforms, one after the other, either
+// complex-to-complex or complex-to-real on the half spectrum.
+//
+// Both passes work on blocks of kBlock columns or rows, copied into a per-
+// thread scratch so that kBlock transforms run side by side, one complex
+// vector lane per transform. The radix-4 Stockham stages (plus one radix-2
+// stage for odd powers of two) then need no shuffles and only broadcast
+// twiddles, and the scratch stays in L1/L2 for every grid size we ship.
+// The c2r row pass runs a half-length complex FFT on the even and odd
+// samples, which come out interleaved as the real row.
+//================================================================================
+class StockhamFFT
+{
+public:
+	StockhamFFT(const uint32_t& size, const uint32_t& howmany, const bool& realOutput, const SimdLevel& level);
+	~StockhamFFT();
+
+	StockhamFFT(StockhamFFT const&) = delete; // Don't Implement
+	void operator=(StockhamFFT const&) = delete;   // Don't Implement
+
+	// Transforms per block, one cache line of complex values
+	static constexpr uint32_t kBlock = 8;
+
+	static bool Supports(const uint32_t& size) { return size >= 2 * kBlock && (size & (size - 1)) == 0; }
+
+	// in holds size * (size or size / 2 + 1) bins per transform, out size * size
+	// complex or real values. c2r transforms overwrite their input, like FFTW's.
+	// Blocks of columns flagged in zeroColumns, one flag per input column of
+	// every transform, are known to be zero and skip the column pass.
+	void Execute(fftwf_complex* in, void* out, const int& threads, const uint8_t* zeroColumns = nullptr);
+
+	// Arithmetic of one Execute, counted like fftwf_flops
+	inline double getFlops() { return m_flops; }
+
+private:
+	struct Stage
+	{
+		uint32_t radix;
+		uint32_t n;			// Remaining length, n = radix * m
+		uint32_t stride;	// s, with n * s = length
+		uint32_t twiddles;	// Offset of the (w1, w2, w3) table in m_twiddles
+	};
+
+	// Stages of one 1D length
+	struct Stages1D
+	{
+		uint32_t length;
+		std::vector<Stage> stages;
+		double flops;
+	};
+
+	void Build_Stages(const uint32_t& length, Stages1D& out);
+
+	// Returns the buffer holding the result, x or y
+	float* Run_Stages(const Stages1D& plan, float* x, float* y);
+
+	void Column_Block(const fftwf_complex* in, fftwf_complex* out, const uint32_t& c0, float* scratch);
+	void Zero_Column_Block(fftwf_complex* out, const uint32_t& c0);
+	void Row_Block_Complex(fftwf_complex* data, const uint32_t& r0, float* scratch);
+	void Row_Block_Real(const fftwf_complex* in, float* out, const uint32_t& r0, float* scratch);
+
+	const uint32_t m_size;
+	const uint32_t m_howmany;
+	const bool m_realOutput;
+	const uint32_t m_specWidth;		// Columns of the input, m_size / 2 + 1 for c2r
+	const SimdLevel m_simdLevel;
+
+	Stages1D m_columnStages;
+	Stages1D m_rowStages;			// Half length for c2r
+	std::vector<float> m_twiddles;
+	std::vector<float> m_realTwiddles;	// exp(i * 2pi * k / size), k < size / 2, for c2r
+
+	// Two scratch buffers of kBlock transforms per thread
+	float* m_scratch = nullptr;
+	int m_scratchThreads = 0;
+
+	double m_flops = 0;
+};
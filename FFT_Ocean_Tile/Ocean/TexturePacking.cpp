@@ -0,0 +1,249 @@
+#include "TexturePacking.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define KERNEL_TARGET_SSE
+#define KERNEL_TARGET_F16C
+#else
+#include <cpuid.h>
+#define KERNEL_TARGET_SSE __attribute__((target("sse4.1")))
+#define KERNEL_TARGET_F16C __attribute__((target("avx2,f16c")))
+#endif // _MSC_VER
+
+namespace
+{
+	const char* kTextureFormatNames[kMaxTextureFormats] = { "rgba32f", "rgba16f", "packed" };
+
+	// Every AVX2 CPU we know of has F16C, but it is a separate CPUID bit
+	bool HasF16C()
+	{
+		static const bool f16c = []()
+		{
+#ifdef _MSC_VER
+			int cpuInfo[4] = { 0 };
+			__cpuid(cpuInfo, 1);
+			return (cpuInfo[2] & (1 << 29)) != 0;
+#else
+			unsigned int eax, ebx, ecx, edx;
+			return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_F16C) != 0;
+#endif // _MSC_VER
+		}();
+
+		return f16c;
+	}
+}
+
+const char* TextureFormatName(const TextureFormat& format)
+{
+	return (format >= 0 && format < kMaxTextureFormats) ? kTextureFormatNames[format] : "unknown";
+}
+
+uint16_t FloatToHalf(const float& value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const uint32_t sign = bits & 0x80000000u;
+	bits ^= sign;
+
+	uint32_t half;
+	if (bits >= 0x47800000u)
+	{
+		// Too large for a half, infinity or NaN
+		half = (bits > 0x7f800000u) ? 0x7e00 : 0x7c00;
+	}
+	else if (bits < 0x38800000u)
+	{
+		// Denormal or zero. Adding 0.5 aligns the 10 mantissa bits at the
+		// bottom of the float, and the float addition does the rounding.
+		const uint32_t magicBits = 126u << 23;
+		float magic, sum;
+		memcpy(&magic, &magicBits, sizeof(magic));
+		memcpy(&sum, &bits, sizeof(sum));
+		sum += magic;
+		memcpy(&half, &sum, sizeof(half));
+		half -= magicBits;
+	}
+	else
+	{
+		// Rebias the exponent and round the mantissa to nearest even
+		const uint32_t mantissaOdd = (bits >> 13) & 1;
+		bits += ((15u - 127u) << 23) + 0xfff + mantissaOdd;
+		half = bits >> 13;
+	}
+
+	return (uint16_t)(half | (sign >> 16));
+}
+
+//--------------------------------------------------------------------------------------
+// Scalar conversions, also used for the tails of the vector loops
+//--------------------------------------------------------------------------------------
+static void PackHalfScalar(const float* texels, uint16_t* out, uint32_t begin, uint32_t end)
+{
+	for (uint32_t v(4 * begin); v < 4 * end; ++v)
+		out[v] = FloatToHalf(texels[v]);
+}
+
+static void PackDisplacementScalar(const float* texels, uint16_t* out, const float mul[3], float peak[3], uint32_t begin, uint32_t end)
+{
+	for (uint32_t n(begin); n < end; ++n)
+	{
+		for (int c(0); c < 3; ++c)
+		{
+			const float d = texels[4 * n + c];
+			const float u = std::min(std::max(d * mul[c] + 0.5f, 0.0f), 1.0f);
+
+			peak[c] = std::max(peak[c], fabsf(d));
+			out[4 * n + c] = (uint16_t)(u * 65535.0f + 0.5f);
+		}
+
+		out[4 * n + 3] = 65535;
+	}
+}
+
+static void PackNormalScalar(const float* texels, int16_t* normals, uint8_t* foam, uint32_t begin, uint32_t end)
+{
+	for (uint32_t n(begin); n < end; ++n)
+	{
+		const float* t = texels + 4 * n;
+		const float length = sqrtf(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+
+		normals[2 * n + 0] = (int16_t)lrintf(std::min(std::max(t[0] / length, -1.0f), 1.0f) * 32767.0f);
+		normals[2 * n + 1] = (int16_t)lrintf(std::min(std::max(t[2] / length, -1.0f), 1.0f) * 32767.0f);
+		foam[n] = (uint8_t)(t[3] * 255.0f + 0.5f);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// SSE4.1 conversions, one texel per vector for the displacement and four
+// transposed texels for the normals
+//--------------------------------------------------------------------------------------
+KERNEL_TARGET_SSE static void PackDisplacementSSE(const float* texels, uint16_t* out, const float mul[3], float peak[3], uint32_t begin, uint32_t end)
+{
+	const __m128 vMul = _mm_setr_ps(mul[0], mul[1], mul[2], 0.0f);
+	const __m128 vBias = _mm_setr_ps(0.5f, 0.5f, 0.5f, 1.0f);
+	const __m128 vZero = _mm_setzero_ps();
+	const __m128 vOne = _mm_set1_ps(1.0f);
+	const __m128 vRange = _mm_set1_ps(65535.0f);
+	const __m128 vHalf = _mm_set1_ps(0.5f);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 vPeak = _mm_setzero_ps();
+
+	uint32_t n(begin);
+	for (; n + 2 <= end; n += 2)
+	{
+		const __m128 d0 = _mm_loadu_ps(texels + 4 * n);
+		const __m128 d1 = _mm_loadu_ps(texels + 4 * n + 4);
+
+		vPeak = _mm_max_ps(vPeak, _mm_max_ps(_mm_and_ps(d0, absMask), _mm_and_ps(d1, absMask)));
+
+		const __m128 u0 = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(d0, vMul), vBias), vZero), vOne);
+		const __m128 u1 = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(d1, vMul), vBias), vZero), vOne);
+
+		const __m128i i0 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(u0, vRange), vHalf));
+		const __m128i i1 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(u1, vRange), vHalf));
+
+		_mm_storeu_si128((__m128i*)(out + 4 * n), _mm_packus_epi32(i0, i1));
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, vPeak);
+	for (int c(0); c < 3; ++c)
+		peak[c] = std::max(peak[c], lanes[c]);
+
+	PackDisplacementScalar(texels, out, mul, peak, n, end);
+}
+
+KERNEL_TARGET_SSE static void PackNormalSSE(const float* texels, int16_t* normals, uint8_t* foam, uint32_t begin, uint32_t end)
+{
+	const __m128 vOne = _mm_set1_ps(1.0f);
+	const __m128 vMinusOne = _mm_set1_ps(-1.0f);
+	const __m128 vSnorm = _mm_set1_ps(32767.0f);
+	const __m128 vUnorm = _mm_set1_ps(255.0f);
+	const __m128 vHalf = _mm_set1_ps(0.5f);
+
+	uint32_t n(begin);
+	for (; n + 4 <= end; n += 4)
+	{
+		__m128 x = _mm_loadu_ps(texels + 4 * n);
+		__m128 y = _mm_loadu_ps(texels + 4 * n + 4);
+		__m128 z = _mm_loadu_ps(texels + 4 * n + 8);
+		__m128 w = _mm_loadu_ps(texels + 4 * n + 12);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+		const __m128 nx = _mm_min_ps(_mm_max_ps(_mm_div_ps(x, length), vMinusOne), vOne);
+		const __m128 nz = _mm_min_ps(_mm_max_ps(_mm_div_ps(z, length), vMinusOne), vOne);
+
+		// Round to nearest even, like lrintf
+		const __m128i ix = _mm_cvtps_epi32(_mm_mul_ps(nx, vSnorm));
+		const __m128i iz = _mm_cvtps_epi32(_mm_mul_ps(nz, vSnorm));
+
+		// x0 z0 x1 z1 x2 z2 x3 z3
+		const __m128i packed = _mm_packs_epi32(_mm_unpacklo_epi32(ix, iz), _mm_unpackhi_epi32(ix, iz));
+		_mm_storeu_si128((__m128i*)(normals + 2 * n), packed);
+
+		const __m128i iw = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(w, vUnorm), vHalf));
+		const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(iw, iw), _mm_setzero_si128());
+		const int word = _mm_cvtsi128_si32(bytes);
+		memcpy(foam + n, &word, sizeof(word));
+	}
+
+	PackNormalScalar(texels, normals, foam, n, end);
+}
+
+//--------------------------------------------------------------------------------------
+// F16C conversion, two texels per vector
+//--------------------------------------------------------------------------------------
+KERNEL_TARGET_F16C static void PackHalfF16C(const float* texels, uint16_t* out, uint32_t begin, uint32_t end)
+{
+	uint32_t n(begin);
+	for (; n + 4 <= end; n += 4)
+	{
+		const __m256 v0 = _mm256_loadu_ps(texels + 4 * n);
+		const __m256 v1 = _mm256_loadu_ps(texels + 4 * n + 8);
+
+		_mm_storeu_si128((__m128i*)(out + 4 * n), _mm256_cvtps_ph(v0, _MM_FROUND_TO_NEAREST_INT));
+		_mm_storeu_si128((__m128i*)(out + 4 * n + 8), _mm256_cvtps_ph(v1, _MM_FROUND_TO_NEAREST_INT));
+	}
+
+	PackHalfScalar(texels, out, n, end);
+}
+
+//--------------------------------------------------------------------------------------
+// Dispatch
+//--------------------------------------------------------------------------------------
+void PackHalfTexels(const float* texels, uint16_t* out, const uint32_t& begin, const uint32_t& end, const SimdLevel& level)
+{
+	if (level == kSimdAVX2 && HasF16C())
+		PackHalfF16C(texels, out, begin, end);
+	else
+		PackHalfScalar(texels, out, begin, end);
+}
+
+void PackDisplacementTexels(const float* texels, uint16_t* out, const float scale[3], float peak[3],
+	const uint32_t& begin, const uint32_t& end, const SimdLevel& level)
+{
+	// A flat ocean has no range, every texel maps to the middle
+	float mul[3];
+	for (int c(0); c < 3; ++c)
+		mul[c] = (scale[c] > 0) ? 0.5f / scale[c] : 0.0f;
+
+	if (level >= kSimdSSE)
+		PackDisplacementSSE(texels, out, mul, peak, begin, end);
+	else
+		PackDisplacementScalar(texels, out, mul, peak, begin, end);
+}
+
+void PackNormalTexels(const float* texels, int16_t* normals, uint8_t* foam,
+	const uint32_t& begin, const uint32_t& end, const SimdLevel& level)
+{
+	if (level >= kSimdSSE)
+		PackNormalSSE(texels, normals, foam, begin, end);
+	else
+		PackNormalScalar(texels, normals, foam, begin, end);
+}
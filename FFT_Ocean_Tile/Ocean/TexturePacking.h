@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+
+#include "SpectrumKernels.h"
+
+//--------------------------------------------------------------------------------------
+// Upload formats of the CPU textures. The RGBA32F textures stay the reference
+// outputs, the other formats are converted from them before the upload.
+//--------------------------------------------------------------------------------------
+enum TextureFormat
+{
+	kTextureRGBA32F,	// Heightmap and normal map as RGBA32F, 32 bytes per texel
+	kTextureRGBA16F,	// Both as RGBA16F, 16 bytes per texel
+	kTexturePacked,		// Displacement as RGBA16 UNORM with a per-frame scale, normals as RG16 SNORM
+						// and foam as R8 UNORM, 13 bytes per texel
+	kMaxTextureFormats
+};
+
+const char* TextureFormatName(const TextureFormat& format);
+
+// Round to nearest even, like F16C
+uint16_t FloatToHalf(const float& value);
+
+//--------------------------------------------------------------------------------------
+// Conversions of the RGBA32F texels [begin, end)
+//--------------------------------------------------------------------------------------
+
+// Every channel as a half
+void PackHalfTexels(const float* texels, uint16_t* out, const uint32_t& begin, const uint32_t& end, const SimdLevel& level);
+
+// XYZ displacement as UNORM, with d = (2u - 1) * scale per channel and W = 1.
+// Displacements beyond the scale are clamped, and the largest |d| per channel
+// is merged into peak.
+void PackDisplacementTexels(const float* texels, uint16_t* out, const float scale[3], float peak[3],
+	const uint32_t& begin, const uint32_t& end, const SimdLevel& level);
+
+// X and Z of the normalised normal as SNORM, the up axis is rebuilt by the
+// shader. The foam flag in W goes to its own UNORM8 texture.
+void PackNormalTexels(const float* texels, int16_t* normals, uint8_t* foam,
+	const uint32_t& begin, const uint32_t& end, const SimdLevel& level);
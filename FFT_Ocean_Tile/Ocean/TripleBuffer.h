@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//================================================================================
+// Lock-free handoff of the latest value from one writer thread to one reader
+// thread. The writer fills the back slot and publishes it, the reader takes
+// the newest published slot as its front. Neither side ever waits, and
+// publishing again before the reader has looked replaces the unread value.
+//================================================================================
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() :m_middle(kMiddleSlot) {}
+
+	TripleBuffer(TripleBuffer const&) = delete; // Don't Implement
+	void operator=(TripleBuffer const&) = delete;   // Don't Implement
+
+	// Writer side. The back slot becomes the newest value, and the writer
+	// gets the slot that neither the reader nor the newest value holds.
+	inline T& Back() { return m_slots[m_back]; }
+
+	void Publish()
+	{
+		m_back = m_middle.exchange(m_back | kFreshBit, std::memory_order_acq_rel) & kSlotMask;
+	}
+
+	// Reader side. Returns false if nothing newer than the front was published.
+	inline T& Front() { return m_slots[m_front]; }
+
+	bool Acquire()
+	{
+		if (!(m_middle.load(std::memory_order_relaxed) & kFreshBit))
+			return false;
+
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & kSlotMask;
+		return true;
+	}
+
+	// Every slot, for setting them up before the threads start
+	inline T& Slot(const uint32_t& slot) { return m_slots[slot]; }
+
+private:
+	static const uint32_t kSlotMask = 3;
+	static const uint32_t kFreshBit = 4;		// Set while the middle slot hasn't been acquired
+	static const uint32_t kMiddleSlot = 2;
+
+	T m_slots[3];
+
+	// Each side's index on its own cache line
+	alignas(64) uint32_t m_back = 0;
+	alignas(64) uint32_t m_front = 1;
+	alignas(64) std::atomic<uint32_t> m_middle;
+};
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "OceanSurface.h"
+#include "SimulationPipeline.h"
+
+//================================================================================
+//
+//        Checks of the simulation and its settings that need no GPU.
+//        Prints every check, and exits with 1 if any of them fails.
+//        Usage: OceanTests
+//
+//================================================================================
+
+//================================================================================
+// Constants
+//================================================================================
+constexpr int kSurfaceGridSize = 256;
+constexpr uint32_t kSurfaceQueries = 20000;
+constexpr float kSurfaceTileSize = 600.0f;		// Three times the patch, so the world scale is checked too
+constexpr double kMinConverged = 0.99;			// Of the queries at the gentle choppiness
+
+//================================================================================
+// Test helpers
+//================================================================================
+
+// Horizontal displacement of the RGBA32F heightmap over a point, summed over
+// the cascades, sampled bilinearly with wrap independently of OceanSurface
+void sample_displacement(FFTWrapper& wrapper, const float& worldScale, const double& x, const double& z, double disp[2])
+{
+	const int n = (int)wrapper.getWidth();
+	disp[0] = disp[1] = 0;
+
+	for (uint32_t c = 0; c < wrapper.getCascadeCount(); ++c)
+	{
+		const float* image = wrapper.getTextures().image + (size_t)c * n * n * 4;
+		const double texelsPerUnit = n / (wrapper.getPatchSize(c) * worldScale);
+		const double u = x * texelsPerUnit, v = z * texelsPerUnit;
+		const double fu = u - floor(u), fv = v - floor(v);
+		const int i0 = (int)floor(u) & (n - 1), j0 = (int)floor(v) & (n - 1);
+		const int i1 = (i0 + 1) & (n - 1), j1 = (j0 + 1) & (n - 1);
+
+		for (int d = 0; d < 2; ++d)
+		{
+			const int ch = 2 * d;
+			const double s0 = image[(j0 * n + i0) * 4 + ch] * (1 - fu) + image[(j0 * n + i1) * 4 + ch] * fu;
+			const double s1 = image[(j1 * n + i0) * 4 + ch] * (1 - fu) + image[(j1 * n + i1) * 4 + ch] * fu;
+			disp[d] += s0 * (1 - fv) + s1 * fv;
+		}
+	}
+}
+
+//================================================================================
+// Checks
+//================================================================================
+
+// Every converged query's texel, displaced, lands within the tolerance of its point
+bool check_surface_residual()
+{
+	PipelineSettings settings;
+	settings.mode = kPipelineCpuNormFFT;
+	settings.gridSize = kSurfaceGridSize;
+	settings.backend = kBackendStockham;
+	settings.cascades = 2;
+	settings.seed = 7;
+	settings.spectrumCache = false;
+	settings.textureFormat = kTextureRGBA32F;
+
+	std::unique_ptr<SimulationPipeline> pipeline = CreatePipeline(settings.mode);
+	std::unique_ptr<FFTWrapper> wrapper = pipeline->Create_Wrapper(settings);
+	wrapper->Generate_Heightmap();
+
+	std::mt19937 e2(1);
+	std::uniform_real_distribution<float> dist(-kSurfaceTileSize, kSurfaceTileSize);
+	std::vector<float> x(kSurfaceQueries), z(kSurfaceQueries), sourceX(kSurfaceQueries), sourceZ(kSurfaceQueries);
+	std::vector<uint8_t> converged(kSurfaceQueries);
+	for (uint32_t q = 0; q < kSurfaceQueries; ++q)
+	{
+		x[q] = dist(e2);
+		z[q] = dist(e2);
+	}
+
+	SurfaceBatch out;
+	out.converged = converged.data();
+	out.sourceX = sourceX.data();
+	out.sourceZ = sourceZ.data();
+
+	bool passed = true;
+	for (const float choppy : { 0.3f, 1.3f })
+	{
+		const PipelineFrame frame = { choppy, 1.2f, 2.0f, settings.timescale, settings.seaState, 0 };
+		pipeline->Step(*wrapper, frame);
+
+		OceanSurface surface;
+		surface.setTileSize(kSurfaceTileSize);
+		surface.Update(*wrapper, wrapper->getTextures(), frame.choppy, frame.heightAdj, frame.timescale);
+		surface.Query_Batch(x.data(), z.data(), kSurfaceQueries, out);
+
+		const float worldScale = surface.getTileSize() / wrapper->getPatchSize(0);
+		uint32_t convergedCount = 0;
+		double worstResidual = 0;
+
+		for (uint32_t q = 0; q < kSurfaceQueries; ++q)
+		{
+			if (!converged[q])
+				continue;
+
+			double disp[2];
+			sample_displacement(*wrapper, worldScale, sourceX[q], sourceZ[q], disp);
+
+			const double rx = sourceX[q] - choppy * worldScale * disp[0] - x[q];
+			const double rz = sourceZ[q] - choppy * worldScale * disp[1] - z[q];
+			worstResidual = std::max(worstResidual, sqrt(rx * rx + rz * rz));
+			++convergedCount;
+		}
+
+		const double convergedFraction = (double)convergedCount / kSurfaceQueries;
+		printf("Surface residual, choppy %.1f: %.1f%% converged, worst residual %.3g (tolerance %.3g)\n",
+			choppy, 100.0 * convergedFraction, worstResidual, surface.getTolerance());
+
+		// Rounding of the float positions on top of the tolerance
+		if (worstResidual > surface.getTolerance() * 1.01 + 1e-4)
+			passed = false;
+		if (choppy < 1.0f && convergedFraction < kMinConverged)
+			passed = false;
+	}
+
+	return passed;
+}
+
+// Settings take valid values and reject the others, leaving the settings as they were
+bool check_settings()
+{
+	struct Case
+	{
+		const char* key;
+		const char* value;
+		bool valid;
+	};
+
+	static const Case cases[] =
+	{
+		{ "grid", "256", true }, { "grid", "300", false }, { "grid", "8", false }, { "grid", "big", false }, { "grid", "256x", false },
+		{ "threads", "0", true }, { "threads", "4", true }, { "threads", "x", false }, { "threads", "-2", false }, { "threads", "", false },
+		{ "cascades", "3", true }, { "cascades", "0", false }, { "cascades", "5", false }, { "cascades", "2abc", false },
+		{ "timescale", "0.02", true }, { "timescale", "fast", false }, { "timescale", "-1", false }, { "timescale", "inf", false },
+		{ "seed", "7", true }, { "seed", "4294967295", true }, { "seed", "4294967296", false }, { "seed", "-1", false }, { "seed", "abc", false },
+		{ "wind", "12.5", true }, { "wind", "abc", false }, { "wind", "0", false }, { "wind", "nan", false },
+		{ "fetch", "50000", true }, { "fetch", "0.5", false }, { "fetch", "far", false },
+		{ "depth", "20", true }, { "depth", "0", false }, { "depth", "deep", false },
+		{ "prune", "off", true }, { "prune", "0.05", true }, { "prune", "0.5", false }, { "prune", "-0.1", false }, { "prune", "some", false },
+		{ "bake", "20", true }, { "bake", "-1", false }, { "bake", "long", false },
+		{ "no_such_key", "1", false },
+	};
+
+	bool passed = true;
+	for (const Case& c : cases)
+	{
+		PipelineSettings settings;
+		const PipelineSettings defaults;
+
+		const bool accepted = ApplyPipelineSetting(settings, c.key, c.value);
+
+		// A rejected value leaves every setting at its default
+		const bool unchanged = settings.gridSize == defaults.gridSize && settings.threads == defaults.threads &&
+			settings.cascades == defaults.cascades && settings.timescale == defaults.timescale && settings.seed == defaults.seed &&
+			settings.seaState.windSpeed == defaults.seaState.windSpeed && settings.seaState.fetch == defaults.seaState.fetch &&
+			settings.seaState.depth == defaults.seaState.depth && settings.pruneEnergy == defaults.pruneEnergy &&
+			settings.bakePeriod == defaults.bakePeriod;
+
+		if (accepted != c.valid || (!accepted && !unchanged))
+		{
+			printf("Setting %s = \"%s\" was %s\n", c.key, c.value, accepted ? "accepted" : "rejected");
+			passed = false;
+		}
+	}
+
+	printf("Settings: %d cases\n", (int)(sizeof(cases) / sizeof(cases[0])));
+	return passed;
+}
+
+//================================================================================
+// Entry point
+//================================================================================
+int main()
+{
+	int failures = 0;
+
+	if (!check_settings())
+	{
+		printf("FAILED: settings\n");
+		++failures;
+	}
+
+	if (!check_surface_residual())
+	{
+		printf("FAILED: OceanSurface queries\n");
+		++failures;
+	}
+
+	printf("%d checks failed\n", failures);
+	return failures ? 1 : 0;
+}